@@ -30,17 +30,27 @@
 #define LUBYK_INCLUDE_LENS_FILE_H_
 
 #include "lens/lens.h"
+#include "lens/Pool.h"
 
 #include "dub/dub.h"
 
 #include <sys/fcntl.h> // O_READ
 #include <errno.h>     // errno
 #include <unistd.h>    // close
+#include <sys/mman.h>  // mmap, madvise
+
+#include <string>
 
 // 8 Ko
 // Maybe we could pass an argument to make this size smaller/bigger
 #define MAX_BUFF_SIZE 8196
 
+// readAll maps regular files of this size or more instead of reading them.
+#define MMAP_THRESHOLD (1 << 20)
+
+// Largest chunk read in one call by read.
+#define MAX_READ_CHUNK (1 << 20)
+
 namespace lens {
 
 /** OS popen wrapper.
@@ -68,6 +78,56 @@ class File {
   /** Buffer that contains received data not yet used by Lua.
    */
   char buffer_[MAX_BUFF_SIZE];
+
+  /** File content in Mmap mode (NULL for empty files).
+   */
+  char *map_;
+
+  size_t map_size_;
+
+  /** Read position in the mapped content.
+   */
+  size_t map_i_;
+
+  /** Read, write or sync running in a lens::Pool thread.
+   */
+  struct IOJob : public Pool::Job {
+    enum Op {
+      ReadOp,
+      WriteOp,
+      SyncOp,
+      DataSyncOp,
+    };
+    int file_fd;
+    int op;
+    // Bytes to read (buffered bytes before the data to write).
+    size_t size;
+    // Data read or to write.
+    std::string data;
+    // Bytes written.
+    size_t written;
+    // errno or 0.
+    int error;
+
+  protected:
+    virtual void run();
+  };
+
+  /** Created on first async operation (NULL before).
+   */
+  IOJob *io_;
+
+  /** True from start{Read,Write,Sync} until the result is collected.
+   */
+  bool io_pending_;
+
+  /** Data written but not yet sent to the OS (see setWriteBuffer).
+   */
+  std::string wbuf_;
+
+  /** Flush threshold (0 = no write buffering).
+   */
+  size_t wbuf_size_;
   
 public:
   enum Mode {
@@ -75,11 +135,25 @@ public:
     Read   = O_RDONLY,
     Write  = O_WRONLY,
     Append = O_APPEND,
+    // Read and write (created if missing), mostly for #readAt and #writeAt.
+    ReadWrite = O_RDWR | O_CREAT,
 #ifdef O_EVTONLY
     Events = O_EVTONLY,
 #else
     Events = 32768,
 #endif
+    // Read only, the whole file is mapped in memory.
+    Mmap   = 0x10000000,
+  };
+
+  /** Access pattern hints for Mmap mode (see #advise).
+   */
+  enum Advice {
+    Normal     = MADV_NORMAL,
+    Sequential = MADV_SEQUENTIAL,
+    Random     = MADV_RANDOM,
+    WillNeed   = MADV_WILLNEED,
+    DontNeed   = MADV_DONTNEED,
   };
 
   
@@ -105,17 +179,27 @@ public:
     , mode_(mode)
     , buffer_length_(0)
     , buffer_i_(0)
+    , map_(NULL)
+    , map_size_(0)
+    , map_i_(0)
+    , io_(NULL)
+    , io_pending_(false)
+    , wbuf_size_(0)
   {
     if (mode != None) {
-      fd_ = open(path, (int)mode);
+      fd_ = open(path, mode == Mmap ? O_RDONLY : (int)mode, 0666);
       if (fd_ < 0) {
         throw dub::Exception("Could not open file '%s' (%s).", path, strerror(errno));
       }
+      if (mode == Mmap) {
+        map(path);
+      }
     }
   }
 
   virtual ~File() {
     close();
+    if (io_) Pool::release(io_);
   }
 
   int fd() {
@@ -123,6 +207,17 @@ public:
   }
 
   void close() {
+    if (io_pending_) {
+      // The pool thread must not use a closed (and maybe reused) fd.
+      waitIO();
+    }
+    if (!wbuf_.empty()) {
+      flushOnClose();
+    }
+    if (map_) {
+      munmap(map_, map_size_);
+      map_ = NULL;
+    }
     if (fd_) {
       ::close(fd_);
       fd_ = 0;
@@ -130,19 +225,116 @@ public:
   }
 
 
-  // Return string and op
+  // Return string and op. The string is shorter than `sz` on EOF (op is End)
+  // or if reading would block (op is Wait). Data is read directly in the Lua
+  // buffer.
   LuaStackSize read(size_t sz, lua_State *L);
 
-  // Return string and op
+  // Return string and op. Params: optional delimiter character (default "\n")
+  // and keep_cr flag to keep a "\r" before "\n".
   LuaStackSize readLine(lua_State *L);
 
-  // Read everyting until EOF is reached.
+  // Read everyting until EOF is reached. Return string and op (End or Wait).
+  // Regular files are read with a single allocation (or mapped in memory if
+  // they are larger than MMAP_THRESHOLD).
   LuaStackSize readAll(lua_State *L);
 
-  // Return written size and op
+  // Return written size and op. With a write buffer, small writes are
+  // appended to the buffer and only sent to the OS when it is full.
   LuaStackSize write(lua_State *L);
 
+  // Read at `offset` without using or moving the read position so that many
+  // threads can share the file. The arguments after `offset` are lengths: one
+  // string is returned per length (shorter if the file ends first). Returns
+  // nil if nothing could be read. All parts are read with a single call.
+  LuaStackSize readAt(double offset, lua_State *L);
+
+  // Write the string arguments after `offset` at this position (pwritev).
+  // This does not use the write buffer nor move the write position. Returns
+  // the written size.
+  LuaStackSize writeAt(double offset, lua_State *L);
+
+  // Coalesce writes in a buffer of `size` bytes (0 disables buffering).
+  void setWriteBuffer(double size) {
+    wbuf_size_ = size;
+  }
+
+  // Send buffered data to the OS. Returns op (Wait if writing would block).
+  // Throws during an async write (the data must wait for it).
+  int flush();
+
+  // Number of bytes in the write buffer.
+  double buffered() {
+    return wbuf_.size();
+  }
+
+  // Return `len` bytes at `offset` as a string (Mmap mode). The string is
+  // shorter if the file ends first. This does not move the read position.
+  LuaStackSize slice(double offset, double len, lua_State *L);
+
+  // Give the kernel an access pattern hint for `len` bytes at `offset`
+  // (Mmap mode). With len 0, the hint applies to the rest of the file.
+  void advise(int advice, double offset = 0, double len = 0);
+
+  // Size of the mapped file (Mmap mode).
+  double size() {
+    return map_size_;
+  }
+
+  // Start reading `sz` bytes in a lens::Pool thread. Regular files are always
+  // ready for poll so a slow disk would otherwise block the scheduler. Wait on
+  // #ioFd until #ioDone and then collect the data with #ioResult.
+  void startRead(double sz);
+
+  // Start writing the string argument in a pool thread.
+  void startWrite(lua_State *L);
+
+  // Start fsync (or fdatasync if `data_only` is true) in a pool thread.
+  // Buffered data is written first (in the calling thread).
+  void startSync(bool data_only = false);
+
+  // File descriptor readable when the async operation is done.
+  int ioFd() {
+    if (!io_) throw dub::Exception("No async operation started.");
+    return io_->fd();
+  }
+
+  bool ioDone() {
+    return !io_pending_ || io_->done();
+  }
+
+  // Return the data read (nil on EOF), the written size or true after sync.
+  LuaStackSize ioResult(lua_State *L);
+
 protected:
+  // Read up to sz bytes in the Lua buffer. Return op.
+  int readInto(luaL_Buffer *buffer, size_t sz);
+
+  // Map the whole file (Mmap mode).
+  void map(const char *path);
+
+  // readLine in Mmap mode.
+  LuaStackSize readMappedLine(char delim, bool strip_cr, lua_State *L);
+
+  // Get a ready to submit job (throws if an operation is pending).
+  IOJob *ioJob(int op);
+
+  // Block until the pending async operation is done.
+  void waitIO();
+
+  // Send buffered writes before an operation which does not use the buffer
+  // (reads in ReadWrite mode, writeAt).
+  void flushWrites();
+
+  // Flush, blocking if needed. Errors are ignored.
+  void flushOnClose();
+
+  // True while an async read or write uses the file position (a sync does
+  // not).
+  bool ioBusy() {
+    return io_pending_ && io_->op <= IOJob::WriteOp;
+  }
+
   void setFd(int fd) {
     fd_ = fd;
   }
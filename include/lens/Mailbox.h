@@ -0,0 +1,125 @@
+/*
+  ==============================================================================
+
+   This file is part of the LUBYK project (http://lubyk.org)
+   Copyright (c) 2007-2014 by Gaspard Bucher (http://teti.ch).
+
+  ------------------------------------------------------------------------------
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+
+  ==============================================================================
+*/
+#ifndef LUBYK_INCLUDE_LENS_MAILBOX_H_
+#define LUBYK_INCLUDE_LENS_MAILBOX_H_
+
+#include "lens/lens.h"
+
+#include "dub/dub.h"
+
+#include <stdlib.h> // malloc, free
+
+namespace lens {
+
+/** Cross-thread message queue.
+ *
+ * Any thread can post strings in a Mailbox but only one thread should
+ * receive. Posting never blocks (lock-free list) and the receiving thread is
+ * woken up through a file descriptor (eventfd on linux, pipe elsewhere) that
+ * its scheduler polls like any other fd.
+ *
+ * Mailboxes passed to a lens.Worker are shared between the Lua states: the
+ * queue lives as long as one of the objects is alive.
+ *
+ * @dub string_format: %%i
+ *      string_args: self->pending()
+ */
+class Mailbox {
+  friend class Worker;
+
+  struct Message {
+    Message *next;
+    size_t len;
+    char data[1];
+  };
+
+  /** Shared queue (multiple producers, single consumer).
+   */
+  struct Queue {
+    int refcount;
+    // Last posted message (producers).
+    Message *head;
+    // Next message to receive (consumer).
+    Message *tail;
+    // Empty message to keep the list non-empty.
+    Message stub;
+    // Number of posted messages not yet received.
+    int pending;
+    // Wake up file descriptors (read, write).
+    int fds[2];
+  };
+
+  Queue *queue_;
+
+public:
+  Mailbox();
+
+  ~Mailbox();
+
+  /** Post a string (any thread). Wakes up the receiving thread if the
+   * mailbox was empty.
+   */
+  void post(lua_State *L);
+
+  /** Return next message or nil (non-blocking). When this returns nil and
+   * #pending is 0, the caller should wait for #fd to be readable.
+   */
+  LuaStackSize recv(lua_State *L);
+
+  /** Number of posted messages not yet received.
+   */
+  int pending() {
+    return __atomic_load_n(&queue_->pending, __ATOMIC_ACQUIRE);
+  }
+
+  /** File descriptor readable when messages are posted.
+   */
+  int fd() {
+    return queue_->fds[0];
+  }
+
+private:
+  /** Share an existing queue (used to pass mailboxes to workers).
+   */
+  Mailbox(Queue *queue);
+
+  static void retain(Queue *queue);
+
+  /** Free the queue when the last reference is released.
+   */
+  static void release(Queue *queue);
+
+  static void push(Queue *queue, Message *msg);
+
+  static Message *pop(Queue *queue);
+};
+
+} // lens
+
+#endif // LUBYK_INCLUDE_LENS_MAILBOX_H_
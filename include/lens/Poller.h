@@ -39,6 +39,16 @@
 #ifdef __APPLE__
 // Only works on mac os X for now. :-(
 #define LUBYK_POLLER_KEVENT
+#elif defined(__linux__) && !defined(LUBYK_POLLER_POLL)
+// Use epoll on linux. Build with -DLUBYK_POLLER_POLL to fallback to ::poll().
+#define LUBYK_POLLER_EPOLL
+#endif
+
+#if defined(LUBYK_POLLER_EPOLL) && !defined(LUBYK_POLLER_NO_URING) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+// io_uring can be selected at runtime with the URing backend.
+#define LUBYK_POLLER_URING
+#endif
 #endif
 
 #define DEBUG 0
@@ -61,11 +71,19 @@
 #ifdef LUBYK_POLLER_KEVENT
 #include <sys/event.h>
 #else
-#include <poll.h>   // poll()
+#include <poll.h>   // poll(), POLLIN, POLLOUT
+#endif
+
+#ifdef LUBYK_POLLER_EPOLL
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h> // close()
 #endif
 
 namespace lens {
 
+class Scheduler;
+
 /** lens basic Poller.
  *
  * @dub string_format: %%f
@@ -74,6 +92,9 @@ namespace lens {
  *      ignore: resume, backPoll
  */
 class Poller : public dub::Thread {
+  // The native run loop uses modifyItem, readyEvents and the completion I/O
+  // methods directly.
+  friend class Scheduler;
 
 #ifdef LUBYK_POLLER_KEVENT
   typedef struct kevent Pollitem;
@@ -83,6 +104,72 @@ class Poller : public dub::Thread {
   int kqueue_;
 
   Pollitem events_data_[MAX_REVENT_COUNT];
+#elif defined(LUBYK_POLLER_EPOLL)
+  /** Same layout as struct pollfd with the registration mode (Edge, OneShot
+   * and Fired bits).
+   */
+  struct Pollitem {
+    int   fd;
+    short events;
+    short revents;
+    int   mode;
+  };
+
+  /** State of a file descriptor in the epoll set. Several items can watch
+   * the same fd (epoll only accepts one registration per fd) so we
+   * register the union of their events.
+   */
+  struct FdState {
+    // First item idx watching this fd (-1 = none).
+    int head;
+    // Events registered in epoll (0 = nothing armed, -1 = fd cannot be
+    // polled by epoll and is always ready, like regular files with poll).
+    int events;
+    // True if the fd is in the epoll set (it can stay in the set with no
+    // armed events after an EPOLLONESHOT registration fired).
+    bool added;
+  };
+
+  /** Epoll instance.
+   */
+  int epoll_;
+
+  struct epoll_event events_data_[MAX_REVENT_COUNT];
+
+  /** Per fd registration (indexed by fd).
+   */
+  FdState *fds_;
+
+  /** Size of the fds_ array.
+   */
+  int fds_size_;
+
+  /** Next item idx watching the same fd (indexed by idx).
+   */
+  int *idx_next_;
+
+  /** Number of items that cannot be watched by epoll (always ready).
+   */
+  int ready_count_;
+
+  /** Timer in the epoll set used to wake up at the precise wake_at time
+   * (-1 if timerfd is not available).
+   */
+  int timer_fd_;
+
+  /** Absolute time (monotonic clock) of the armed timer (-1 = disarmed).
+   */
+  double timer_at_;
+
+#ifdef LUBYK_POLLER_URING
+  /** io_uring state (defined in src/linux/uring.cpp).
+   */
+  struct URingState;
+
+  /** Set when the URing backend is running. NULL = epoll.
+   */
+  URingState *uring_;
+#endif
 #else
   typedef struct pollfd Pollitem;
 #endif
@@ -104,6 +191,33 @@ class Poller : public dub::Thread {
    */
   int *pos_to_idx_;
 
+  /** Size of the arrays indexed by idx (idx_to_pos_, free_idx_).
+   */
+  int idx_size_;
+
+  /** Highest idx in use + 1. New idx are taken from free_idx_ or here.
+   */
+  int idx_count_;
+
+  /** Stack of free idx below idx_count_. Entries >= idx_count_ are stale
+   * (released by a decrease of idx_count_) and skipped.
+   */
+  int *free_idx_;
+
+  /** Number of entries in free_idx_.
+   */
+  int free_count_;
+
+  /** Minimal size of the arrays (we do not shrink below this).
+   */
+  int reserve_;
+
+  /** Ready item idx and revents collected after poll (see readyEvents).
+   */
+  int *ready_idx_;
+  int *ready_rev_;
+  int ready_size_;
+
   /** Number of slots used in the pollitems.
    */
   int used_count_;
@@ -134,6 +248,10 @@ class Poller : public dub::Thread {
    */
   static pthread_key_t sThisKey;
 
+  /** Creates sThisKey once (Pollers are created in several threads).
+   */
+  static pthread_once_t sThisKeyOnce;
+
   /** Implementation specific.
    */
   void *impl_ptr_;
@@ -144,16 +262,52 @@ public:
     Read  = 1, // POLLIN
     Write = 2, // POLLOUT
     VNode = 3,
+    // Registration flags (can be or-ed with Read and Write).
+    // Only report new readiness (EPOLLET, EV_CLEAR).
+    Edge    = 4,
+    // Report once and disarm until the item is modified (EPOLLONESHOT,
+    // EV_ONESHOT).
+    OneShot = 8,
+    // Event bits reported with Read and Write by fillEvents.
+    Hup     = 16,
+    Error   = 32,
   };
 
-  /** Create a poller and reserve free slots.
+  enum Backends {
+    // Best backend for the platform (kqueue, epoll or poll).
+    Default = 0,
+    KQueue,
+    EPoll,
+    // Linux io_uring. Falls back to EPoll if the kernel does not support it.
+    URing,
+    Poll,
+  };
+
+  /** Create a poller and reserve free slots. The `backend` argument is used
+   * to request a specific implementation (see Backends).
    */
-  Poller(int reserve=8);
+  Poller(int reserve=8, int backend=Default);
 
   ~Poller() {
+    if (pthread_getspecific(sThisKey) == this) {
+      // Next Poller in this thread handles interrupts.
+      pthread_setspecific(sThisKey, NULL);
+    }
     if (pollitems_)  free(pollitems_);
     if (idx_to_pos_) free(idx_to_pos_);
     if (pos_to_idx_) free(pos_to_idx_);
+    if (free_idx_)   free(free_idx_);
+    if (ready_idx_)  free(ready_idx_);
+    if (ready_rev_)  free(ready_rev_);
+#ifdef LUBYK_POLLER_EPOLL
+#ifdef LUBYK_POLLER_URING
+    if (uring_)      closeURing();
+#endif
+    if (fds_)        free(fds_);
+    if (idx_next_)   free(idx_next_);
+    if (timer_fd_ != -1) ::close(timer_fd_);
+    if (epoll_ != -1) ::close(epoll_);
+#endif
   }
 
   /** Polls for new events.
@@ -200,10 +354,51 @@ public:
       } else {
         return false;
       }
+#elif defined(LUBYK_POLLER_EPOLL)
+#ifdef LUBYK_POLLER_URING
+    if (uring_) {
+      // submit pending polls and wait (nanosecond timeout)
+      event_count_ = uringWait(timeout);
+    } else
+#endif
+    {
+      // Items that epoll cannot watch are always ready: do not block.
+      if (ready_count_ && timeout != 0) timeout = 0;
+      event_count_ = epollWait(wake_at, timeout);
+    }
+    if (event_count_ < 0) {
+      // error or interruption
+      event_count_ = 0;
+      if (!interrupted_) {
+        throw dub::Exception("An error occured during poll (%s)", strerror(errno));
+      } else {
+        return false;
+      }
+    } else if (ready_count_) {
+      // always ready items: do not sleep
+      return true;
+#elif defined(__linux__)
+    // ppoll expects a timespec
+    // negative timeout == wait forever
+    if (timeout >= 0) {
+      struct timespec ttimeout;
+      ttimeout.tv_sec  = timeout;
+      ttimeout.tv_nsec = (timeout - ttimeout.tv_sec) * 1000000000; // nanosec
+      event_count_ = ::ppoll(pollitems_, used_count_, &ttimeout, NULL);
+    } else {
+      event_count_ = ::ppoll(pollitems_, used_count_, NULL, NULL);
+    }
+    if (event_count_ < 0) {
+      // error or interruption
+      event_count_ = 0;
+      if (!interrupted_) {
+        throw dub::Exception("An error occured during poll (%s)", strerror(errno));
+      } else {
+        return false;
+      }
 #else
     // poll expects milliseconds
     // negative timeout == wait forever
-    // FIXME: replace with ::epoll on linux
     event_count_ = ::poll(pollitems_, used_count_, timeout * 1000);
     if (event_count_ < 0) {
       // error or interruption
@@ -269,37 +464,56 @@ public:
   /** Return a table with all event idx or nil.
    */
   LuaStackSize events(lua_State *L) {
-    if (!event_count_) return 0;
-    lua_newtable(L);
+    int count = readyEvents();
+    if (!count) {
+      // All events were for removed items.
+      return 0;
+    }
+    lua_createtable(L, count, 0);
     // <table>
-    int pos = 0;
-#ifdef LUBYK_POLLER_KEVENT
-    for(int i=0; i < event_count_; ++i) {
-      Pollitem *item = &events_data_[i];
-      // udata contains idx
-      lua_pushnumber(L, (intptr_t)item->udata);
+    for(int i=0; i < count; ++i) {
+      lua_pushnumber(L, ready_idx_[i]);
       // <table> <idx>
-      lua_rawseti(L, -2, ++pos);
+      lua_rawseti(L, -2, i + 1);
     }
-#else
-    for(int i=0; i < used_count_; ++i) {
-      Pollitem *item = pollitems_ + i;
-      if (item->revents) {
-        lua_pushnumber(L, pos_to_idx_[i]);
-        // <table> <idx>
-        lua_rawseti(L, -2, ++pos);
+    return 1;
+  }
+
+  /** Store event idx in the caller owned table `tbl` (tbl[1..count]) and
+   * return the event count. Entries past count are not cleared. If `revents`
+   * is a table, it receives the event mask (Read, Write, Hup, Error) for each
+   * entry. This does not allocate a new table on each poll.
+   */
+  LuaStackSize fillEvents(lua_State *L) {
+    // <self> <tbl> (<revents>)
+    if (!lua_istable(L, 2)) {
+      throw dub::Exception("Table expected to store events.");
+    }
+    int rev = 0;
+    if (lua_gettop(L) > 2 && !lua_isnil(L, 3)) {
+      if (!lua_istable(L, 3)) {
+        throw dub::Exception("Table expected to store revents.");
       }
-      if (pos == event_count_) break;
+      rev = 3;
     }
-#endif
-    event_count_ = 0;
+    int count = readyEvents();
+    for(int i=0; i < count; ++i) {
+      lua_pushnumber(L, ready_idx_[i]);
+      // <self> <tbl> (<revents>) <idx>
+      lua_rawseti(L, 2, i + 1);
+      if (rev) {
+        lua_pushnumber(L, ready_rev_[i]);
+        lua_rawseti(L, rev, i + 1);
+      }
+    }
+    lua_pushnumber(L, count);
     return 1;
   }
 
   // This must be called for the given thread before poll is called again.
   int fflags(int idx) {
 #ifdef LUBYK_POLLER_KEVENT
-    assert(idx < pollitems_size_ && idx >= 0);
+    assert(idx < idx_size_ && idx >= 0);
     int pos = idx_to_pos_[idx];
     return pollitems_[pos].fflags;
 #else
@@ -351,74 +565,26 @@ public:
     return addItem(fd, filter, fflags);
   }
 
-  /** Modify an item's filter by its id.
+  /** Modify an item's filter by its id. This also re-arms OneShot items.
    */
   void modify(int idx, int filter, lua_State *L) {
-    debug_print("modify idx:%i, filter:%i.\n", idx, filter);
-    assert(filter);
-    assert(idx < pollitems_size_ && idx >= 0);
-    Pollitem *item = pollitems_ + idx_to_pos_[idx];
     int fd     = -1;
-    int top    = lua_gettop(L);
-#ifdef LUBYK_POLLER_KEVENT
     int fflags = 0;
-#endif
+    int top    = lua_gettop(L);
     // <self> <idx> <filter> <new_fd> (<flags>)
     if (top > 3) {
       fd = dub::checkint(L, 4);
       if (top > 4) {
-#ifdef LUBYK_POLLER_KEVENT
         fflags = dub::checkint(L, 5);
-#else
-        // FIXME: Support file events on linux.
-        throw dub::Exception("File Watch not supported on this platform.");
-#endif
       }
     }
-#ifdef LUBYK_POLLER_KEVENT
-    if (fd != -1) {
-      // changed fd or identifier
-      item->ident = fd;
-    }
-	
-    switch(filter) {
-      case Read:
-        item->filter = EVFILT_READ;
-        item->flags  = EV_ADD | EV_ENABLE | EV_CLEAR;
-        break;
-      case Write:
-        item->filter = EVFILT_WRITE;
-        item->flags  = EV_ADD | EV_ENABLE | EV_CLEAR;
-
-        break;
-      case VNode:
-        item->filter = EVFILT_VNODE;
-        item->flags  = EV_ADD | EV_ENABLE | EV_CLEAR;
-        if (fflags == 0) {
-          // default File flags
-          fflags = NOTE_DELETE | NOTE_WRITE | NOTE_EXTEND | NOTE_ATTRIB | NOTE_LINK | NOTE_RENAME | NOTE_REVOKE;
-        }
-
-        item->fflags = fflags;
-       break;
-      default:
-        throw dub::Exception("Invalid filter value %i.", filter);
-    }
-    // change kevent
-    setKEvent(item);
-#else
-    item->events = filter;
-    if (fd != -1) {
-      // changed fd
-      item->fd = fd;
-    }
-#endif
+    modifyItem(idx, filter, fd, fflags);
   }
 
   /** Remove an item by its id.
    */
   void remove(int idx) {
-    if (idx < 0 || idx >= pollitems_size_) {
+    if (idx < 0 || idx >= idx_size_) {
       // Allready removed = bug.
       throw dub::Exception("Invalid index '%i'.", idx);
     }
@@ -433,32 +599,63 @@ public:
     debug_print("remove fd:%i.\n", (int)item->ident);
     item->flags = EV_DELETE;
     setKEvent(item);
+#elif defined(LUBYK_POLLER_EPOLL)
+#ifdef LUBYK_POLLER_URING
+    if (uring_) {
+      uringRemove(idx);
+    } else
+#endif
+    unlinkFd(idx, pollitems_[pos].fd);
 #endif
 
     idx_to_pos_[idx] = -1; // now free
+    if (idx == idx_count_ - 1) {
+      // Release trailing free idx (their free_idx_ entries become stale).
+      while (idx_count_ && idx_to_pos_[idx_count_ - 1] == -1) --idx_count_;
+    } else {
+      free_idx_[free_count_++] = idx;
+    }
     --used_count_;
-    if (pos == last_pos) {
-      // we removed the last element, we are done.
-      return;
+    if (pos != last_pos) {
+      // move last item in the position where idx was
+      int last_idx = pos_to_idx_[last_pos];
+      pos_to_idx_[last_pos] = -1;
+      idx_to_pos_[last_idx] = pos;
+      pos_to_idx_[pos] = last_idx;
+      // pollitems_[pos] <== pollitems_[last_pos];
+      memcpy(pollitems_ + pos, pollitems_ + last_pos, sizeof(Pollitem));
+    }
+
+    if (pollitems_size_ > reserve_ && used_count_ < pollitems_size_ / 4) {
+      // Release memory after mass removal.
+      shrink();
     }
-    // move last item in the position where idx was
-    int last_idx = pos_to_idx_[last_pos];
-    pos_to_idx_[last_pos] = -1;
-    idx_to_pos_[last_idx] = pos;
-    pos_to_idx_[pos] = last_idx;
-    // pollitems_[pos] <== pollitems_[last_pos];
-    memcpy(pollitems_ + pos, pollitems_ + last_pos, sizeof(Pollitem));
   }
 
   int count() {
     return used_count_;
   }
 
+  /** Return the backend in use (see Backends).
+   */
+  int backend() {
+#ifdef LUBYK_POLLER_KEVENT
+    return KQueue;
+#elif defined(LUBYK_POLLER_EPOLL)
+#ifdef LUBYK_POLLER_URING
+    if (uring_) return URing;
+#endif
+    return EPoll;
+#else
+    return Poll;
+#endif
+  }
+
   /** Used for testing only.
    * @return pos or nil
    */
   LuaStackSize idxToPos(int idx, lua_State *L) {
-    if (idx >= pollitems_size_ || idx < 0) return 0;
+    if (idx >= idx_size_ || idx < 0) return 0;
     lua_pushnumber(L, idx_to_pos_[idx]);
     return 1;
   }
@@ -499,53 +696,230 @@ public:
   }
 
 private:
+  /** Completion I/O operations (see submitRecv).
+   */
+  enum Ops {
+    NoOp = 0,
+    RecvOp,
+    SendOp,
+  };
+
+  /** True if the backend can run recv and send calls (see submitRecv).
+   */
+  bool completionIO() {
+#ifdef LUBYK_POLLER_URING
+    return uring_ != NULL;
+#else
+    return false;
+#endif
+  }
+
+  /** Run a recv of up to `len` bytes on the fd of item idx instead of its
+   * next poll. The item is reported once the call is done and #completion
+   * returns the data. Only call this if completionIO() is true.
+   */
+  void submitRecv(int idx, size_t len) {
+#ifdef LUBYK_POLLER_URING
+    uringSubmit(idx, RecvOp, NULL, len);
+#endif
+  }
+
+  /** Same as submitRecv for a send of `data` (copied).
+   */
+  void submitSend(int idx, const char *data, size_t len) {
+#ifdef LUBYK_POLLER_URING
+    uringSubmit(idx, SendOp, data, len);
+#endif
+  }
+
+  /** Push the result of the recv or send done on item idx: the received
+   * string or a number (bytes sent, 0 when the connection is closed, -errno on
+   * failure). Returns 0 if no operation completed on idx.
+   */
+  LuaStackSize completion(int idx, lua_State *L) {
+#ifdef LUBYK_POLLER_URING
+    if (uring_) return uringCompletion(idx, L);
+#endif
+    return 0;
+  }
+
+  /** Store ready item idx and revents in ready_idx_ and ready_rev_. Returns
+   * the number of events.
+   */
+  int readyEvents() {
+#ifdef LUBYK_POLLER_EPOLL
+    if (!event_count_ && !ready_count_) return 0;
+#else
+    if (!event_count_) return 0;
+#endif
+    if (ready_size_ < pollitems_size_) {
+      int *ptr = (int*)realloc(ready_idx_, pollitems_size_ * sizeof(int));
+      if (!ptr) {
+        throw dub::Exception("Could not reallocate %i events.", pollitems_size_);
+      }
+      ready_idx_ = ptr;
+      ptr = (int*)realloc(ready_rev_, pollitems_size_ * sizeof(int));
+      if (!ptr) {
+        throw dub::Exception("Could not reallocate %i events.", pollitems_size_);
+      }
+      ready_rev_  = ptr;
+      ready_size_ = pollitems_size_;
+    }
+    int pos = 0;
+#ifdef LUBYK_POLLER_KEVENT
+    for(int i=0; i < event_count_; ++i) {
+      Pollitem *item = &events_data_[i];
+      int revents = item->filter == EVFILT_WRITE ? Write : Read;
+      if (item->flags & EV_EOF)   revents |= Hup;
+      if (item->flags & EV_ERROR) revents |= Error;
+      // udata contains idx
+      addEvent(pos++, (intptr_t)item->udata, revents);
+    }
+#elif defined(LUBYK_POLLER_EPOLL)
+#ifdef LUBYK_POLLER_URING
+    if (uring_) {
+      for(int i=0; i < event_count_; ++i) {
+        int revents;
+        int idx = uringEvent(i, &revents);
+        Pollitem *item = pollitems_ + idx_to_pos_[idx];
+        addEvent(pos++, idx, eventBits(item->events, revents));
+      }
+    } else
+#endif
+    {
+      for(int i=0; i < event_count_; ++i) {
+        struct epoll_event *ev = &events_data_[i];
+        // data.fd contains the fd: find items interested in these events.
+        int revents = ev->events;
+        if (revents & (EPOLLERR | EPOLLHUP)) {
+          // wake everyone on error or hangup
+          revents |= EPOLLIN | EPOLLOUT;
+        }
+        FdState *state = fds_ + ev->data.fd;
+        bool disarm = false;
+        if (state->events & EPOLLONESHOT) {
+          // The kernel disarmed the fd.
+          state->events = 0;
+          disarm = true;
+        }
+        for(int idx = state->head; idx != -1; idx = idx_next_[idx]) {
+          Pollitem *item = pollitems_ + idx_to_pos_[idx];
+          if (item->mode & Fired) continue;
+          if (item->events & revents) {
+            addEvent(pos++, idx, eventBits(item->events, ev->events));
+            if (item->mode & OneShot) {
+              item->mode |= Fired;
+              disarm = true;
+            }
+          }
+        }
+        if (disarm) {
+          // Re-arm items that did not fire (or remove fired ones).
+          setEPollEvent(ev->data.fd);
+        }
+      }
+      if (ready_count_) {
+        for(int i=0; i < used_count_; ++i) {
+          Pollitem *item = pollitems_ + i;
+          if (fds_[item->fd].events == -1 && !(item->mode & Fired)) {
+            addEvent(pos++, pos_to_idx_[i], eventBits(item->events, item->events));
+            if (item->mode & OneShot) {
+              item->mode |= Fired;
+              setEPollEvent(item->fd);
+            }
+          }
+        }
+      }
+    }
+#else
+    for(int i=0; i < used_count_; ++i) {
+      Pollitem *item = pollitems_ + i;
+      if (item->revents) {
+        addEvent(pos++, pos_to_idx_[i], eventBits(item->events, item->revents));
+      }
+      if (pos == event_count_) break;
+    }
+#endif
+    event_count_ = 0;
+    return pos;
+  }
+
+  void addEvent(int pos, int idx, int revents) {
+    ready_idx_[pos] = idx;
+    ready_rev_[pos] = revents;
+  }
+
+#ifndef LUBYK_POLLER_KEVENT
+  /** Translate poll revents for an item watching `events` to Read, Write,
+   * Hup and Error bits.
+   */
+  static int eventBits(int events, int revents) {
+    int bits = 0;
+    if (revents & (POLLHUP | POLLERR)) {
+      // Hangup and error wake both readers and writers.
+      revents |= events;
+    }
+    if (revents & events & POLLIN)  bits |= Read;
+    if (revents & events & POLLOUT) bits |= Write;
+    if (revents & POLLHUP)          bits |= Hup;
+    if (revents & POLLERR)          bits |= Error;
+    return bits;
+  }
+#endif
+
+  // Filter part of the filter argument (Read, Write or VNode).
+  static const int FilterMask = 3;
+  // Registration flags in the filter argument.
+  static const int ModeMask   = Edge | OneShot;
+  // Set in Pollitem mode when a OneShot item has been reported.
+  static const int Fired      = 0x100;
+
   int addItem(int fd, int filter, int fflags) {
     debug_print("addItem fd:%i\n", fd);
+#ifdef LUBYK_POLLER_EPOLL
+    if ((filter & FilterMask) == VNode) {
+      // FIXME: Support file events on linux.
+      throw dub::Exception("File Watch not supported on this platform.");
+    }
+#endif
     if (used_count_ >= pollitems_size_) {
       // we need more space: realloc
-      int *sptr = (int*)realloc(idx_to_pos_, pollitems_size_ * 2 * sizeof(int));
-      if (!sptr) {
-        throw dub::Exception("Could not reallocate %i pollitems.", pollitems_size_ * 2);
-      }
-      idx_to_pos_ = sptr;
-      sptr = NULL;
-      sptr = (int*)realloc(pos_to_idx_, pollitems_size_ * 2 * sizeof(int));
-      if (!sptr) {
-        throw dub::Exception("Could not reallocate %i pollitems.", pollitems_size_ * 2);
+      resizeItems(pollitems_size_ * 2);
+    }
+    // find a free idx
+    intptr_t idx = -1;
+    while (free_count_) {
+      int i = free_idx_[--free_count_];
+      if (i < idx_count_) {
+        idx = i;
+        break;
       }
-      pos_to_idx_ = sptr;
-      Pollitem *ptr = (Pollitem*)realloc(pollitems_, pollitems_size_ * 2 * sizeof(Pollitem));
-      if (!ptr) {
-        throw dub::Exception("Could not reallocate %i pollitems.", pollitems_size_ * 2);
+      // else: stale
+    }
+    if (idx == -1) {
+      if (idx_count_ >= idx_size_) {
+        resizeIdx(idx_size_ * 2);
       }
-      pollitems_ = ptr;
-      // clear new space (same size as pollitems_size_ because we double).
-      memset(idx_to_pos_+ used_count_, -1, pollitems_size_ * sizeof(int));
-      memset(pos_to_idx_+ used_count_, -1, pollitems_size_ * sizeof(int));
-      memset(pollitems_ + used_count_,  0, pollitems_size_ * sizeof(Pollitem));
-      pollitems_size_ = 2 * pollitems_size_;
+      idx = idx_count_++;
     }
     int pos = used_count_;
     ++used_count_;
     Pollitem *item = pollitems_ + pos;
-    // Hasn't been moved yet: idx == position
-    // find a free idx
-    intptr_t idx;
-    for(idx = 0; idx < pollitems_size_; ++idx) {
-      if (idx_to_pos_[idx] < 0) break;
-    }
     idx_to_pos_[idx] = pos;
     pos_to_idx_[pos] = idx;
 
 #ifdef LUBYK_POLLER_KEVENT
-    switch(filter) {
+    int flags = EV_ADD | EV_ENABLE | EV_CLEAR;
+    if (filter & OneShot) flags |= EV_ONESHOT;
+
+    switch(filter & FilterMask) {
       case Read:
-        EV_SET(item, fd, EVFILT_READ, EV_ADD | EV_ENABLE | EV_CLEAR,
+        EV_SET(item, fd, EVFILT_READ, flags,
               fflags, 0, (void*)idx);
 
         break;
       case Write:
-        EV_SET(item, fd, EVFILT_WRITE, EV_ADD | EV_ENABLE | EV_CLEAR,
+        EV_SET(item, fd, EVFILT_WRITE, flags,
               fflags, 0, (void*)idx);
 
         break;
@@ -554,7 +928,7 @@ private:
           // default File flags
           fflags = NOTE_DELETE | NOTE_WRITE | NOTE_EXTEND | NOTE_ATTRIB | NOTE_LINK | NOTE_RENAME | NOTE_REVOKE;
         }
-        EV_SET(item, fd, EVFILT_VNODE, EV_ADD | EV_ENABLE | EV_CLEAR,
+        EV_SET(item, fd, EVFILT_VNODE, flags,
               fflags, 0, (void*)idx);
 
         break;
@@ -562,23 +936,196 @@ private:
         throw dub::Exception("Invalid filter value %i.", filter);
     }                            
     setKEvent(item);
+#elif defined(LUBYK_POLLER_EPOLL)
+    item->fd     = fd;
+    item->events = pollEvents(filter);
+    item->mode   = filter & ModeMask;
+#ifdef LUBYK_POLLER_URING
+    if (uring_) {
+      uringAdd(idx);
+    } else
+#endif
+    linkFd(idx, fd);
 #else
     item->fd = fd;
+    item->events = pollEvents(filter);
+#endif
+    return idx;
+  }
+
+  /** Change filter, fd (-1 = keep) and fflags of item idx.
+   */
+  void modifyItem(int idx, int filter, int fd, int fflags) {
+    debug_print("modify idx:%i, filter:%i.\n", idx, filter);
+    assert(filter);
+    assert(idx < idx_size_ && idx >= 0);
+    Pollitem *item = pollitems_ + idx_to_pos_[idx];
+#ifndef LUBYK_POLLER_KEVENT
+    if (fflags) {
+      // FIXME: Support file events on linux.
+      throw dub::Exception("File Watch not supported on this platform.");
+    }
+#endif
+
+#ifdef LUBYK_POLLER_KEVENT
+    if (fd != -1) {
+      // changed fd or identifier
+      item->ident = fd;
+    }
+
+    // kqueue is always edge triggered (EV_CLEAR).
+    int flags = EV_ADD | EV_ENABLE | EV_CLEAR;
+    if (filter & OneShot) flags |= EV_ONESHOT;
+
+    switch(filter & FilterMask) {
+      case Read:
+        item->filter = EVFILT_READ;
+        item->flags  = flags;
+        break;
+      case Write:
+        item->filter = EVFILT_WRITE;
+        item->flags  = flags;
+
+        break;
+      case VNode:
+        item->filter = EVFILT_VNODE;
+        item->flags  = flags;
+        if (fflags == 0) {
+          // default File flags
+          fflags = NOTE_DELETE | NOTE_WRITE | NOTE_EXTEND | NOTE_ATTRIB | NOTE_LINK | NOTE_RENAME | NOTE_REVOKE;
+        }
+
+        item->fflags = fflags;
+       break;
+      default:
+        throw dub::Exception("Invalid filter value %i.", filter);
+    }
+    // change kevent
+    setKEvent(item);
+#elif defined(LUBYK_POLLER_EPOLL)
+    if ((filter & FilterMask) == VNode) {
+      // FIXME: Support file events on linux.
+      throw dub::Exception("File Watch not supported on this platform.");
+    }
+    int events = pollEvents(filter);
+    // Clears the Fired bit: re-arms OneShot items.
+    int mode   = filter & ModeMask;
+#ifdef LUBYK_POLLER_URING
+    if (uring_) {
+      if ((fd != -1 && fd != item->fd) || events != item->events ||
+          mode != item->mode) {
+        if (fd != -1) item->fd = fd;
+        item->events = events;
+        item->mode   = mode;
+        // cancel current poll and queue a new one
+        uringModify(idx);
+      }
+    } else
+#endif
+    if (fd != -1 && fd != item->fd) {
+      // changed fd
+      unlinkFd(idx, item->fd);
+      item->fd     = fd;
+      item->events = events;
+      item->mode   = mode;
+      linkFd(idx, fd);
+    } else if (events != item->events || mode != item->mode) {
+      item->events = events;
+      item->mode   = mode;
+      setEPollEvent(item->fd);
+    }
+    // else: nothing changed, avoid epoll_ctl.
+#else
+    item->events = pollEvents(filter);
+    if (fd != -1) {
+      // changed fd
+      item->fd = fd;
+    }
+#endif
+  }
+
+  /** Resize the arrays indexed by pos (pollitems_, pos_to_idx_).
+   */
+  void resizeItems(int size);
+
+  /** Resize the arrays indexed by idx (idx_to_pos_, free_idx_, ...).
+   */
+  void resizeIdx(int size);
+
+  /** Halve the arrays when most items have been removed.
+   */
+  void shrink();
+
+#ifndef LUBYK_POLLER_KEVENT
+  /** Translate a filter to poll events.
+   */
+  static int pollEvents(int filter) {
     int events = 0;
     if (filter & Read) {
-      events += POLLIN;
+      events |= POLLIN;
     }
     if (filter & Write) {
-      events += POLLOUT;
+      events |= POLLOUT;
     }
-    item->events = events;
-#endif
-    return idx;
+    return events;
   }
+#endif
+
+#ifdef LUBYK_POLLER_EPOLL
+  /** Add item idx to the items watching fd and update epoll set.
+   */
+  void linkFd(int idx, int fd);
+
+  /** Remove item idx from the items watching fd and update epoll set.
+   */
+  void unlinkFd(int idx, int fd);
+
+  /** Register the union of all events watched on fd in epoll.
+   */
+  void setEPollEvent(int fd);
+
+  /** Wait for events until wake_at (absolute time) with timerfd precision.
+   * Timer events are removed from the returned events. Returns the number of
+   * events or -1 on error.
+   */
+  int epollWait(double wake_at, double timeout);
+#endif
+
+#ifdef LUBYK_POLLER_URING
+  /** Try to start the io_uring backend. Returns false if the kernel does not
+   * support the required features.
+   */
+  bool setupURing(unsigned entries);
+
+  void closeURing();
+
+  /** Submit pending polls and wait for completions. Returns the number of
+   * ready items or -1 on error.
+   */
+  int uringWait(double timeout);
+
+  /** Return the idx and poll revents of the i-th ready item.
+   */
+  int uringEvent(int i, int *revents);
+
+  void uringAdd(int idx);
+
+  void uringModify(int idx);
+
+  void uringRemove(int idx);
+
+  /** Queue a recv or send on item idx (see submitRecv).
+   */
+  void uringSubmit(int idx, int type, const char *data, size_t len);
+
+  LuaStackSize uringCompletion(int idx, lua_State *L);
+#endif
 
   static void sInterrupted(int i) {
-    signal(i, SIG_DFL); // double interrupt == kill
     Poller *p = (Poller*)pthread_getspecific(sThisKey);
+    // Not a thread with an interrupt hook (a thread created outside of lens).
+    if (!p) return;
+    signal(i, SIG_DFL); // double interrupt == kill
     p->interrupted();
     // continue
   }
@@ -591,6 +1138,12 @@ private:
   }
 
   void setupInterruptHook() {
+    // Workers and pool threads block SIGINT (see lens::startThread): only the
+    // main thread handles Ctrl-C.
+    sigset_t set;
+    pthread_sigmask(SIG_BLOCK, NULL, &set);
+    if (sigismember(&set, SIGINT)) return;
+
     Poller *p = (Poller*)pthread_getspecific(sThisKey);
     if (!p) {
       // only register first (main) Scheduler
@@ -599,11 +1152,17 @@ private:
     }
   }
 
+  static void sCreateKey() {
+    pthread_key_create(&sThisKey, NULL);
+  }
+
 #ifdef LUBYK_POLLER_KEVENT
   void setKEvent(Pollitem *item) {
     int res = ::kevent(kqueue_, item, 1, NULL, 0, NULL);
     if (res < 0) {
-      if (item->flags == EV_DELETE && (errno == EAGAIN || errno == EBADF)) {
+      if (item->flags == EV_DELETE && errno == ENOENT) {
+        // OneShot event already fired and removed by the kernel.
+      } else if (item->flags == EV_DELETE && (errno == EAGAIN || errno == EBADF)) {
         // FIXME: is it OK to ignore this error ?
         // How to avoid removing closed fd ?
         printf("EAGAIN or EBADF with EV_DELETE..\n");
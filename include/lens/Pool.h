@@ -0,0 +1,115 @@
+/*
+  ==============================================================================
+
+   This file is part of the LUBYK project (http://lubyk.org)
+   Copyright (c) 2007-2014 by Gaspard Bucher (http://teti.ch).
+
+  ------------------------------------------------------------------------------
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+
+  ==============================================================================
+*/
+#ifndef LUBYK_INCLUDE_LENS_POOL_H_
+#define LUBYK_INCLUDE_LENS_POOL_H_
+
+#include "lens/lens.h"
+
+#include "dub/dub.h"
+
+#include <pthread.h>
+
+// Maximal number of background threads per queue. Threads are started on
+// demand.
+#define POOL_MAX_THREADS 4
+
+// Number of Pool::Queue values.
+#define POOL_QUEUES 2
+
+namespace lens {
+
+/** Background threads running blocking calls (name resolution, disk I/O) off
+ * the event loop.
+ *
+ * Each job has a wake up file descriptor (eventfd on linux, pipe elsewhere)
+ * that becomes readable when the job is done so that the waiting Lua thread
+ * simply yields on it like on any other fd.
+ *
+ * Each kind of job has its own queue and threads so that slow jobs of one
+ * kind (name lookups waiting for resolver timeouts) do not delay the others
+ * (disk I/O).
+ */
+class Pool {
+public:
+  enum Queue {
+    NameQueue = 0,
+    DiskQueue,
+  };
+
+  class Job {
+    friend class Pool;
+  public:
+    Job();
+
+    virtual ~Job();
+
+    /** File descriptor readable when the job is done.
+     */
+    int fd() {
+      return fds_[0];
+    }
+
+    bool done() {
+      return __atomic_load_n(&done_, __ATOMIC_ACQUIRE);
+    }
+
+    /** Prepare a done job to be submitted again (clears the wake up fd).
+     */
+    void reset();
+
+  protected:
+    /** Blocking work (called in a pool thread). Errors must be stored in the
+     * job: exceptions are ignored.
+     */
+    virtual void run() = 0;
+
+  private:
+    // One reference for the owner and one while queued or running.
+    int refcount_;
+    int done_;
+    // Wake up file descriptors (read, write).
+    int fds_[2];
+    Job *next_;
+  };
+
+  /** Queue a job. The job must not be modified until it is done.
+   */
+  static void submit(Job *job, Queue queue);
+
+  /** Release the owner's reference. The job is deleted once done.
+   */
+  static void release(Job *job);
+
+private:
+  static void *sRun(void *data);
+};
+
+} // lens
+
+#endif // LUBYK_INCLUDE_LENS_POOL_H_
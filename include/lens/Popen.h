@@ -39,6 +39,7 @@ namespace lens {
  *
  * @dub string_format: %%d
  *      string_args: self->fd()
+ *      ignore: readAt, writeAt, setWriteBuffer, flush, buffered, slice, advise, size, startRead, startWrite, startSync, ioFd, ioDone, ioResult
  */
 class Popen : public File {
   // Forked process id
@@ -0,0 +1,121 @@
+/*
+  ==============================================================================
+
+   This file is part of the LUBYK project (http://lubyk.org)
+   Copyright (c) 2007-2014 by Gaspard Bucher (http://teti.ch).
+
+  ------------------------------------------------------------------------------
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+
+  ==============================================================================
+*/
+#ifndef LUBYK_INCLUDE_LENS_RESOLVER_H_
+#define LUBYK_INCLUDE_LENS_RESOLVER_H_
+
+#include "lens/lens.h"
+#include "lens/Pool.h"
+
+#include "dub/dub.h"
+
+#include <string>
+
+namespace lens {
+
+// Default time (in seconds) a resolved address stays in the cache.
+#define RESOLVER_DEFAULT_TTL 60
+// Maximal number of cached host names.
+#define RESOLVER_MAX_CACHE 1024
+
+/** Name resolution running in a lens::Pool thread so that the event loop
+ * does not block on DNS.
+ *
+ * Resolved addresses are kept in a cache shared by all Lua states (workers
+ * included) for #ttl seconds. getaddrinfo does not expose the DNS record's
+ * TTL so the cache uses the same (configurable) time for all entries.
+ *
+ * @dub string_format: %%s
+ *      string_args: self->host()
+ */
+class Resolver {
+  struct Lookup : public Pool::Job {
+    // Query
+    std::string host;
+    bool reverse;
+    // Result
+    std::string name;
+    std::string error;
+  protected:
+    virtual void run();
+  };
+
+  Lookup *job_;
+
+public:
+  ~Resolver();
+
+  /** Start a reverse lookup (host name) of the numeric address `host`.
+   */
+  static Resolver *reverse(const char *host);
+
+  /** Start resolving `host` to a numeric address (IPv4 or IPv6). Use
+   * #cached first to avoid the lookup.
+   */
+  static Resolver *resolve(const char *host);
+
+  /** Return the numeric address of `host` if `host` is already numeric or if
+   * it is in the cache. Returns nil otherwise (never blocks).
+   */
+  static LuaStackSize cached(const char *host, lua_State *L);
+
+  /** Set the time in seconds resolved addresses stay in the cache. 0 disables
+   * the cache.
+   */
+  static void setTTL(double ttl);
+
+  static double ttl();
+
+  /** File descriptor readable when the lookup is done.
+   */
+  int fd() {
+    return job_->fd();
+  }
+
+  bool done() {
+    return job_->done();
+  }
+
+  /** Return the result or nil and an error message. Must only be called once
+   * #done returns true.
+   */
+  LuaStackSize result(lua_State *L);
+
+  const char *host() {
+    return job_->host.c_str();
+  }
+
+private:
+  Resolver(Lookup *job);
+
+  static Resolver *start(const char *host, bool reverse);
+};
+
+} // lens
+
+#endif // LUBYK_INCLUDE_LENS_RESOLVER_H_
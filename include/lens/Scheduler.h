@@ -0,0 +1,255 @@
+/*
+  ==============================================================================
+
+   This file is part of the LUBYK project (http://lubyk.org)
+   Copyright (c) 2007-2014 by Gaspard Bucher (http://teti.ch).
+
+  ------------------------------------------------------------------------------
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+
+  ==============================================================================
+*/
+#ifndef LUBYK_INCLUDE_LENS_SCHEDULER_H_
+#define LUBYK_INCLUDE_LENS_SCHEDULER_H_
+
+#include "lens/lens.h"
+#include "lens/Poller.h"
+#include "dub/dub.h"
+
+namespace lens {
+
+/** Native run loop for lens.Scheduler.
+ *
+ * Threads are Lua tables with a coroutine in `co` (see lens.Thread). The
+ * scheduler keeps the time queue and file descriptor registrations, resumes
+ * coroutines with lua_resume and handles the 'read', 'write', 'sleep' and
+ * 'wait' operations directly. Other operations are found in the
+ * `operations` table of the Lua class.
+ *
+ * @dub push: dub_pushobject
+ *      string_format: %%d
+ *      string_args: self->fdCount()
+ */
+class Scheduler : public dub::Thread {
+  /** Poller used to wait (owned by the Lua object in self.poller).
+   */
+  Poller *poller_;
+
+  /** Time reference for threads started in the current loop.
+   */
+  double now_;
+
+  /** Set to false to stop the loop.
+   */
+  bool should_run_;
+
+  /** Number of threads waiting on a file descriptor.
+   */
+  int fd_count_;
+
+  /** Time queue: threads are stored in self.at_threads[slot] and
+   * slots are kept in a binary heap ordered by at_ (at_seq_ keeps threads
+   * with the same time in FIFO order).
+   */
+  double *at_;
+  unsigned int *at_seq_;
+
+  /** Position of slot in heap_ (-1 when not queued).
+   */
+  int *at_pos_;
+
+  /** Free slot list.
+   */
+  int *at_next_;
+
+  /** Slot state (Free, Queued or Due).
+   */
+  char *at_state_;
+
+  /** Size of the time queue arrays.
+   */
+  int at_size_;
+
+  /** First free slot (linked with at_next_).
+   */
+  int at_free_;
+
+  /** Binary heap of queued slots (heap_[0] runs first).
+   */
+  int *heap_;
+  int heap_count_;
+
+  /** Insertion counter for at_seq_.
+   */
+  unsigned int seq_;
+
+  /** Slots removed from the queue by runDue.
+   */
+  int *due_;
+  int due_size_;
+  int due_count_;
+
+  /** Lua values used during a run.
+   */
+  struct Frame {
+    int self;
+    int operations;
+    int idx_to_thread;
+    int at_threads;
+  };
+
+  enum SlotStates {
+    Free = 0,
+    Queued,
+    Due,
+  };
+
+public:
+  Scheduler();
+
+  ~Scheduler();
+
+  /** Set the poller used to wait for events and timeouts.
+   */
+  void setPoller(Poller *poller) {
+    poller_ = poller;
+  }
+
+  /** Run until there are no more threads, until halt or until interrupted.
+   */
+  void loop(lua_State *L);
+
+  /** Run the threads scheduled before now.
+   */
+  void runDue(lua_State *L);
+
+  /** Run the threads woken up by the last poll.
+   */
+  void runEvents(lua_State *L);
+
+  /** Return time of next scheduled thread or -1 if the time queue is empty.
+   */
+  double wakeAt() {
+    return heap_count_ ? at_[heap_[0]] : -1;
+  }
+
+  /** Insert <thread> in the time queue at thread.at (a thread is only
+   * scheduled once).
+   */
+  void scheduleAt(lua_State *L);
+
+  /** Remove <thread> from the time queue.
+   */
+  void unschedule(lua_State *L);
+
+  /** Wait on <fd> with <filter> (and <flags>) in <thread>.
+   */
+  void changeFdFilter(lua_State *L);
+
+  /** Stop waiting on the file descriptor of <thread>.
+   */
+  void removeFd(lua_State *L);
+
+  /** Cleanup dead <thread> and resume threads joining it.
+   */
+  void finalizeThread(lua_State *L);
+
+  /** Time reference of the current loop.
+   */
+  double now() {
+    return now_;
+  }
+
+  int fdCount() {
+    return fd_count_;
+  }
+
+  bool shouldRun() {
+    return should_run_;
+  }
+
+  /** Allow loop to run (set by lens.Scheduler.run).
+   */
+  void start() {
+    should_run_ = true;
+  }
+
+  /** Stop the loop after the current thread.
+   */
+  void stop() {
+    should_run_ = false;
+  }
+
+private:
+  /** Push the Lua tables used during a run (<self> must be at position 1).
+   */
+  void prepare(lua_State *L, Frame *f);
+
+  void dueThreads(lua_State *L, Frame *f);
+
+  void eventThreads(lua_State *L, Frame *f);
+
+  /** Resume thread at stack position `t`. Returns true if the thread must run
+   * again right away.
+   */
+  bool runThread(lua_State *L, Frame *f, int t);
+
+  /** Execute operation yielded by thread `t` (<a> <b> <c> from position
+   * `a`). Returns true if the thread must run again right away.
+   */
+  bool operation(lua_State *L, Frame *f, int t, int a);
+
+  void scheduleThread(lua_State *L, Frame *f, int t);
+
+  void unscheduleThread(lua_State *L, Frame *f, int t);
+
+  void changeFilter(lua_State *L, Frame *f, int t, int fd, int filter, int flags);
+
+  void removeThreadFd(lua_State *L, Frame *f, int t);
+
+  void finalize(lua_State *L, Frame *f, int t);
+
+  void releaseSlot(lua_State *L, Frame *f, int t, int slot);
+
+  int allocSlot();
+
+  /** Insert slot in the time queue: O(log n).
+   */
+  void linkSlot(int slot);
+
+  /** Remove slot from the time queue: O(log n).
+   */
+  void unlinkSlot(int slot);
+
+  /** Return true if slot `a` must run before slot `b`.
+   */
+  bool before(int a, int b) {
+    return at_[a] < at_[b] ||
+      (at_[a] == at_[b] && (int)(at_seq_[a] - at_seq_[b]) < 0);
+  }
+
+  void siftUp(int pos);
+
+  void siftDown(int pos);
+};
+
+} // lens
+
+#endif // LUBYK_INCLUDE_LENS_SCHEDULER_H_
@@ -36,19 +36,36 @@
 #include <unistd.h> // close
 #include <netdb.h>  // getaddrinfo
 #include <arpa/inet.h> // inet_ntop
+#include <sys/uio.h>   // iovec
 
 #include <errno.h>  // errno
+#include <stdlib.h> // malloc, free
 #include <string.h> // strerror
 #include <fcntl.h>
 
 #include <string>
+#include <deque>
 
 // How many pending connections should wait for 'accept'.
 #define BACKLOG 10
-// recv buffer size (must be at least SIZEOF_SIZE)
+// default recv buffer size (must be at least SIZEOF_SIZE)
 #define MAX_BUFF_SIZE 8196
+// Maximum number of drained receive buffers kept for reuse (per size).
+#define MAX_POOLED_BUFFERS 256
 // 4 = size needed to encode SIZE_MAX
 #define SIZEOF_SIZE 4
+// Largest frame accepted by recvFrame (protects against garbage headers).
+#define MAX_FRAME_SIZE (64 * 1024 * 1024)
+// Maximum number of datagrams received or sent in one system call.
+#define MAX_MSG_BATCH 64
+// Size of each recvMessages buffer (largest UDP payload) so that datagrams
+// are never truncated.
+#define MAX_DATAGRAM_SIZE 65536
+// Maximum number of buffers written in one system call.
+#define MAX_SEND_IOV 64
+// Maximum size of a send done by the poller (see Socket::queued). The data is
+// copied so large chunks are sent in parts.
+#define MAX_QUEUED_SEND (256 * 1024)
 
 namespace lens {
 
@@ -63,11 +80,18 @@ namespace lens {
 class Socket : public dub::Thread {
   int socket_fd_;
   int socket_type_;
+  // Address family of socket_fd_ (AF_INET or AF_INET6).
+  int socket_family_;
   std::string local_host_;
   int local_port_;
   std::string remote_host_;
   int remote_port_;
 
+  /** Error raised by accept after acceptMany returned the connections
+   * accepted before it (empty if none).
+   */
+  std::string accept_error_;
+
   // buffer management
   /** Number of bytes already received in the buffer.
    */
@@ -78,9 +102,58 @@ class Socket : public dub::Thread {
    */
   int buffer_i_;
 
-  /** Buffer that contains received data not yet used by Lua.
+  /** Buffer that contains received data not yet used by Lua. The buffer is
+   * taken from a shared pool on receive and given back once drained so that
+   * idle and listening sockets do not hold any memory.
+   */
+  char *buffer_;
+
+  /** Size of the receive buffer (set on creation).
+   */
+  int buffer_size_;
+
+  // frame management (see recvFrame)
+  /** Header of the frame being received (big endian size).
+   */
+  unsigned char frame_header_[SIZEOF_SIZE];
+  int frame_header_i_;
+
+  /** Frame being received when it does not fit in the receive buffer.
+   */
+  char *frame_;
+  int frame_size_;
+  int frame_i_;
+
+  /** Set when an invalid frame header was received: the stream position is
+   * lost and every later readFrame call throws.
+   */
+  bool frame_broken_;
+
+  // send queue management
+  /** Data waiting to be sent. Lua strings are not copied: a registry
+   * reference keeps them alive until they are sent.
+   */
+  struct OutChunk {
+    const char *data;
+    size_t size;
+    // Registry reference to the Lua string (LUA_NOREF if owned).
+    int ref;
+    // Data owned by the socket (packed values, frame headers).
+    std::string *owned;
+  };
+  std::deque<OutChunk> out_;
+
+  /** Total number of bytes in out_.
    */
-  char buffer_[MAX_BUFF_SIZE];
+  size_t out_size_;
+
+  /** Lua send methods return once out_size_ is at or below this value.
+   */
+  size_t out_watermark_;
+
+  /** Set while the poller sends the first chunk of the queue (see queued).
+   */
+  bool send_busy_;
 public:
 
   enum SocketType {
@@ -88,22 +161,53 @@ public:
     UDP = SOCK_DGRAM,
   };
 
-  Socket(int socket_type)
+  /** Options for bind (can be combined).
+   */
+  enum BindFlags {
+    // SO_REUSEADDR: bind even if old connections are in TIME_WAIT.
+    ReuseAddr = 1,
+    // SO_REUSEPORT: several sockets can listen on the same port and the
+    // kernel balances incoming connections between them.
+    ReusePort = 2,
+  };
+
+  /** Create a new socket. `buffer_size` is the size of the receive buffer.
+   */
+  Socket(int socket_type, int buffer_size = MAX_BUFF_SIZE)
       // When changing this, also change the private
       // constructor.
       : socket_fd_(-1)
       , socket_type_(socket_type)
+      , socket_family_(AF_UNSPEC)
       , local_host_("*")
       , local_port_(-1)
       , remote_host_("?")
       , remote_port_(-1)
       , buffer_length_(0)
       , buffer_i_(0)
+      , buffer_(NULL)
+      , buffer_size_(buffer_size)
+      , frame_header_i_(0)
+      , frame_(NULL)
+      , frame_size_(0)
+      , frame_i_(0)
+      , frame_broken_(false)
+      , out_size_(0)
+      , out_watermark_(0)
+      , send_busy_(false)
   {
+    if (buffer_size < SIZEOF_SIZE) {
+      throw dub::Exception("Buffer size must be at least %i (found %i).", SIZEOF_SIZE, buffer_size);
+    }
   }
 
   virtual ~Socket() {
     close();
+    // Drop unused data.
+    buffer_i_ = buffer_length_;
+    releaseBuffer();
+    if (frame_) free(frame_);
+    clearQueue();
   }
 
   void close() {
@@ -113,15 +217,20 @@ public:
     }
   }
 
-  /** Bind socket to a specific interface.
+  /** Bind socket to a specific interface. `flags` is a combination of
+   * BindFlags.
    * @return bound port
    */
-  int bind(const char *localhost = NULL, int port = 0);
+  int bind(const char *localhost = NULL, int port = 0, int flags = 0);
 
-  /** Connect to a remote socket.
+  /** Connect to a remote socket. If `address` is set, it is the numeric
+   * address of `host` (see lens.Resolver) and connect does not resolve the
+   * host name. Otherwise, the host is resolved synchronously. UDP sockets
+   * resolve the host once and connect to it so that #send does not resolve
+   * on each datagram. Call connect again to resolve the host again.
    * @return false if the socket is not ready and we should waitWrite and 'connectFinish'.
    */
-  bool connect(const char *host, int port);
+  bool connect(const char *host, int port, const char *address = NULL);
 
   /** Finish connecting for NON-BLOCKING sockets.
    */
@@ -132,12 +241,21 @@ public:
    */
   void listen(int backlog = BACKLOG);
 
-  /** Accept a new incomming connection.
+  /** Accept a new incomming connection. The remote host is the numeric
+   * address (no reverse DNS lookup, see lens.Resolver).
    * @return a new lens.Socket connected to the remote end.
    */
   LuaStackSize accept(lua_State *L);
 
-  /** Receive a line.
+  /** Accept up to `max` pending connections in one call. Aborted
+   * connections are skipped. On other errors, the connections already
+   * accepted are returned and the error is raised by the next call.
+   * @return a list of new lens.Socket or nil if no connection is pending.
+   */
+  LuaStackSize acceptMany(int max, lua_State *L);
+
+  /** Receive a line. Params: optional delimiter character (default "\n") and
+   * keep_cr flag to keep a "\r" before "\n".
    *
    * Returns 'data, eagain'.
    */
@@ -151,16 +269,119 @@ public:
 
   /** Receive a message (UDP only).
    *
-   * Returns 'data, eagain'.
+   * Returns 'data, eagain, host, port'.
    */
   LuaStackSize recvMessage(lua_State *L);
 
-  /** Send raw bytes.
-   * param: string to send.
-   * @return number of bytes sent.
+  /** Receive up to `max` messages with a single system call (UDP only).
+   *
+   * Returns 'messages, hosts, ports' (three lists) or 'nil, eagain'.
+   */
+  LuaStackSize recvMessages(int max, lua_State *L);
+
+  /** Send the strings in a list as datagrams to the connected host with as
+   * few system calls as possible (UDP only). Params: list and optional
+   * first index.
+   * @return number of messages sent (0 on EAGAIN).
+   */
+  int sendMessages(lua_State *L);
+
+  /** Send raw bytes. Params: one or more strings. The strings are written
+   * with a single system call when possible and what cannot be sent right
+   * away is queued without copy (see flush).
+   * @return number of bytes waiting in the send queue.
    */
   int send(lua_State *L);
 
+  /** Send queued data.
+   * @return number of bytes still waiting in the send queue.
+   */
+  int flush();
+
+  /** Number of bytes waiting in the send queue.
+   */
+  int pending() const {
+    return out_size_;
+  }
+
+  /** Lua send methods only wait for the socket when more than `bytes` are
+   * queued (default is 0: wait until everything is sent).
+   */
+  void setWatermark(int bytes) {
+    out_watermark_ = bytes < 0 ? 0 : bytes;
+  }
+
+  int watermark() const {
+    return out_watermark_;
+  }
+
+  /** Completion I/O (io_uring): the poller runs the recv and send calls and
+   * the Lua methods move the data with the following methods.
+   *
+   * Free space in the receive buffer.
+   */
+  int recvSpace() const {
+    return buffer_size_ - (buffer_length_ - buffer_i_);
+  }
+
+  /** Append data received by the poller to the receive buffer. Param: string
+   * of at most recvSpace() bytes.
+   */
+  void feed(lua_State *L);
+
+  /** Return the first chunk of the send queue (at most MAX_QUEUED_SEND
+   * bytes) so that the poller sends it (TCP only). Until #consume is called, the chunk stays in the queue and
+   * #flush does nothing. Returns nil if the queue is empty or already being
+   * sent.
+   */
+  LuaStackSize queued(lua_State *L);
+
+  /** Remove `sent` bytes sent by the poller from the send queue.
+   * @return number of bytes still waiting in the send queue.
+   */
+  int consume(int sent);
+
+  /** Receive a length-prefixed frame (TCP only). The payload is returned as
+   * a single string once it is complete. Partial frames are kept in the
+   * socket.
+   *
+   * Returns 'data' or 'nil, eagain'.
+   */
+  LuaStackSize recvFrame(lua_State *L);
+
+  /** Send a string as a length-prefixed frame (4 bytes big endian size
+   * followed by the data). Param: string.
+   * @return number of bytes waiting in the send queue.
+   */
+  int sendFrame(lua_State *L);
+
+  /** Receive a Lua value sent with sendValue (TCP only). The value is
+   * decoded directly from the receive buffer.
+   *
+   * Returns 'value, false' or 'nil, true' on EAGAIN.
+   */
+  LuaStackSize recvValue(lua_State *L);
+
+  /** Encode a Lua value with msgpack and send it as a frame. Param: value.
+   * @return number of bytes waiting in the send queue.
+   */
+  int sendValue(lua_State *L);
+
+  /** Send up to `len` bytes of the file descriptor `fd` starting at
+   * `offset` without copying data through user space (sendfile). Queued
+   * data is sent first (TCP only).
+   * @return number of bytes sent or -1 on EAGAIN.
+   */
+  double sendFile(int fd, double offset, double len);
+
+  /** Move up to `len` bytes from the pipe `fd` (for example the output of
+   * a lens.Popen) to the socket. On linux, data stays in the kernel
+   * (splice). Queued data is sent first (TCP only).
+   * @return number of bytes sent, 0 on end of file, -1 if the pipe is not
+   * ready for reading or -2 if the socket is not ready for writing.
+   */
+  int splice(int fd, int len);
+
   /** Return the hostname of the local host.
    */
   const char *localHost() const {
@@ -191,6 +412,12 @@ public:
     return socket_fd_;
   }
 
+  /** Size of the receive buffer.
+   */
+  int bufferSize() const {
+    return buffer_size_;
+  }
+
 protected:
   void setNonBlocking() {
     int x;
@@ -203,38 +430,16 @@ protected:
   /** Send raw bytes from C++.
    */
   inline int sendBytes(const char *bytes, size_t sz) {
-    int sent;
-
-    if (socket_type_ == UDP) {
-      struct addrinfo hints, *res;
-
-      memset(&hints, 0, sizeof(hints));
-
-      // we do not care if we get an IPv4 or IPv6 address
-      hints.ai_family = AF_UNSPEC;
-      // UDP
-      hints.ai_socktype = SOCK_DGRAM;
-
-
-      char port_str[10];
-      snprintf(port_str, 10, "%i", remote_port_);
-
-      int status;
-      if ( (status = getaddrinfo(remote_host_.c_str(), port_str, &hints, &res)) ) {
-        throw dub::Exception("Could not getaddrinfo for %s:%i (%s).", remote_host_.c_str(), remote_port_, gai_strerror(status));
-      }
-
-      // FIXME: performance save addrinfo !.
-
-      sent = sendto(socket_fd_, bytes, sz, 0, res->ai_addr, res->ai_addrlen);
-      freeaddrinfo(res);
-    } else {
-      sent = ::send(socket_fd_, bytes, sz, 0);
-    }
+    // UDP sockets are connected (see connect).
+    int sent = ::send(socket_fd_, bytes, sz, 0);
 
     if (sent == -1) {
       if (errno == EAGAIN) {
         return -1;
+      } else if (socket_type_ == UDP && errno == ECONNREFUSED) {
+        // ICMP port unreachable from a previous datagram: datagrams can be
+        // lost, ignore.
+        return sz;
       } else {
         throw dub::Exception("Could not send message (%s).", strerror(errno));
       };
@@ -246,25 +451,127 @@ protected:
   /** Create a socket with an existing file descriptor.
    * This is used as the result of an 'accept()' call.
    */
-  Socket(int type, int fd, const char *local_host, const char *remote_host, int remote_port)
+  Socket(int type, int fd, const char *local_host, const char *remote_host, int remote_port, int buffer_size = MAX_BUFF_SIZE)
       : socket_fd_(fd)
       , socket_type_(type)
+      , socket_family_(AF_UNSPEC)
       , local_host_(local_host)
       , local_port_(get_port(fd))
       , remote_host_(remote_host)
       , remote_port_(remote_port)
       , buffer_length_(0)
       , buffer_i_(0)
+      , buffer_(NULL)
+      , buffer_size_(buffer_size)
+      , frame_header_i_(0)
+      , frame_(NULL)
+      , frame_size_(0)
+      , frame_i_(0)
+      , frame_broken_(false)
+      , out_size_(0)
+      , out_watermark_(0)
+      , send_busy_(false)
   {
   }
 
 private:
   static int get_port(int fd);
 
+  /** Write numeric host (INET6_ADDRSTRLEN bytes) and return port of an
+   * address.
+   */
+  static int addressString(struct sockaddr_storage *addr, char *host);
+
+  /** Push numeric host and port of a sender address.
+   */
+  static void pushAddress(lua_State *L, struct sockaddr_storage *addr);
+
+  /** Accept a connection and push the new lens.Socket. Connections aborted
+   * before accept are skipped.
+   * @return false on EAGAIN.
+   */
+  bool acceptOne(lua_State *L);
+
+  /** Raise the error kept by acceptMany.
+   */
+  void throwAcceptError();
+
+  void connectUDP(const char *host, int port, const char *address);
+
+  /** Resolve host (or parse numeric address) for connect.
+   */
+  void getAddrInfo(const char *host, int port, const char *address, struct addrinfo **res);
+
+  void setFlag(int option, const char *name);
+
+  /** Receive a frame. `data` points in the receive buffer or frame storage
+   * until frameDone is called.
+   * @return frame size, -1 on EAGAIN, -2 when the connection is closed.
+   */
+  int readFrame(const char **data);
+
+  /** Release the frame returned by readFrame.
+   */
+  void frameDone();
+
+  /** Reset frame state after an invalid header and refuse further frames.
+   */
+  void frameBroken();
+
+  /** Write buffers with a single system call.
+   * @return number of bytes sent or -1 on EAGAIN.
+   */
+  int writeIov(struct iovec *iov, int count);
+
+  /** Write `count` buffers and queue what could not be sent. The Lua
+   * strings at stack positions `refs` are referenced instead of copied (0
+   * means the data must be copied).
+   */
+  void sendOrQueue(lua_State *L, struct iovec *iov, int *refs, int count);
+
+  /** Add data to the send queue.
+   */
+  void queue(lua_State *L, const char *data, size_t size, int ref_index);
+
+  /** Remove the first chunk from the send queue.
+   */
+  void popChunk();
+
+  /** Remove `sent` bytes from the front of the send queue.
+   */
+  void dropSent(int sent);
+
+  /** Drop all queued data.
+   */
+  void clearQueue();
+
+  /** Get a receive buffer from the pool if we do not have one.
+   */
+  void acquireBuffer();
+
+  /** Give the receive buffer back to the pool if all data has been used.
+   */
+  void releaseBuffer();
+
+  /** Holds the receive buffer during a recv call.
+   */
+  struct BufferLease {
+    Socket *socket_;
+    BufferLease(Socket *socket) : socket_(socket) {
+      socket_->acquireBuffer();
+    }
+    ~BufferLease() {
+      socket_->releaseBuffer();
+    }
+  };
+
   virtual int pushNewSocket(lua_State *L, int type, int fd, const char *local_host, const char *remote_host, int remote_port) {
-    Socket *new_socket = new Socket(type, fd, local_host, remote_host, remote_port);
+    Socket *new_socket = new Socket(type, fd, local_host, remote_host, remote_port, buffer_size_);
 
+#ifndef __linux__
+    // Set by accept4 on linux.
     new_socket->setNonBlocking();
+#endif
     new_socket->dub_pushobject(L, new_socket, "lens.Socket", true);
     return 1;
   }
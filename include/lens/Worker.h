@@ -0,0 +1,98 @@
+/*
+  ==============================================================================
+
+   This file is part of the LUBYK project (http://lubyk.org)
+   Copyright (c) 2007-2014 by Gaspard Bucher (http://teti.ch).
+
+  ------------------------------------------------------------------------------
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+
+  ==============================================================================
+*/
+#ifndef LUBYK_INCLUDE_LENS_WORKER_H_
+#define LUBYK_INCLUDE_LENS_WORKER_H_
+
+#include "lens/lens.h"
+#include "lens/Mailbox.h"
+
+#include "dub/dub.h"
+
+#include <pthread.h>
+
+namespace lens {
+
+/** Run Lua code in a new OS thread.
+ *
+ * The worker has its own lua_State and therefore its own lens.sched()
+ * scheduler and poller. Workers and the main thread communicate with
+ * lens.Mailbox objects passed to the constructor.
+ *
+ * @dub string_format: %%s
+ *      string_args: self->running() ? "running" : "done"
+ */
+class Worker {
+  /** Data shared with the thread (the Worker can be garbage collected while
+   * the thread runs).
+   */
+  struct Job {
+    int refcount;
+    // Set by the thread when the code returns.
+    int done;
+    // Lua code executed in the new thread.
+    char *code;
+    size_t code_len;
+    // Queues passed as arguments.
+    Mailbox::Queue **queues;
+    int queue_count;
+  };
+
+  Job *job_;
+
+  pthread_t thread_;
+
+  bool joined_;
+
+public:
+  /** Start a thread running `code`. Mailboxes on the stack after `code` are
+   * passed as arguments (...) to the code.
+   */
+  Worker(const char *code, lua_State *L);
+
+  /** Detaches the thread if join was not called.
+   */
+  ~Worker();
+
+  /** Block until the thread finishes.
+   */
+  void join();
+
+  bool running() {
+    return !__atomic_load_n(&job_->done, __ATOMIC_ACQUIRE);
+  }
+
+private:
+  static void *sRun(void *data);
+
+  static void release(Job *job);
+};
+
+} // lens
+
+#endif // LUBYK_INCLUDE_LENS_WORKER_H_
@@ -50,6 +50,11 @@
 
 #endif
 
+#if !(_WIN32 || __WIN32__)
+#include <pthread.h>
+#include <signal.h> // pthread_sigmask
+#endif
+
 
 // ========================== Namespace LENS
 
@@ -114,6 +119,42 @@ namespace lens {
     }
 #endif
   }
+
+#if !(_WIN32 || __WIN32__)
+  // Start a background thread with SIGINT blocked (the signal mask is
+  // inherited) so that Ctrl-C is always delivered to the main thread and its
+  // Poller (see Poller::setupInterruptHook). Returns 0 or an errno value.
+  inline int startThread(pthread_t *thread, void *(*func)(void*), void *arg) {
+    sigset_t set, old;
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &set, &old);
+    int err = pthread_create(thread, NULL, func, arg);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    return err;
+  }
+#endif
+
+  // Append the bytes in `buf` from `*i` to `len` to the Lua buffer until the
+  // `delim` character is found. Returns true if a full line was added (the
+  // delimiter is consumed but not added). With `strip_cr`, a '\r' just before
+  // the delimiter is dropped. A '\r' ending the data is then left in `buf`
+  // (not consumed) so that the caller can keep it while refilling.
+  inline bool scanLine(luaL_Buffer *b, const char *buf, int *i, int len, char delim, bool strip_cr) {
+    const char *start = buf + *i;
+    const char *end   = (const char*)memchr(start, delim, len - *i);
+    if (end) {
+      *i = end - buf + 1;
+      if (strip_cr && end > start && end[-1] == '\r') --end;
+      luaL_addlstring(b, start, end - start);
+      return true;
+    }
+    end = buf + len;
+    if (strip_cr && end > start && end[-1] == '\r') --end;
+    luaL_addlstring(b, start, end - start);
+    *i = end - buf;
+    return false;
+  }
 } // lens
 
 #endif // LUBYK_INCLUDE_LENS_LENS_H_
@@ -0,0 +1,57 @@
+/*
+  ==============================================================================
+
+   This file is part of the LUBYK project (http://lubyk.org)
+   Copyright (c) 2007-2014 by Gaspard Bucher (http://teti.ch).
+
+  ------------------------------------------------------------------------------
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+
+  ==============================================================================
+*/
+#ifndef LUBYK_INCLUDE_LENS_MSGPACK_H_
+#define LUBYK_INCLUDE_LENS_MSGPACK_H_
+
+#include "dub/dub.h"
+
+#include <string>
+
+// Maximum nesting of tables in packed values.
+#define MSGPACK_MAX_DEPTH 100
+
+namespace lens {
+
+  // Append the msgpack encoding of the Lua value at `index` to `out`. Tables
+  // with keys 1..n are packed as arrays, other tables as maps.
+  void msgpackPack(lua_State *L, int index, std::string &out, int depth = 0);
+
+  // Decode the msgpack value in `data` and push it on the Lua stack. Returns
+  // the number of bytes used.
+  size_t msgpackUnpack(lua_State *L, const char *data, size_t size, int depth = 0);
+
+  // Encode a Lua value with msgpack. Returns a string.
+  LuaStackSize pack(lua_State *L);
+
+  // Decode a string encoded with msgpack. Returns a Lua value.
+  LuaStackSize unpack(lua_State *L);
+
+} // lens
+
+#endif // LUBYK_INCLUDE_LENS_MSGPACK_H_
@@ -6,14 +6,25 @@
   for read/write/events.
 
 --]]------------------------------------------------------
+local lens  = require 'lens'
 local core  = require 'lens.core'
 local lib   = core.File
 
-local     OK,     Wait,     new =
-      lib.OK, lib.Wait, lib.new
+local     OK,     Wait,     End,     new =
+      lib.OK, lib.Wait, lib.End, lib.new
 
-local           yield,     readLine,     write,        len,        sub =
-      coroutine.yield, lib.readLine, lib.write, string.len, string.sub
+local           yield,     readLine,     read,     readAll,     write,        len,        sub,        concat =
+      coroutine.yield, lib.readLine, lib.read, lib.readAll, lib.write, string.len, string.sub, table.concat
+
+local     startRead,     startWrite,     startSync,     ioFd,     ioDone,     ioResult =
+      lib.startRead, lib.startWrite, lib.startSync, lib.ioFd, lib.ioDone, lib.ioResult
+
+local     flush,     buffered,     setWriteBuffer =
+      lib.flush, lib.buffered, lib.setWriteBuffer
+
+local ONE_SHOT = core.Poller.OneShot
+local waitIO, startFlushTimer, ioThread, ioJoin, runIO, waitQueued, asyncRead,
+      asyncWrite, asyncSync, flushBuffered, flushNow, commitNow
 
 -- These lua helpers must be copied in each sub-class in order to avoid casting
 -- resolution overhead. :-(
@@ -22,7 +33,9 @@ local           yield,     readLine,     write,        len,        sub =
 --
 -- + Read:   prepare file for reading
 -- + Write:  prepare file for writing
+-- + ReadWrite: read and write (created if missing), see #readAt
 -- + Events: listen to file changes
+-- + Mmap:   map the whole file in memory for reading (see #slice)
 --
 function lib.new(path, mode)
   local self = {
@@ -32,13 +45,16 @@ function lib.new(path, mode)
   return setmetatable(self, lib)
 end
 
--- Read a line. Returns a string or nil on EOF.
-function lib:readLine()
-  local line, op = readLine(self)
+-- Read a line. Returns a string or nil on EOF. The optional `delim` sets the
+-- end of line character (default is "\n"). A "\r" before "\n" is removed
+-- unless `keep_cr` is true.
+function lib:readLine(delim, keep_cr)
+  waitQueued(self)
+  local line, op = readLine(self, delim, keep_cr)
   while op == Wait do
     local l
     yield('read', self:fd())
-    l, op = readLine(self)
+    l, op = readLine(self, delim, keep_cr)
     line = line .. l
   end
   if op == OK then
@@ -49,6 +65,41 @@ function lib:readLine()
   end
 end
 
+-- Read `sz` bytes. Returns a string or nil on EOF. The string is shorter
+-- than `sz` if the end of file is reached first.
+function lib:read(sz)
+  waitQueued(self)
+  local data, op = read(self, sz)
+  while op == Wait do
+    local d
+    yield('read', self:fd())
+    d, op = read(self, sz - len(data))
+    data = data .. d
+  end
+  if op == End and data == '' then
+    -- EOF
+    return nil
+  end
+  return data
+end
+
+-- Read until the end of file and return the content (empty string if there
+-- is nothing to read).
+function lib:readAll()
+  waitQueued(self)
+  local data, op = readAll(self)
+  if op == Wait then
+    local list = {data}
+    while op == Wait do
+      yield('read', self:fd())
+      data, op = readAll(self)
+      list[#list + 1] = data
+    end
+    data = concat(list)
+  end
+  return data
+end
+
 -- Write a string to a file.
 function lib:write(str)
   local wsz, op = write(self, str)
@@ -57,9 +108,141 @@ function lib:write(str)
     yield('write', self:fd())
     wsz, op = write(self, str)
   end
-  -- done
+  if self.flush_interval and not self.flush_thread and buffered(self) > 0 then
+    startFlushTimer(self)
+  end
+end
+
+-- # Positional I/O
+--
+-- #readAt and #writeAt use pread and pwritev: they do not use or move the
+-- file position so many threads can share the same file for random access
+-- (index or record files) without seeking.
+--
+-- Usage example:
+--
+--   local db = lens.File('records.bin', lens.File.ReadWrite)
+--   db:writeAt(128 * i, header, body)
+--   local header, body = db:readAt(128 * i, 16, 112)
+
+-- Read at `offset` (0 based). Each following argument is a length and one
+-- string is returned for each of them. Strings are shorter if the file ends
+-- first. Returns nil if there is nothing to read at `offset`.
+-- function lib:readAt(offset, len, ...)
+
+-- Write all string arguments at `offset` with a single system call. Returns
+-- the written size. This does not use the write buffer (buffered data is
+-- flushed first, as before any read).
+-- function lib:writeAt(offset, str, ...)
+
+-- # Write buffer
+--
+-- Each #write is a system call by default. With a write buffer, writes are
+-- coalesced in memory and sent to the OS when `size` bytes are pending,
+-- `interval` seconds after the first buffered write (scheduler clock) or when
+-- #flush is called. Buffered data is also written when the file is closed.
+--
+-- The optional `sync` policy makes the interval flush durable: 'data' uses
+-- fdatasync and 'full' uses fsync (see #commit).
+--
+-- Usage example:
+--
+--   local log = lens.File('app.log', lens.File.Write)
+--   -- 64KB buffer, flushed and synced every 0.2 seconds.
+--   log:setBuffer(65536, 0.2, 'data')
+
+-- Set write buffer `size` in bytes (0 disables buffering) with an optional
+-- flush `interval` in seconds and `sync` policy.
+function lib:setBuffer(size, interval, sync)
+  self:flush()
+  setWriteBuffer(self, size)
+  self.buffer_size    = size > 0 and size or nil
+  self.flush_interval = interval
+  self.sync_mode      = sync
+end
+
+-- Send buffered data to the OS.
+function lib:flush()
+  if self.io_thread then
+    -- A queued background write holds older data.
+    return runIO(self, flushNow)
+  end
+  flushNow(self)
+end
+
+-- Number of bytes in the write buffer.
+-- function lib:buffered()
+
+-- Write buffered data and sync the file to disk (fdatasync unless the sync
+-- policy is 'full') in a background thread. Threads calling commit while a
+-- sync is running share the next sync: durability is batched across many
+-- writes instead of syncing after each one.
+function lib:commit()
+  local th = self.next_commit
+  if not th then
+    th = ioThread(self, commitNow)
+    self.next_commit = th
+  end
+  return ioJoin(th)
+end
+
+-- # Background I/O
+--
+-- Regular files are always ready for poll so #read and #write never yield on
+-- them and a slow disk blocks the scheduler. These methods run the system call
+-- in a background thread (see lens.Pool) and only the calling thread waits.
+-- Operations on the same file run one after the other, in call order.
+--
+-- Usage example:
+--
+--   local f = lens.File('data.bin', lens.File.Write)
+--   f:writeAsync(data)
+--   f:sync()
+
+-- Read `sz` bytes in a background thread. Returns a string or nil on EOF.
+function lib:readAsync(sz)
+  return runIO(self, asyncRead, sz)
 end
 
+-- Write a string in a background thread. Returns the written size.
+function lib:writeAsync(str)
+  return runIO(self, asyncWrite, str)
+end
+
+-- Flush written data to disk in a background thread. If `data_only` is true,
+-- metadata not needed to read the data back (mtime) is not flushed
+-- (fdatasync).
+function lib:sync(data_only)
+  return runIO(self, asyncSync, data_only)
+end
+
+-- # Memory mapped files
+--
+-- In Mmap mode, the file is mapped once when it is opened. #readLine, #read
+-- and #readAll copy data from the mapping without any system call and
+-- #slice gives random access. Strings are only created for the requested
+-- parts. The file must not be truncated while it is mapped.
+--
+-- Usage example:
+--
+--   local f = lens.File('table.bin', lens.File.Mmap)
+--   f:advise(lens.File.Random)
+--   local record = f:slice(128 * i, 128)
+
+-- Return `len` bytes at `offset` (0 based) as a string. The string is shorter
+-- if the file ends first. This does not change the position used by
+-- #readLine and #read.
+-- function lib:slice(offset, len)
+
+-- Tell the kernel how the mapped content will be accessed. `advice` is one of
+-- File.Normal, File.Sequential (default), File.Random, File.WillNeed or
+-- File.DontNeed. The optional `offset` and `len` limit the hint to a part of
+-- the file.
+-- function lib:advise(advice, offset, len)
+
+-- Size of the mapped file in bytes.
+-- function lib:size()
+
 -- # Events
 
 -- Listen for OS notifications on file changes. The flags determine which
@@ -100,6 +283,117 @@ end
 -- nodoc
 lib.eventMap = core.Poller.eventMap
 
+------------------------------------------------------ PRIVATE
+
+function startFlushTimer(self)
+  self.flush_thread = lens.Thread(function()
+    yield('sleep', self.flush_interval)
+    self.flush_thread = nil
+    if self:fd() == 0 then
+      -- closed
+      return
+    elseif self.sync_mode then
+      self:commit()
+    else
+      self:flush()
+    end
+  end)
+end
+
+function waitIO(self)
+  while not ioDone(self) do
+    -- The job fd stays readable until the next operation.
+    yield('read', ioFd(self), ONE_SHOT)
+  end
+  return ioResult(self)
+end
+
+function asyncRead(self, sz)
+  startRead(self, sz)
+  local data = waitIO(self)
+  flushBuffered(self)
+  return data
+end
+
+function asyncWrite(self, str)
+  startWrite(self, str)
+  local wsz = waitIO(self)
+  flushBuffered(self)
+  return wsz
+end
+
+function asyncSync(self, data_only)
+  startSync(self, data_only)
+  return waitIO(self)
+end
+
+-- Run `func` in a thread started after the operations already queued for this
+-- file (the native side only runs one operation at a time).
+function ioThread(self, func, arg)
+  local prev = self.io_thread
+  local th
+  local function done()
+    if self.io_thread == th then
+      self.io_thread = nil
+    end
+  end
+  th = lens.Thread(function()
+    if prev then prev:join() end
+    th.res = func(self, arg)
+    done()
+  end)
+  -- pcall cannot yield in Lua 5.1: errors are caught by the scheduler.
+  th.error = function(err)
+    th.err = err
+    done()
+  end
+  self.io_thread = th
+  return th
+end
+
+-- Wait for an operation thread and return its result.
+function ioJoin(th)
+  th:join()
+  if th.err then error(th.err, 0) end
+  return th.res
+end
+
+function runIO(self, func, arg)
+  return ioJoin(ioThread(self, func, arg))
+end
+
+-- Sync reads use the file position: wait for the queued operations first.
+-- Their errors are raised in the threads which started them.
+function waitQueued(self)
+  local th = self.io_thread
+  while th do
+    th:join()
+    th = self.io_thread
+  end
+end
+
+-- Data written during an async read or write was kept in the buffer.
+function flushBuffered(self)
+  if buffered(self) >= (self.buffer_size or 1) then
+    flushNow(self)
+  end
+end
+
+function flushNow(self)
+  local op = flush(self)
+  while op == Wait do
+    yield('write', self:fd())
+    op = flush(self)
+  end
+end
+
+function commitNow(self)
+  -- Threads calling commit from now on wait for the next sync.
+  self.next_commit = nil
+  flushNow(self)
+  startSync(self, self.sync_mode ~= 'full')
+  return waitIO(self)
+end
 
 return lib
 
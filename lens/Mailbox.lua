@@ -0,0 +1,73 @@
+--[[------------------------------------------------------
+
+  # Mailbox
+
+  Message queue between OS threads (see lens.Worker). Any thread can #post
+  strings without blocking. The receiving thread waits for messages in its
+  scheduler with #receive.
+
+  Usage example:
+
+    local inbox  = lens.Mailbox()
+    local outbox = lens.Mailbox()
+    local worker = lens.Worker([[
+      local lens = require 'lens'
+      local inbox, outbox = ...
+      lens.sched():run(function()
+        while true do
+          local msg = inbox:receive()
+          outbox:post(msg:upper())
+        end
+      end)
+    ]], inbox, outbox)
+
+    lens.run(function()
+      inbox:post('hello')
+      print(outbox:receive())
+      --> HELLO
+    end)
+
+  Only one thread should receive from a given mailbox.
+
+--]]------------------------------------------------------
+local core  = require 'lens.core'
+local lib   = core.Mailbox
+
+local           yield,     recv,     pending,     fd =
+      coroutine.yield, lib.recv, lib.pending, lib.fd
+
+-- # Constructor
+
+-- Create a new empty mailbox.
+-- function lib.new()
+
+-- # Methods
+
+-- Post a string message. This can be called from any thread.
+-- function lib:post(msg)
+
+-- Return the next message or nil if the mailbox is empty (does not yield).
+-- function lib:recv()
+
+-- Wait for the next message and return it.
+function lib:receive()
+  while true do
+    local msg = recv(self)
+    if msg then
+      return msg
+    elseif pending(self) == 0 then
+      yield('read', fd(self))
+    else
+      -- Another thread is posting a message.
+      yield('sleep', 0)
+    end
+  end
+end
+
+-- Number of messages posted and not yet received.
+-- function lib:pending()
+
+-- File descriptor readable when messages are available.
+-- function lib:fd()
+
+return lib
@@ -4,8 +4,21 @@
 
   Normally, end users do not interact directly with the poller.
   It is used internally by lens.Scheduler to wait on file
-  descriptors and sleep. This poller uses fast poll API and nanosleep
-  for precise operation.
+  descriptors and sleep. This poller uses kqueue on macosx, epoll on
+  linux (or the fast poll API when built with `LUBYK_POLLER_POLL`). Wake up
+  times are never rounded to milliseconds: kqueue and ppoll take a timespec
+  and epoll waits on a timerfd armed with the absolute wake up time so that
+  timers fire with microsecond accuracy in a single blocking call.
+
+  On linux, io_uring can be selected at runtime by passing `Poller.URing` as
+  backend. Changes to the watched items are then submitted with the same
+  system call that waits for events. If the kernel does not support it, the
+  poller silently falls back to epoll (check with #backend).
+
+  With io_uring, lens.Socket receive and send methods use completion I/O:
+  instead of waking the thread when the socket is ready and then calling
+  recv or send, the poller submits the call itself and the thread is resumed
+  with the result.
 
 -- # Poller API
 -- TODO  
@@ -16,8 +29,23 @@ local core  = require 'lens.core'
 local lib   = core.Poller
 
 -- Create a new poller. Optional `reserve` argument is used to reserve slots
--- in memory for items to poll on (default = 8).
--- function lib.new(reserve)
+-- in memory for items to poll on (default = 8). Optional `backend` can be
+-- `Poller.URing` to use io_uring on linux (default = Poller.Default).
+-- function lib.new(reserve, backend)
+
+-- Add a file descriptor to watch. `filter` is Poller.Read, Poller.Write or
+-- Poller.VNode. Read and Write can be combined with Poller.Edge (only report
+-- new readiness) and Poller.OneShot (report once until #modify is called).
+-- Both flags are ignored by the poll fallback. Returns the item idx.
+-- function lib:add(fd, filter, flags)
+
+-- Change the filter (and optionally the fd) of item `idx`. This re-arms a
+-- OneShot item.
+-- function lib:modify(idx, filter, fd, flags)
+
+-- Return the backend in use (Poller.KQueue, Poller.EPoll, Poller.URing or
+-- Poller.Poll).
+-- function lib:backend()
 
 -- Polls for new events with a maximal waiting time of `timeout`. Returns `true`
 -- on success and `false` on interruption.
@@ -26,4 +54,10 @@ local lib   = core.Poller
 -- Return a table with all event idx or nil. Used after a call to #poll.
 -- function lib.events()
 
+-- Store event idx in `events` (events[1..count]) and return the count. This
+-- is used instead of #events to avoid creating a table on each poll. Entries
+-- past count are left untouched. If `revents` is a table, it receives a mask
+-- of Poller.Read, Poller.Write, Poller.Hup and Poller.Error for each event.
+-- function lib:fillEvents(events, revents)
+
 return lib
@@ -9,11 +9,11 @@ local core  = require 'lens.core'
 local lib   = core.Popen
 local new   = core.Popen.new
 
-local           OK,           Wait, Read =
-      lens.File.OK, lens.File.Wait, lens.File.Read
+local           OK,           Wait,           End, Read =
+      lens.File.OK, lens.File.Wait, lens.File.End, lens.File.Read
 
-local           yield,     readLine,     write,        len,        sub =
-      coroutine.yield, lib.readLine, lib.write, string.len, string.sub
+local           yield,     readLine,     read,     readAll,     write,        len,        sub,        concat =
+      coroutine.yield, lib.readLine, lib.read, lib.readAll, lib.write, string.len, string.sub, table.concat
 
 
 --nodoc (used for testing)
@@ -34,13 +34,15 @@ end
 -- These lua helpers must be copied from File in each sub-class in order to
 -- avoid casting resolution overhead. :-(
 
--- Read a line. Returns a string or nil on EOF.
-function lib:readLine()
-  local line, op = readLine(self)
+-- Read a line. Returns a string or nil on EOF. The optional `delim` sets the
+-- end of line character (default is "\n"). A "\r" before "\n" is removed
+-- unless `keep_cr` is true.
+function lib:readLine(delim, keep_cr)
+  local line, op = readLine(self, delim, keep_cr)
   while op == Wait do
     local l
     yield('read', self:fd())
-    l, op = readLine(self)
+    l, op = readLine(self, delim, keep_cr)
     line = line .. l
   end
   if op == OK then
@@ -51,6 +53,39 @@ function lib:readLine()
   end
 end
 
+-- Read `sz` bytes. Returns a string or nil on EOF. The string is shorter
+-- than `sz` if the end of file is reached first.
+function lib:read(sz)
+  local data, op = read(self, sz)
+  while op == Wait do
+    local d
+    yield('read', self:fd())
+    d, op = read(self, sz - len(data))
+    data = data .. d
+  end
+  if op == End and data == '' then
+    -- EOF
+    return nil
+  end
+  return data
+end
+
+-- Read until the end of file and return the content (empty string if there
+-- is nothing to read).
+function lib:readAll()
+  local data, op = readAll(self)
+  if op == Wait then
+    local list = {data}
+    while op == Wait do
+      yield('read', self:fd())
+      data, op = readAll(self)
+      list[#list + 1] = data
+    end
+    data = concat(list)
+  end
+  return data
+end
+
 -- Write a string to a file.
 function lib:write(str)
   local wsz, op = write(self, str)
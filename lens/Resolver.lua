@@ -0,0 +1,74 @@
+--[[------------------------------------------------------
+
+  # Resolver
+
+  Name resolution in background threads. The calling thread yields until the
+  lookup is done so that the scheduler keeps running other threads while the
+  resolver waits for DNS. lens.Socket uses the resolver in #connect.
+
+  Resolved addresses are cached (shared by all workers) for #ttl seconds.
+
+  Usage example:
+
+    lens.run(function()
+      print(lens.Resolver.resolve('localhost'))
+      --> 127.0.0.1
+      print(lens.Resolver.reverse('127.0.0.1'))
+      --> localhost
+    end)
+
+--]]------------------------------------------------------
+local core  = require 'lens.core'
+local lib   = core.Resolver
+
+local           yield,     done,     fd,     result =
+      coroutine.yield, lib.done, lib.fd, lib.result
+
+local reverse, resolve, cached = lib.reverse, lib.resolve, lib.cached
+
+local ONE_SHOT = core.Poller.OneShot
+
+-- nodoc
+-- Wait for the lookup to finish and return the result or nil and an error
+-- message.
+function lib:wait()
+  while not done(self) do
+    -- OneShot: the wake up fd stays readable once the lookup is done.
+    yield('read', fd(self), ONE_SHOT)
+  end
+  return result(self)
+end
+
+-- # Functions
+
+-- Return the numeric address (IPv4 or IPv6) of `host` or nil and an error
+-- message. Yields until the lookup is done unless the address is numeric or
+-- in the cache.
+function lib.resolve(host)
+  local addr = cached(host)
+  if addr then
+    return addr
+  end
+  return resolve(host):wait()
+end
+
+-- Return the host name of the numeric address `host` or nil and an error
+-- message (reverse DNS). Yields until the lookup is done.
+function lib.reverse(host)
+  return reverse(host):wait()
+end
+
+-- Return the numeric address of `host` if it is numeric or cached, nil
+-- otherwise. Never yields.
+-- function lib.cached(host)
+
+-- # Cache
+
+-- Set the time in seconds during which resolved addresses are cached (default
+-- is 60). Set to 0 to disable the cache.
+-- function lib.setTTL(ttl)
+
+-- Return the cache time in seconds.
+-- function lib.ttl()
+
+return lib
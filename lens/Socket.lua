@@ -3,7 +3,7 @@
   lens.Socket
   ---------
 
-  BSD Socket that uses msgpack to send Lua values.
+  BSD Socket that uses msgpack to send Lua values (see #sendValue).
 
 --]]------------------------------------------------------
 local lens = require 'lens'
@@ -11,15 +11,27 @@ local core = require 'lens.core'
 local lib  = core.Socket
 local new  = lib.new
 
-local           yield,       slen,       ssub = 
-      coroutine.yield, string.len, string.sub
+local yield, running = coroutine.yield, coroutine.running
 
-function lib.new(sock_type, func)
+-- Create a new socket of type `sock_type` (default is Socket.TCP). If `func`
+-- is provided, it is run in a new thread. The optional `buffer_size` sets the
+-- size of the receive buffer (default is 8196 bytes). This buffer is only
+-- allocated while there is received data not yet used so that idle sockets do
+-- not hold memory.
+function lib.new(sock_type, func, buffer_size)
   if type(sock_type) == 'function' then
-    func = sock_type
+    func, buffer_size = sock_type, func
     sock_type = lib.TCP
   end
-  local self = new(sock_type or lib.TCP)
+  if type(func) == 'number' then
+    func, buffer_size = nil, func
+  end
+  local self
+  if buffer_size then
+    self = new(sock_type or lib.TCP, buffer_size)
+  else
+    self = new(sock_type or lib.TCP)
+  end
 
   if func then
     self.thread = lens.Thread(function()
@@ -30,17 +42,35 @@ function lib.new(sock_type, func)
 end
 
 local bind = lib.bind
-function lib:bind(host, port)
+-- Bind socket to `host` and `port`. The optional `flags` can be
+-- Socket.ReuseAddr, Socket.ReusePort or their sum. With ReusePort, several
+-- sockets (usually in different lens.Worker) can listen on the same port and
+-- the kernel balances incoming connections between them.
+function lib:bind(host, port, flags)
   self.host    = host
-  self.port    = bind(self.super, host, port)
+  self.port    = bind(self.super, host or '*', port or 0, flags or 0)
   self.sock_fd = self:fd()
   return self.port
 end
 
 local connect = lib.connect
-function lib:connect(...)
+-- Connect to `host` and `port`. The host name is resolved in a background
+-- thread (see lens.Resolver) and this method yields until the address is
+-- known and the connection is established. Outside of a lens.Thread, the
+-- host is resolved synchronously.
+function lib:connect(host, port)
   local super = self.super
-  local ok = connect(super, ...)
+  local co, main = running()
+  local ok
+  if co and not main then
+    local addr, err = lens.Resolver.resolve(host)
+    if not addr then
+      error(string.format('Could not resolve %s (%s).', host, err))
+    end
+    ok = connect(super, host, port, addr)
+  else
+    ok = connect(super, host, port)
+  end
   self.sock_fd = super:fd()
   if not ok then
     yield('write', self.sock_fd)
@@ -50,12 +80,12 @@ end
 
 local recvMessage = lib.recvMessage
 -- Receive all there is to receive. This method yields if the data is not yet
--- available.
+-- available. With UDP sockets, also returns the sender's `host` and `port`.
 function lib:recvMessage()
   local super  = self.super
 
   while true do
-    local data, eagain = recvMessage(super)
+    local data, eagain, host, port = recvMessage(super)
     if eagain then
       -- EAGAIN
       -- no data
@@ -63,12 +93,50 @@ function lib:recvMessage()
       -- closed
       error('Connection closed while reading.')
     else
-      return data
+      return data, host, port
     end
     yield('read', self.sock_fd)
   end
 end
 
+local recvMessages = lib.recvMessages
+-- Receive up to `max` (default 64) datagrams with a single system call (UDP
+-- only). Returns three lists: `messages`, `hosts` and `ports`. This method
+-- yields if no datagram is available.
+function lib:recvMessages(max)
+  local super  = self.super
+  max = max or 64
+
+  while true do
+    local list, hosts, ports = recvMessages(super, max)
+    if list then
+      return list, hosts, ports
+    end
+    yield('read', self.sock_fd)
+  end
+end
+
+local recvSpace, feed = lib.recvSpace, lib.feed
+
+-- Wait for more data. When the scheduler's poller supports completion I/O
+-- (lens.Poller.URing), the poller receives the data while the thread waits and
+-- the data is moved in the receive buffer: no system call after wake up.
+local function waitRecv(self)
+  if not self.no_completion then
+    local data = yield('recv', self.sock_fd, recvSpace(self.super))
+    if type(data) == 'string' then
+      feed(self.super, data)
+      return
+    elseif data ~= false then
+      -- Closed or error: reported by the next recv call.
+      return
+    end
+    -- Not supported by the poller.
+    self.no_completion = true
+  end
+  yield('read', self.sock_fd)
+end
+
 local recvBytes = lib.recvBytes
 -- Receive `len` count of bytes. This method yields if the data is not yet
 -- available.
@@ -96,17 +164,20 @@ function lib:recvBytes(len)
         return data
       end
     end
-    yield('read', self.sock_fd)
+    waitRecv(self)
   end
 end
 
 local recvLine = lib.recvLine
-function lib:recvLine()
+-- Receive a line. This method yields if the line is not yet complete. The
+-- optional `delim` sets the end of line character (default is "\n"). A "\r"
+-- before "\n" is removed unless `keep_cr` is true.
+function lib:recvLine(delim, keep_cr)
   local super  = self.super
   local buffer
 
   while true do
-    local data, eagain = recvLine(super)
+    local data, eagain = recvLine(super, delim, keep_cr)
     if not data then
       -- closed
       error('Connection closed while reading.')
@@ -124,34 +195,197 @@ function lib:recvLine()
         return data
       end
     end
-    yield('read', self.sock_fd)
+    waitRecv(self)
+  end
+end
+
+local send, flush, watermark = lib.send, lib.flush, lib.watermark
+local queued, consume = lib.queued, lib.consume
+
+-- Let the poller send the first chunk of the send queue (completion I/O, see
+-- waitRecv). Returns the number of bytes still waiting or nil if the queue
+-- must be sent with flush.
+local function sendQueued(self)
+  local super = self.super
+  local data = queued(super)
+  if not data then return end
+  local sent = yield('send', self.sock_fd, data)
+  if sent == false then
+    -- Not supported by the poller.
+    self.no_completion = true
+  end
+  local pending = consume(super, sent or 0)
+  if sent and sent > 0 then
+    return pending
+  elseif sent then
+    -- Error: reported by flush.
+    return flush(super)
   end
 end
 
-local send = lib.send
-function lib:send(data)
-  local buffer = data
+-- Wait until the send queue is at or below `low` bytes.
+local function drain(self, pending, low)
+  while pending > low do
+    local left = not self.no_completion and sendQueued(self)
+    if left then
+      pending = left
+    else
+      yield('write', self.sock_fd)
+      pending = flush(self.super)
+    end
+  end
+end
+
+-- Send one or more strings. The strings are written with a single system
+-- call when possible. What cannot be sent right away stays in the socket's
+-- send queue (without copy) and this method yields until the queue is at or
+-- below the watermark (see #setWatermark).
+function lib:send(...)
+  local super = self.super
+  drain(self, send(super, ...), watermark(super))
+end
+
+-- Yield until all queued data is sent.
+function lib:flush()
+  drain(self, flush(self.super), 0)
+end
+
+-- # Send queue
+--
+-- By default, send methods return once all data has been written. With a
+-- watermark, they return as soon as less than `bytes` are waiting in the
+-- queue so that a thread can prepare more data while the socket sends. The
+-- rest of the queue is sent on the next send call or with #flush.
+--
+-- function lib:setWatermark(bytes)
+
+-- Number of bytes waiting in the send queue.
+--
+-- function lib:pending()
+
+local recvFrame = lib.recvFrame
+-- Receive a length-prefixed frame (see #sendFrame). Returns the payload as a
+-- single string. This method yields until the frame is complete.
+function lib:recvFrame()
+  local super  = self.super
+
+  while true do
+    local data, eagain = recvFrame(super)
+    if data then
+      return data
+    elseif not eagain then
+      -- closed
+      error('Connection closed while reading.')
+    end
+    waitRecv(self)
+  end
+end
+
+local sendFrame = lib.sendFrame
+-- Send `data` as a length-prefixed frame: 4 bytes with the size (big endian)
+-- followed by the data. This method yields if the socket is not ready for
+-- writing.
+function lib:sendFrame(data)
+  local super = self.super
+  drain(self, sendFrame(super, data), watermark(super))
+end
+
+local recvValue = lib.recvValue
+-- Receive a Lua value sent with #sendValue. The value is decoded from the
+-- received bytes without intermediate Lua strings. This method yields until
+-- the value is complete.
+function lib:recvValue()
+  local super  = self.super
+
   while true do
-    local sent = send(self.super, data)
-    if sent < 0 then
-      -- eagain
+    local value, eagain = recvValue(super)
+    if eagain == false then
+      return value
+    elseif not eagain then
+      -- closed
+      error('Connection closed while reading.')
+    end
+    waitRecv(self)
+  end
+end
+
+local sendValue = lib.sendValue
+-- Send a Lua value (nil, boolean, number, string or table of these) encoded
+-- with msgpack as a frame (see #sendFrame). This method yields if the socket
+-- is not ready for writing.
+function lib:sendValue(value)
+  local super = self.super
+  drain(self, sendValue(super, value), watermark(super))
+end
+
+local sendMessages = lib.sendMessages
+-- Send each string in `list` as a datagram to the connected host (UDP only,
+-- see #connect). Messages are sent in batches with as few system calls as
+-- possible. This method yields if the socket is not ready for writing.
+function lib:sendMessages(list)
+  local super = self.super
+  local i = 1
+  local count = #list
+  while i <= count do
+    i = i + sendMessages(super, list, i)
+    if i <= count then
       yield('write', self.sock_fd)
-    elseif sent == slen(data) then
+    end
+  end
+end
+
+local sendFile = lib.sendFile
+-- Send the content of `file` (a lens.File or a file descriptor) starting at
+-- `offset` (default 0). If `len` is nil, sends until the end of the file. The
+-- data does not go through Lua (sendfile). Data already read by File#readLine
+-- and kept in the file's buffer is not sent. This method yields if the socket
+-- is not ready for writing and returns the number of bytes sent (TCP only).
+function lib:sendFile(file, offset, len)
+  local super = self.super
+  local fd = type(file) == 'number' and file or file:fd()
+  offset = offset or 0
+  local total = 0
+  while not len or total < len do
+    local sent = sendFile(super, fd, offset + total, len and len - total or 2^30)
+    if sent == 0 then
+      -- end of file
       break
+    elseif sent < 0 then
+      yield('write', self.sock_fd)
     else
-      data = ssub(data, sent + 1)
+      total = total + sent
     end
   end
+  return total
 end
 
-local accept = lib.accept
-function lib:accept(func)
-  local cli = accept(self.super)
-  while not cli do
-    yield('read', self.sock_fd)
-    cli = accept(self.super)
+local splice = lib.splice
+-- Send data read from the pipe `file` (a lens.File such as lens.Popen or a
+-- file descriptor) until end of file or until `len` bytes have been sent. On
+-- linux, the data stays in the kernel (splice). This method yields while the
+-- pipe has no data or the socket is not ready for writing and returns the
+-- number of bytes sent (TCP only).
+function lib:sendPipe(file, len)
+  local super = self.super
+  local fd = type(file) == 'number' and file or file:fd()
+  local total = 0
+  while not len or total < len do
+    local sent = splice(super, fd, len and len - total or 65536)
+    if sent == 0 then
+      -- end of file
+      break
+    elseif sent == -1 then
+      yield('read', fd)
+    elseif sent == -2 then
+      yield('write', self.sock_fd)
+    else
+      total = total + sent
+    end
   end
+  return total
+end
 
+local function setupClient(cli, func)
   cli.sock_fd = cli:fd()
   if func then
     -- start new thread
@@ -162,6 +396,112 @@ function lib:accept(func)
   return cli
 end
 
+local accept = lib.accept
+-- Accept a new connection. If `func` is provided, it is run with the client
+-- socket in a new thread. The client's remote host is the numeric address:
+-- use #remoteName to get the host name.
+function lib:accept(func)
+  local cli = accept(self.super)
+  while not cli do
+    yield('read', self.sock_fd)
+    cli = accept(self.super)
+  end
+
+  return setupClient(cli, func)
+end
+
+local acceptMany = lib.acceptMany
+-- Accept all pending connections (up to `max`, default 64) in one call. This
+-- is faster than #accept during connection bursts. If `func` is provided, it
+-- is run with each client socket in a new thread. Returns the list of client
+-- sockets.
+function lib:acceptMany(max, func)
+  if type(max) == 'function' then
+    max, func = nil, max
+  end
+  max = max or 64
+  local list = acceptMany(self.super, max)
+  while not list do
+    yield('read', self.sock_fd)
+    list = acceptMany(self.super, max)
+  end
+
+  for i = 1, #list do
+    setupClient(list[i], func)
+  end
+  return list
+end
+
+-- Return the host name of the remote end or nil and an error message. The
+-- reverse DNS lookup runs in a background thread (see lens.Resolver) and this
+-- method yields until it is done.
+function lib:remoteName()
+  return lens.Resolver.reverse(self:remoteHost())
+end
+
+local SHARD = [[
+local lens = require 'lens'
+local host, port, index, code = %q, %d, %d, %q
+local control = ...
+local handler = assert((loadstring or load)(code, 'lens.Socket.shard'))(select(2, ...))
+lens.sched():run(function()
+  local srv = lens.Socket()
+  srv:bind(host, port, lens.Socket.ReuseAddr + lens.Socket.ReusePort)
+  srv:listen()
+  local loop = lens.Thread(function()
+    while true do
+      srv:accept(function(cli)
+        handler(cli, index)
+      end)
+    end
+  end)
+  -- Any message on the control mailbox stops the accept loop. Threads
+  -- running the handler finish their work before the worker returns.
+  control:receive()
+  loop:kill()
+  srv:close()
+end)
+]]
+
+-- Start `count` lens.Worker threads, each running its own accept loop on
+-- `host:port` with SO_REUSEPORT. `code` is a string with Lua code returning
+-- the function called (in a new lens.Thread) with each accepted client and
+-- the index of the worker (1 to `count`). Mailboxes passed after `code` are
+-- available in `code` as `...`. Returns the list of workers. Use
+-- #stopSharded to stop them.
+--
+-- Usage example:
+--
+--   local workers = lens.Socket.shardedListen('*', 8080, 4, [=[
+--     return function(cli)
+--       cli:send(cli:recvLine() .. '\n')
+--     end
+--   ]=])
+--   -- ...
+--   lens.Socket.stopSharded(workers)
+function lib.shardedListen(host, port, count, code, ...)
+  local list = {control = {}}
+  for i = 1, count do
+    local control = lens.Mailbox()
+    local chunk = string.format(SHARD, host or '*', port, i, code)
+    list.control[i] = control
+    list[i] = lens.Worker(chunk, control, ...)
+  end
+  return list
+end
+
+-- Stop the accept loops started by #shardedListen and wait for the workers to
+-- return. Since lens.Worker#join blocks the OS thread, this should not be
+-- called while connection handlers still wait on the calling scheduler.
+function lib.stopSharded(list)
+  for i = 1, #list do
+    list.control[i]:post('stop')
+  end
+  for i = 1, #list do
+    list[i]:join()
+  end
+end
+
 function lib:kill()
   if self.thread then
     self.thread:kill()
@@ -0,0 +1,47 @@
+--[[------------------------------------------------------
+
+  # Worker
+
+  Run Lua code on another core. The code runs in a new OS thread with its own
+  Lua state, lens.sched() scheduler and poller. Lua values cannot be shared
+  between threads: use lens.Mailbox objects to pass messages.
+
+  Do not use lens.run in the worker code: it calls os.exit when the scheduler
+  stops which would end the whole process.
+
+  Usage example:
+
+    local inbox = lens.Mailbox()
+    -- One worker per core, all receiving from the same mailbox is *not*
+    -- supported: give each worker its own inbox.
+    local worker = lens.Worker([[
+      local lens = require 'lens'
+      local inbox = ...
+      lens.sched():run(function()
+        local msg = inbox:receive()
+        print('worker got', msg)
+      end)
+    ]], inbox)
+
+    inbox:post('work')
+
+--]]------------------------------------------------------
+local core  = require 'lens.core'
+local lib   = core.Worker
+
+-- # Constructor
+
+-- Start a new OS thread running `code` (a string). Any lens.Mailbox passed
+-- after the code is available in the worker as arguments (`...`).
+-- function lib.new(code, ...)
+
+-- # Methods
+
+-- Block until the worker code returns. Note that this blocks the calling OS
+-- thread (and its scheduler).
+-- function lib:join()
+
+-- Return true until the worker code returns.
+-- function lib:running()
+
+return lib
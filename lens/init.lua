@@ -52,6 +52,12 @@ lib.DESCRIPTION = {
   lens.Finalizer: run code on garbage collection.
 
   lens.Popen: pipe working with scheduler (non-blocking).
+
+  lens.Worker: run Lua code in another OS thread with its own scheduler.
+
+  lens.Mailbox: lock-free message queue between workers.
+
+  lens.Resolver: name resolution without blocking the scheduler.
   ]],
   homepage = "http://doc.lubyk.org/"..lib.type..".html",
   author   = "Gaspard Bucher",
@@ -64,7 +70,7 @@ lib.BUILD = {
   includes  = {'include', 'src/bind'},
   libraries = {'stdc++'},
   platlibs  = {
-    linux   = {'stdc++', 'rt'},
+    linux   = {'stdc++', 'rt', 'pthread'},
     macosx  = {
       'stdc++',
       '-framework Foundation',
@@ -122,26 +128,29 @@ end
 
 -- Wait until the filedescriptor `fd` is ready for reading. Since some pollers
 -- are edge based, make sure that fd is *not readable* before calling this.
+-- The optional `mode` can be lens.Poller.Edge to only be woken up by new data
+-- or lens.Poller.OneShot.
 --
 -- this function simply does:
 --
---   lens.waitRead(fd)
+--   lens.waitRead(fd, mode)
 --   -- is the same as
---   coroutine.yield('read', fd)
-function lib.waitRead(fd)
-  yield('read', fd)
+--   coroutine.yield('read', fd, mode)
+function lib.waitRead(fd, mode)
+  yield('read', fd, mode)
 end
 
 -- Wait until the filedescriptor `fd` is ready for writing. Since some pollers
 -- are edge based, make sure that fd is *not writeable* before calling this.
+-- See #waitRead for `mode`.
 --
 -- this function simply does:
 --
---   lens.waitWrite(fd)
+--   lens.waitWrite(fd, mode)
 --   -- is the same as
---   coroutine.yield('write', fd)
-function lib.waitWrite(fd)
-  yield('write', fd)
+--   coroutine.yield('write', fd, mode)
+function lib.waitWrite(fd, mode)
+  yield('write', fd, mode)
 end
 
 -- nodoc
@@ -161,6 +170,21 @@ lib.millisleep = core.millisleep
 -- nodoc
 lib.elapsed = core.elapsed
 
+-- Encode a Lua value (nil, boolean, number, string or table of these) with
+-- msgpack. Returns a string. Tables with keys 1..n are encoded as arrays.
+--
+-- function lib.pack(value)
+
+-- nodoc
+lib.pack = core.pack
+
+-- Decode a string encoded with msgpack (see #pack).
+--
+-- function lib.unpack(str)
+
+-- nodoc
+lib.unpack = core.unpack
+
 -- Initialize library.
 core.init()
 
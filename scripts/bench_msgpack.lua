@@ -0,0 +1,214 @@
+--
+-- Compare the native msgpack codec (lens.pack, lens.unpack) with a pure Lua
+-- implementation (the way values were encoded before the native codec).
+--
+-- Usage: lua scripts/bench_msgpack.lua [iterations]
+--
+local lens = require 'lens'
+
+local char, byte, sub, floor, frexp, ldexp, concat =
+      string.char, string.byte, string.sub, math.floor, math.frexp, math.ldexp, table.concat
+
+local unpack = unpack or table.unpack
+
+local ITER = tonumber(arg and arg[1]) or 20000
+
+------------------------------------------------------ Pure Lua codec
+
+local function be(n, bytes)
+  local t = {}
+  for i = bytes, 1, -1 do
+    t[i] = n % 256
+    n = floor(n / 256)
+  end
+  return char(unpack(t))
+end
+
+local function packDouble(d)
+  local sign = 0
+  if d < 0 or (d == 0 and 1/d < 0) then
+    sign = 0x80
+    d = -d
+  end
+  local m, e = frexp(d)
+  if d == 0 then
+    m, e = 0, 0
+  else
+    m = (m * 2 - 1) * 2^52
+    e = e + 1022
+  end
+  local hi = floor(m / 2^32)
+  return char(0xcb, sign + floor(e / 16), (e % 16) * 16 + floor(hi / 2^16)) ..
+         be(hi % 2^16, 2) .. be(m % 2^32, 4)
+end
+
+local pack
+
+local function packTable(t, out)
+  local n = #t
+  local count = 0
+  for _ in pairs(t) do count = count + 1 end
+  if count == n then
+    out[#out+1] = n < 16 and char(0x90 + n) or (char(0xdc) .. be(n, 2))
+    for i = 1, n do pack(t[i], out) end
+  else
+    out[#out+1] = count < 16 and char(0x80 + count) or (char(0xde) .. be(count, 2))
+    for k, v in pairs(t) do
+      pack(k, out)
+      pack(v, out)
+    end
+  end
+end
+
+function pack(v, out)
+  local tv = type(v)
+  if tv == 'nil' then
+    out[#out+1] = char(0xc0)
+  elseif tv == 'boolean' then
+    out[#out+1] = char(v and 0xc3 or 0xc2)
+  elseif tv == 'number' then
+    if v == floor(v) and v >= 0 and v < 2^32 then
+      if v < 128 then
+        out[#out+1] = char(v)
+      elseif v < 2^16 then
+        out[#out+1] = char(0xcd) .. be(v, 2)
+      else
+        out[#out+1] = char(0xce) .. be(v, 4)
+      end
+    elseif v == floor(v) and v < 0 and v >= -32 then
+      out[#out+1] = char(256 + v)
+    else
+      out[#out+1] = packDouble(v)
+    end
+  elseif tv == 'string' then
+    local n = #v
+    if n < 32 then
+      out[#out+1] = char(0xa0 + n)
+    elseif n < 2^16 then
+      out[#out+1] = char(0xda) .. be(n, 2)
+    else
+      out[#out+1] = char(0xdb) .. be(n, 4)
+    end
+    out[#out+1] = v
+  else
+    packTable(v, out)
+  end
+end
+
+local function luaPack(v)
+  local out = {}
+  pack(v, out)
+  return concat(out)
+end
+
+local function getBE(s, i, bytes)
+  local n = 0
+  for j = i, i + bytes - 1 do
+    n = n * 256 + byte(s, j)
+  end
+  return n
+end
+
+local unpackAt
+
+local function unpackList(s, i, n, map)
+  local t = {}
+  local k, v
+  for j = 1, n do
+    if map then
+      k, i = unpackAt(s, i)
+      v, i = unpackAt(s, i)
+      t[k] = v
+    else
+      t[j], i = unpackAt(s, i)
+    end
+  end
+  return t, i
+end
+
+function unpackAt(s, i)
+  local c = byte(s, i)
+  if c < 0x80 then
+    return c, i + 1
+  elseif c >= 0xe0 then
+    return c - 256, i + 1
+  elseif c < 0x90 then
+    return unpackList(s, i + 1, c - 0x80, true)
+  elseif c < 0xa0 then
+    return unpackList(s, i + 1, c - 0x90)
+  elseif c < 0xc0 then
+    local n = c - 0xa0
+    return sub(s, i + 1, i + n), i + 1 + n
+  elseif c == 0xc0 then
+    return nil, i + 1
+  elseif c == 0xc2 then
+    return false, i + 1
+  elseif c == 0xc3 then
+    return true, i + 1
+  elseif c == 0xcb then
+    local b1, b2 = byte(s, i + 1, i + 2)
+    local sign = b1 >= 0x80 and -1 or 1
+    local e = (b1 % 0x80) * 16 + floor(b2 / 16)
+    local m = ((b2 % 16) * 2^48 + getBE(s, i + 3, 6)) / 2^52
+    if e == 0 then
+      return sign * ldexp(m, -1022), i + 9
+    end
+    return sign * ldexp(1 + m, e - 1023), i + 9
+  elseif c == 0xcc then
+    return byte(s, i + 1), i + 2
+  elseif c == 0xcd then
+    return getBE(s, i + 1, 2), i + 3
+  elseif c == 0xce then
+    return getBE(s, i + 1, 4), i + 5
+  elseif c == 0xda or c == 0xdb then
+    local bytes = c == 0xda and 2 or 4
+    local n = getBE(s, i + 1, bytes)
+    return sub(s, i + 1 + bytes, i + bytes + n), i + 1 + bytes + n
+  elseif c == 0xdc then
+    return unpackList(s, i + 3, getBE(s, i + 1, 2))
+  elseif c == 0xde then
+    return unpackList(s, i + 3, getBE(s, i + 1, 2), true)
+  end
+  error(string.format('Unsupported type 0x%02x', c))
+end
+
+local function luaUnpack(s)
+  return (unpackAt(s, 1))
+end
+
+------------------------------------------------------ Benchmark
+
+local value = {
+  id     = 12345,
+  name   = 'temperature sensor',
+  values = {},
+  ok     = true,
+  ratio  = 0.75,
+  tags   = {'a', 'b', 'c'},
+}
+for i = 1, 50 do
+  value.values[i] = i * 1.5
+end
+
+-- Both codecs must agree.
+assert(luaPack(value.values) == lens.pack(value.values))
+assert(luaUnpack(lens.pack(value)).name == value.name)
+assert(lens.unpack(luaPack(value)).ratio == value.ratio)
+
+local function bench(name, func)
+  local start = lens.elapsed()
+  for i = 1, ITER do
+    func()
+  end
+  local t = lens.elapsed() - start
+  print(string.format('%-14s %8.3f s  %8.2f us/op', name, t, t * 1000000 / ITER))
+  return t
+end
+
+local packed = lens.pack(value)
+print(string.format('%i iterations, %i bytes per value', ITER, #packed))
+local lp = bench('Lua pack',      function() luaPack(value) end)
+local np = bench('native pack',   function() lens.pack(value) end)
+local lu = bench('Lua unpack',    function() luaUnpack(packed) end)
+local nu = bench('native unpack', function() lens.unpack(packed) end)
+print(string.format('speedup: pack x%.1f, unpack x%.1f', lp / np, lu / nu))
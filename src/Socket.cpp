@@ -27,11 +27,41 @@
   ==============================================================================
 */
 #include "lens/Socket.h"
+#include "lens/lens.h"
+#include "lens/msgpack.h"
+
+#include <sys/uio.h> // iovec
+#include <pthread.h>
+#include <poll.h>
+
+#ifdef __linux__
+#include <fcntl.h>        // splice
+#include <sys/sendfile.h>
+#elif __APPLE__ && __MACH__
+#include <sys/uio.h>      // sendfile
+#endif
+
+#include <map>
+#include <vector>
+
+// Do not raise SIGPIPE when the peer has closed the connection.
+#ifdef MSG_NOSIGNAL
+#define SEND_FLAGS MSG_NOSIGNAL
+#else
+#define SEND_FLAGS 0
+#endif
+
+// Drained receive buffers by size. Shared by all sockets in the process
+// (sockets can live in different lens.Worker threads). The pool is never
+// deleted so that sockets collected on exit can still release their buffer.
+typedef std::map<int, std::vector<char*> > BufferPool;
+static BufferPool *buffer_pool = NULL;
+static pthread_mutex_t buffer_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 /** Bind socket to a specific interface.
  * @return bound port
  */
-int lens::Socket::bind(const char *localhost, int port) {
+int lens::Socket::bind(const char *localhost, int port, int flags) {
   char port_str[10];
   snprintf(port_str, 10, "%i", port);
 
@@ -76,8 +106,25 @@ int lens::Socket::bind(const char *localhost, int port) {
     freeaddrinfo(res);
     throw dub::Exception("Could not create socket for %s:%i (%s).", local_host_.c_str(), port, strerror(errno));
   }
+  socket_family_ = res->ai_family;
   setNonBlocking();
 
+  try {
+    if (flags & ReuseAddr) {
+      setFlag(SO_REUSEADDR, "SO_REUSEADDR");
+    }
+    if (flags & ReusePort) {
+#ifdef SO_REUSEPORT
+      setFlag(SO_REUSEPORT, "SO_REUSEPORT");
+#else
+      throw dub::Exception("SO_REUSEPORT not supported on this platform.");
+#endif
+    }
+  } catch (...) {
+    freeaddrinfo(res);
+    throw;
+  }
+
   // bind to port
   if (::bind(socket_fd_, res->ai_addr, res->ai_addrlen)) {
     freeaddrinfo(res);
@@ -94,7 +141,12 @@ int lens::Socket::bind(const char *localhost, int port) {
   return local_port_;
 }
 
-bool lens::Socket::connect(const char *host, int port) {
+bool lens::Socket::connect(const char *host, int port, const char *address) {
+  if (socket_type_ == UDP) {
+    connectUDP(host, port, address);
+    return true;
+  }
+
   if (socket_fd_ != -1) {
     ::close(socket_fd_);
     socket_fd_ = -1;
@@ -103,39 +155,8 @@ bool lens::Socket::connect(const char *host, int port) {
   remote_host_ = host;
   remote_port_ = port;
 
-  if (socket_type_ == UDP) {
-    // store remote info but only connect on send
-    socket_fd_ = socket(AF_INET, SOCK_DGRAM, 0);
-
-    // bind any port
-    struct sockaddr_in addr;
-    
-    addr.sin_family = AF_INET;
-    addr.sin_addr.s_addr = htonl(INADDR_ANY);
-    addr.sin_port = htons(0);
-
-    if (::bind(socket_fd_, (struct sockaddr *) &addr, sizeof(addr))) {
-      throw dub::Exception("Could not bind local socket (%s)\n.", strerror(errno));
-    }
-    return true;
-  }
-
-  char port_str[10];
-  snprintf(port_str, 10, "%i", port);
-  struct addrinfo hints, *res;
-
-  memset(&hints, 0, sizeof(hints));
-
-  // we do not care if we get an IPv4 or IPv6 address
-  hints.ai_family = AF_UNSPEC;
-  // TCP
-  hints.ai_socktype = SOCK_STREAM;
-
-  int status;
-  if ( (status = getaddrinfo(host, port_str, &hints, &res)) ) {
-    throw dub::Exception("Could not getaddrinfo for %s:%i (%s).", host, port, gai_strerror(status));
-  }
-
+  struct addrinfo *res;
+  getAddrInfo(host, port, address, &res);
 
   // we use getaddrinfo to stay IPv4/IPv6 agnostic
   socket_fd_ = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
@@ -171,6 +192,68 @@ bool lens::Socket::connect(const char *host, int port) {
   return true;
 }
 
+void lens::Socket::connectUDP(const char *host, int port, const char *address) {
+  // Resolve once: the socket is connected so that send does not need the
+  // address (calling connect again resolves the host again).
+  struct addrinfo *res;
+  getAddrInfo(host, port, address, &res);
+
+  if (socket_fd_ != -1 && socket_family_ != res->ai_family) {
+    // Cannot reuse socket (IPv4 <-> IPv6).
+    ::close(socket_fd_);
+    socket_fd_ = -1;
+  }
+
+  if (socket_fd_ == -1) {
+    socket_fd_ = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (socket_fd_ == -1) {
+      freeaddrinfo(res);
+      throw dub::Exception("Could not create socket for %s:%i (%s).", host, port, strerror(errno));
+    }
+    socket_family_ = res->ai_family;
+    setNonBlocking();
+  }
+
+  // Connecting a UDP socket only sets the default destination (binds any
+  // local port if needed).
+  if (::connect(socket_fd_, res->ai_addr, res->ai_addrlen)) {
+    freeaddrinfo(res);
+    throw dub::Exception("Could not connect socket to %s:%i (%s).", host, port, strerror(errno));
+  }
+  freeaddrinfo(res);
+
+  remote_host_ = host;
+  remote_port_ = port;
+  local_port_  = get_port(socket_fd_);
+}
+
+void lens::Socket::getAddrInfo(const char *host, int port, const char *address, struct addrinfo **res) {
+  char port_str[10];
+  snprintf(port_str, 10, "%i", port);
+  struct addrinfo hints;
+
+  memset(&hints, 0, sizeof(hints));
+
+  // we do not care if we get an IPv4 or IPv6 address
+  hints.ai_family = AF_UNSPEC;
+  if (socket_type_ == TCP) {
+    hints.ai_socktype = SOCK_STREAM;
+  } else {
+    hints.ai_socktype = SOCK_DGRAM;
+  }
+  if (address) {
+    // Already resolved: parse only (never blocks).
+    hints.ai_flags = AI_NUMERICHOST | AI_NUMERICSERV;
+  } else {
+    address = host;
+  }
+
+  int status;
+  if ( (status = getaddrinfo(address, port_str, &hints, res)) ) {
+    throw dub::Exception("Could not getaddrinfo for %s:%i (%s).", host, port, gai_strerror(status));
+  }
+}
+
 void lens::Socket::connectFinish() {
   if (socket_fd_ == -1) {
     throw dub::Exception("Should only be called after 'connect' (no socket).");
@@ -220,51 +303,557 @@ LuaStackSize lens::Socket::accept(lua_State *L) {
   if (local_port_ == -1)
     throw dub::Exception("Accept called before bind.");
 
-  struct sockaddr sa;
-  memset(&sa, 0, sizeof(struct sockaddr));
+  throwAcceptError();
+
+  // return nil to indicate EAGAIN
+  return acceptOne(L) ? 1 : 0;
+}
+
+LuaStackSize lens::Socket::acceptMany(int max, lua_State *L) {
+  if (socket_type_ == lens::Socket::UDP) {
+    throw dub::Exception("not supported by UDP sockets.");
+  }
+
+  if (local_port_ == -1)
+    throw dub::Exception("Accept called before bind.");
+
+  throwAcceptError();
+
+  lua_newtable(L);
+  int list = lua_gettop(L);
+  int count = 0;
+  try {
+    while (count < max && acceptOne(L)) {
+      lua_rawseti(L, list, ++count);
+    }
+  } catch (std::exception &e) {
+    if (!count) throw;
+    // Do not drop the accepted connections: report on next call.
+    accept_error_ = e.what();
+  }
+  if (!count) {
+    // EAGAIN
+    return 0;
+  }
+  return 1;
+}
+
+bool lens::Socket::acceptOne(lua_State *L) {
+  struct sockaddr_storage sa;
   // length has to be in a variable
   socklen_t sa_len = sizeof(sa);
 
   int fd;
+  while (true) {
+#ifdef __linux__
+    fd = ::accept4(socket_fd_, (struct sockaddr *)&sa, &sa_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+    fd = ::accept(socket_fd_, (struct sockaddr *)&sa, &sa_len);
+#endif
+    // printf("[%p] accept(%i) --> %i\n", this, socket_fd_, fd);
+    if (fd != -1) break;
 
-  fd = ::accept(socket_fd_, &sa, &sa_len);
-  // printf("[%p] accept(%i) --> %i\n", this, socket_fd_, fd);
-  
-  if (fd == -1) {
-    if (errno == EAGAIN) {
-      // return nil to indicate EAGAIN
-      return 0;
+    switch(errno) {
+      case EAGAIN:
+#if EWOULDBLOCK != EAGAIN
+      case EWOULDBLOCK:
+#endif
+        return false;
+      case EINTR:
+      case ECONNABORTED:
+#ifdef EPROTO
+      case EPROTO:
+#endif
+        // Interrupted or connection reset by the peer before accept: try the
+        // next one.
+        sa_len = sizeof(sa);
+        break;
+      default:
+        throw dub::Exception("Error while accepting connection (%s).", strerror(errno));
     }
-    throw dub::Exception("Error while accepting connection (%s).", strerror(errno));
   }
 
-  // get remote name / port
-  int remote_port;
-  if (sa.sa_family == AF_INET) {
-    remote_port = ntohs(((struct sockaddr_in *)&sa)->sin_port);
-  } else {
-    remote_port = ntohs(((struct sockaddr_in6 *)&sa)->sin6_port);
-  }
+  // Numeric remote host: a reverse DNS lookup here would block the
+  // scheduler.
+  char remote_host[INET6_ADDRSTRLEN];
+  int remote_port = addressString(&sa, remote_host);
 
-  char remote_host[NI_MAXHOST];
+  pushNewSocket(L, socket_type_, fd, local_host_.c_str(), remote_host, remote_port);
+  return true;
+}
 
-  if (getnameinfo(&sa, sizeof(sa), remote_host, sizeof(remote_host), NULL, 0, 0)) {
-    throw dub::Exception("Could not get remote host name (%s).", strerror(errno));
+void lens::Socket::throwAcceptError() {
+  if (!accept_error_.empty()) {
+    std::string msg;
+    msg.swap(accept_error_);
+    throw dub::Exception("%s", msg.c_str());
   }
-
-  return pushNewSocket(L, socket_type_, fd, local_host_.c_str(), remote_host, remote_port);
 }
 
 /** Send raw bytes.
  * param: string to send.
  */
 int lens::Socket::send(lua_State *L) {
-  // <string>
+  int top = lua_gettop(L);
+  struct iovec iov[MAX_SEND_IOV];
+  int refs[MAX_SEND_IOV];
+  int count = 0;
+  for(int i = 2; i <= top; ++i) {
+    size_t size;
+    const char *data = luaL_checklstring(L, i, &size);
+    if (!size) continue;
+    iov[count].iov_base = (void*)data;
+    iov[count].iov_len  = size;
+    refs[count] = i;
+    if (++count == MAX_SEND_IOV) {
+      sendOrQueue(L, iov, refs, count);
+      count = 0;
+    }
+  }
+  if (count) {
+    sendOrQueue(L, iov, refs, count);
+  }
+  return out_size_;
+}
+
+LuaStackSize lens::Socket::recvFrame(lua_State *L) {
+  BufferLease lease(this);
+  const char *data;
+  int size = readFrame(&data);
+  if (size == -1) {
+    lua_pushnil(L);
+    lua_pushboolean(L, true);
+    // <nil>, eagain
+    return 2;
+  } else if (size < 0) {
+    // connection closed
+    return 0;
+  }
+  lua_pushlstring(L, data, size);
+  frameDone();
+  return 1;
+}
+
+LuaStackSize lens::Socket::recvValue(lua_State *L) {
+  BufferLease lease(this);
+  const char *data;
+  int size = readFrame(&data);
+  if (size == -1) {
+    lua_pushnil(L);
+    lua_pushboolean(L, true);
+    // <nil>, eagain
+    return 2;
+  } else if (size < 0) {
+    // connection closed
+    return 0;
+  }
+  // Decode in place.
+  size_t used;
+  try {
+    used = lens::msgpackUnpack(L, data, size);
+  } catch (...) {
+    frameDone();
+    throw;
+  }
+  frameDone();
+  if (used != (size_t)size) {
+    throw dub::Exception("Cannot unpack value (%i trailing bytes).", size - (int)used);
+  }
+  // The value can be nil.
+  lua_pushboolean(L, false);
+  // value, false
+  return 2;
+}
+
+int lens::Socket::readFrame(const char **data) {
+  if (socket_type_ != lens::Socket::TCP) {
+    throw dub::Exception("Frames only work with TCP sockets.");
+  }
+  if (frame_broken_) {
+    throw dub::Exception("Frame stream broken by a previous error.");
+  }
+
+  while (true) {
+    int available = buffer_length_ - buffer_i_;
+    if (frame_header_i_ < SIZEOF_SIZE) {
+      // Reading header.
+      while (available && frame_header_i_ < SIZEOF_SIZE) {
+        frame_header_[frame_header_i_++] = buffer_[buffer_i_++];
+        --available;
+      }
+      if (frame_header_i_ == SIZEOF_SIZE) {
+        unsigned int sz = ((unsigned int)frame_header_[0] << 24) |
+                          ((unsigned int)frame_header_[1] << 16) |
+                          ((unsigned int)frame_header_[2] << 8)  |
+                          (unsigned int)frame_header_[3];
+        if (sz > MAX_FRAME_SIZE) {
+          frameBroken();
+          throw dub::Exception("Frame too large (%u bytes).", sz);
+        }
+        frame_size_ = sz;
+        frame_i_    = 0;
+        if (available >= frame_size_) {
+          // Full frame in buffer: no copy.
+          *data = buffer_ + buffer_i_;
+          buffer_i_ += frame_size_;
+          return frame_size_;
+        }
+        frame_ = (char*)malloc(frame_size_);
+        if (!frame_) {
+          int sz = frame_size_;
+          frameBroken();
+          throw dub::Exception("Could not allocate frame (%i bytes).", sz);
+        }
+      }
+    }
+
+    if (frame_header_i_ == SIZEOF_SIZE) {
+      // Reading payload.
+      int sz = frame_size_ - frame_i_;
+      if (sz > available) sz = available;
+      memcpy(frame_ + frame_i_, buffer_ + buffer_i_, sz);
+      frame_i_  += sz;
+      buffer_i_ += sz;
+      if (frame_i_ == frame_size_) {
+        *data = frame_;
+        return frame_size_;
+      }
+    }
+
+    // Need more data. The rest of a large payload is received in place.
+    int len;
+    if (frame_ && frame_size_ - frame_i_ >= buffer_size_) {
+      len = ::recv(socket_fd_, frame_ + frame_i_, frame_size_ - frame_i_, 0);
+      if (len > 0) {
+        frame_i_ += len;
+        continue;
+      }
+    } else {
+      buffer_i_ = 0;
+      buffer_length_ = ::recv(socket_fd_, buffer_, buffer_size_, 0);
+      len = buffer_length_;
+      if (len < 0) buffer_length_ = 0;
+    }
+
+    if (len == 0) {
+      // connection closed
+      return -2;
+    } else if (len < 0) {
+      if (errno == EAGAIN) {
+        return -1;
+      } else {
+        throw dub::Exception("Could not receive (%s).", strerror(errno));
+      }
+    }
+  }
+}
+
+void lens::Socket::frameDone() {
+  if (frame_) {
+    free(frame_);
+    frame_ = NULL;
+  }
+  frame_header_i_ = 0;
+}
+
+void lens::Socket::frameBroken() {
+  frameDone();
+  frame_size_   = 0;
+  frame_i_      = 0;
+  frame_broken_ = true;
+}
+
+int lens::Socket::sendFrame(lua_State *L) {
   size_t size;
-  const char *data = luaL_checklstring(L, -1, &size);
-  // printf("send string (%lu bytes)\n", size);
-  // send raw bytes
-  return sendBytes(data, size);
+  const char *data = luaL_checklstring(L, 2, &size);
+  if (size > MAX_FRAME_SIZE) {
+    throw dub::Exception("Frame too large (%lu bytes).", (unsigned long)size);
+  }
+  unsigned char header[SIZEOF_SIZE] = {
+    (unsigned char)(size >> 24),
+    (unsigned char)(size >> 16),
+    (unsigned char)(size >> 8),
+    (unsigned char)size,
+  };
+
+  // Header and data in a single call.
+  struct iovec iov[2];
+  int refs[2] = {0, 2};
+  iov[0].iov_base = header;
+  iov[0].iov_len  = SIZEOF_SIZE;
+  iov[1].iov_base = (void*)data;
+  iov[1].iov_len  = size;
+  sendOrQueue(L, iov, refs, 2);
+  return out_size_;
+}
+
+int lens::Socket::sendValue(lua_State *L) {
+  luaL_checkany(L, 2);
+  // Reserve frame header.
+  std::string out(SIZEOF_SIZE, '\0');
+  lens::msgpackPack(L, 2, out);
+  size_t size = out.size() - SIZEOF_SIZE;
+  if (size > MAX_FRAME_SIZE) {
+    throw dub::Exception("Frame too large (%lu bytes).", (unsigned long)size);
+  }
+  out[0] = (char)(size >> 24);
+  out[1] = (char)(size >> 16);
+  out[2] = (char)(size >> 8);
+  out[3] = (char)size;
+
+  struct iovec iov;
+  int ref = 0;
+  iov.iov_base = (void*)out.data();
+  iov.iov_len  = out.size();
+  sendOrQueue(L, &iov, &ref, 1);
+  return out_size_;
+}
+
+int lens::Socket::flush() {
+  if (send_busy_) {
+    // The poller is sending the first chunk.
+    return out_size_;
+  }
+  while (!out_.empty()) {
+    if (socket_type_ == lens::Socket::UDP) {
+      // One datagram per chunk.
+      OutChunk &chunk = out_.front();
+      if (sendBytes(chunk.data, chunk.size) < 0) break;
+      popChunk();
+      continue;
+    }
+
+    struct iovec iov[MAX_SEND_IOV];
+    int count = 0;
+    for(std::deque<OutChunk>::iterator it = out_.begin();
+        it != out_.end() && count < MAX_SEND_IOV; ++it, ++count) {
+      iov[count].iov_base = (void*)it->data;
+      iov[count].iov_len  = it->size;
+    }
+    int sent = writeIov(iov, count);
+    if (sent < 0) break;
+    dropSent(sent);
+  }
+  return out_size_;
+}
+
+void lens::Socket::feed(lua_State *L) {
+  size_t len;
+  const char *data = luaL_checklstring(L, 2, &len);
+  if (len > (size_t)recvSpace()) {
+    throw dub::Exception("Cannot feed %i bytes (%i free in receive buffer).", (int)len, recvSpace());
+  }
+  if (!len) return;
+  int keep = buffer_length_ - buffer_i_;
+  acquireBuffer();
+  if (keep && buffer_i_) {
+    memmove(buffer_, buffer_ + buffer_i_, keep);
+  }
+  memcpy(buffer_ + keep, data, len);
+  buffer_i_      = 0;
+  buffer_length_ = keep + len;
+}
+
+LuaStackSize lens::Socket::queued(lua_State *L) {
+  if (send_busy_ || out_.empty() || socket_type_ != lens::Socket::TCP) {
+    return 0;
+  }
+  OutChunk &chunk = out_.front();
+  lua_pushlstring(L, chunk.data, chunk.size < MAX_QUEUED_SEND ? chunk.size : MAX_QUEUED_SEND);
+  send_busy_ = true;
+  return 1;
+}
+
+int lens::Socket::consume(int sent) {
+  send_busy_ = false;
+  if (sent > 0) dropSent(sent);
+  return out_size_;
+}
+
+void lens::Socket::dropSent(int sent) {
+  while (sent > 0 && !out_.empty()) {
+    OutChunk &chunk = out_.front();
+    if ((size_t)sent >= chunk.size) {
+      sent -= chunk.size;
+      popChunk();
+    } else {
+      // Partial write: move in the chunk.
+      chunk.data += sent;
+      chunk.size -= sent;
+      out_size_  -= sent;
+      sent = 0;
+    }
+  }
+}
+
+double lens::Socket::sendFile(int fd, double offset, double len) {
+  if (socket_type_ != lens::Socket::TCP) {
+    throw dub::Exception("sendFile only works with TCP sockets.");
+  }
+  // Keep order with queued data.
+  if (flush()) return -1;
+
+#ifdef __linux__
+  off_t off = (off_t)offset;
+  ssize_t sent = ::sendfile(socket_fd_, fd, &off, (size_t)len);
+#elif __APPLE__ && __MACH__
+  off_t sent = (off_t)len;
+  if (::sendfile(fd, socket_fd_, (off_t)offset, &sent, NULL, 0) < 0) {
+    // Partial write before EAGAIN.
+    if (sent > 0) return sent;
+    sent = -1;
+  }
+#else
+  // Fallback: copy through the receive buffer size.
+  char buffer[MAX_BUFF_SIZE];
+  size_t sz = len < MAX_BUFF_SIZE ? (size_t)len : MAX_BUFF_SIZE;
+  ssize_t sent = pread(fd, buffer, sz, (off_t)offset);
+  if (sent > 0) {
+    int ref = 0;
+    struct iovec iov;
+    iov.iov_base = buffer;
+    iov.iov_len  = sent;
+    sendOrQueue(NULL, &iov, &ref, 1);
+  }
+#endif
+  if (sent < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      return -1;
+    } else {
+      throw dub::Exception("Could not send file (%s).", strerror(errno));
+    }
+  }
+  return sent;
+}
+
+int lens::Socket::splice(int fd, int len) {
+  if (socket_type_ != lens::Socket::TCP) {
+    throw dub::Exception("splice only works with TCP sockets.");
+  }
+  // Keep order with queued data.
+  if (flush()) return -2;
+
+#ifdef __linux__
+  ssize_t sent = ::splice(fd, NULL, socket_fd_, NULL, len,
+                          SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+  if (sent < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      // Find out which end is not ready.
+      struct pollfd fds;
+      fds.fd      = socket_fd_;
+      fds.events  = POLLOUT;
+      fds.revents = 0;
+      if (::poll(&fds, 1, 0) == 1 && (fds.revents & POLLOUT)) {
+        // Pipe empty
+        return -1;
+      }
+      return -2;
+    } else {
+      throw dub::Exception("Could not splice (%s).", strerror(errno));
+    }
+  }
+  return sent;
+#else
+  // Copy through a local buffer and queue what cannot be sent.
+  char buffer[MAX_BUFF_SIZE];
+  ssize_t sz = ::read(fd, buffer, len < MAX_BUFF_SIZE ? len : MAX_BUFF_SIZE);
+  if (sz < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      return -1;
+    } else {
+      throw dub::Exception("Could not read pipe (%s).", strerror(errno));
+    }
+  }
+  if (sz > 0) {
+    int ref = 0;
+    struct iovec iov;
+    iov.iov_base = buffer;
+    iov.iov_len  = sz;
+    sendOrQueue(NULL, &iov, &ref, 1);
+  }
+  return sz;
+#endif
+}
+
+int lens::Socket::writeIov(struct iovec *iov, int count) {
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov    = iov;
+  msg.msg_iovlen = count;
+  int sent = ::sendmsg(socket_fd_, &msg, SEND_FLAGS);
+  if (sent < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      return -1;
+    } else {
+      throw dub::Exception("Could not send (%s).", strerror(errno));
+    }
+  }
+  return sent;
+}
+
+void lens::Socket::sendOrQueue(lua_State *L, struct iovec *iov, int *refs, int count) {
+  int i = 0;
+  if (out_.empty()) {
+    // Try to send right away.
+    if (socket_type_ == lens::Socket::UDP) {
+      for(; i < count; ++i) {
+        if (sendBytes((const char*)iov[i].iov_base, iov[i].iov_len) < 0) break;
+      }
+    } else {
+      int sent = writeIov(iov, count);
+      while (sent > 0 && i < count) {
+        if ((size_t)sent >= iov[i].iov_len) {
+          sent -= iov[i].iov_len;
+          ++i;
+        } else {
+          iov[i].iov_base = (char*)iov[i].iov_base + sent;
+          iov[i].iov_len -= sent;
+          sent = 0;
+        }
+      }
+    }
+  }
+
+  for(; i < count; ++i) {
+    if (iov[i].iov_len) {
+      queue(L, (const char*)iov[i].iov_base, iov[i].iov_len, refs[i]);
+    }
+  }
+}
+
+void lens::Socket::queue(lua_State *L, const char *data, size_t size, int ref_index) {
+  OutChunk chunk;
+  chunk.size  = size;
+  chunk.ref   = LUA_NOREF;
+  chunk.owned = NULL;
+  if (ref_index && dub_L) {
+    // Keep Lua string alive.
+    lua_pushvalue(L, ref_index);
+    chunk.ref  = luaL_ref(L, LUA_REGISTRYINDEX);
+    chunk.data = data;
+  } else {
+    chunk.owned = new std::string(data, size);
+    chunk.data  = chunk.owned->data();
+  }
+  out_.push_back(chunk);
+  out_size_ += size;
+}
+
+void lens::Socket::popChunk() {
+  OutChunk &chunk = out_.front();
+  out_size_ -= chunk.size;
+  if (chunk.owned) {
+    delete chunk.owned;
+  } else if (chunk.ref != LUA_NOREF) {
+    luaL_unref(dub_L, LUA_REGISTRYINDEX, chunk.ref);
+  }
+  out_.pop_front();
+}
+
+void lens::Socket::clearQueue() {
+  while (!out_.empty()) {
+    popChunk();
+  }
 }
 
 int lens::Socket::get_port(int fd) {
@@ -283,33 +872,99 @@ int lens::Socket::get_port(int fd) {
   }
 }
 
+void lens::Socket::setFlag(int option, const char *name) {
+  int on = 1;
+  if (setsockopt(socket_fd_, SOL_SOCKET, option, &on, sizeof(on))) {
+    throw dub::Exception("Could not set %s (%s).", name, strerror(errno));
+  }
+}
+
+// Take `count` buffers of `size` bytes from the pool (allocated if the pool
+// is empty).
+static void takeBuffers(int size, char **list, int count) {
+  int i = 0;
+  pthread_mutex_lock(&buffer_pool_mutex);
+  if (buffer_pool) {
+    std::vector<char*> &pool = (*buffer_pool)[size];
+    for(; i < count && !pool.empty(); ++i) {
+      list[i] = pool.back();
+      pool.pop_back();
+    }
+  }
+  pthread_mutex_unlock(&buffer_pool_mutex);
+
+  for(; i < count; ++i) {
+    list[i] = (char*)malloc(size);
+    if (!list[i]) {
+      for(int j = 0; j < i; ++j) free(list[j]);
+      throw dub::Exception("Could not allocate receive buffer (%i bytes).", size);
+    }
+  }
+}
+
+// Give buffers back to the pool (freed when the pool is full).
+static void giveBuffers(int size, char **list, int count) {
+  int i = 0;
+  pthread_mutex_lock(&buffer_pool_mutex);
+  if (!buffer_pool) buffer_pool = new BufferPool();
+  std::vector<char*> &pool = (*buffer_pool)[size];
+  for(; i < count && pool.size() < MAX_POOLED_BUFFERS; ++i) {
+    pool.push_back(list[i]);
+  }
+  pthread_mutex_unlock(&buffer_pool_mutex);
+
+  for(; i < count; ++i) {
+    free(list[i]);
+  }
+}
+
+void lens::Socket::acquireBuffer() {
+  if (buffer_) return;
+  takeBuffers(buffer_size_, &buffer_, 1);
+  buffer_i_      = 0;
+  buffer_length_ = 0;
+}
+
+void lens::Socket::releaseBuffer() {
+  if (!buffer_ || buffer_i_ < buffer_length_) return;
+  giveBuffers(buffer_size_, &buffer_, 1);
+  buffer_        = NULL;
+  buffer_i_      = 0;
+  buffer_length_ = 0;
+}
+
 int lens::Socket::recvLine(lua_State *L) {
+  size_t delim_len;
+  const char *delim = luaL_optlstring(L, 2, "\n", &delim_len);
+  if (delim_len != 1) {
+    throw dub::Exception("Line delimiter must be a single character (found '%s').", delim);
+  }
+  bool strip_cr = *delim == '\n' && !lua_toboolean(L, 3);
+
+  BufferLease lease(this);
   luaL_Buffer buffer;
   luaL_buffinit(L, &buffer);
 
   while (true) {
-    while (buffer_i_ < buffer_length_) {
-      char c = buffer_[buffer_i_++];
-      // printf("recvLine (%c)\n", c);
-      if (c == '\n') {
-        // found end of line
-        // push string
-        luaL_pushresult(&buffer);
-        return 1;
-      } else if (c != '\r') {
-        // ignore \r
-        // add char to lua buffer
-        luaL_putchar(&buffer, c);
-      }
+    if (lens::scanLine(&buffer, buffer_, &buffer_i_, buffer_length_, *delim, strip_cr)) {
+      // found end of line
+      // push string
+      luaL_pushresult(&buffer);
+      return 1;
     }
-      
+
+    // Keep a trailing '\r' until we know if it is followed by '\n'.
+    int keep = buffer_length_ - buffer_i_;
+    if (keep) buffer_[0] = buffer_[buffer_i_];
+    buffer_i_ = 0;
+
     // read more data
-    buffer_length_ = ::recv(socket_fd_, buffer_, MAX_BUFF_SIZE, 0);
+    buffer_length_ = ::recv(socket_fd_, buffer_ + keep, buffer_size_ - keep, 0);
     if (buffer_length_ == 0) {
       // connection closed
       return 0;
     } else if (buffer_length_ < 0) {
-      buffer_length_ = 0;
+      buffer_length_ = keep;
       if (errno == EAGAIN) {
         luaL_pushresult(&buffer);
         // indicate more to come
@@ -319,12 +974,13 @@ int lens::Socket::recvLine(lua_State *L) {
         throw dub::Exception("Could not receive (%s).", strerror(errno));
       }
     }
-    buffer_i_ = 0;
+    buffer_length_ += keep;
   }                             
   return 0;
 }
 
 int lens::Socket::recvBytes(int sz, lua_State *L) {
+  BufferLease lease(this);
   luaL_Buffer buffer;
 
   if (buffer_i_ < buffer_length_) {
@@ -347,7 +1003,7 @@ int lens::Socket::recvBytes(int sz, lua_State *L) {
 
     // we prefer not reading too much so that we might simplify read operation
     // with a single pushlstring
-    buffer_length_ = ::recv(socket_fd_, buffer_, sz < MAX_BUFF_SIZE ? sz : MAX_BUFF_SIZE, 0);
+    buffer_length_ = ::recv(socket_fd_, buffer_, sz < buffer_size_ ? sz : buffer_size_, 0);
     if (buffer_length_ == 0) {
       // connection closed
       return 0;
@@ -381,12 +1037,12 @@ LuaStackSize lens::Socket::recvMessage(lua_State *L) {
     throw dub::Exception("recvMessage only works with UDP sockets.");
   }
 
-  struct sockaddr_in fromAddr;
+  BufferLease lease(this);
+  struct sockaddr_storage fromAddr;
   socklen_t fromAddrLen = sizeof(fromAddr);
 
-  // TODO: store latest fromAddr.
   buffer_length_ = recvfrom(socket_fd_,
-                            buffer_, MAX_BUFF_SIZE, 0,
+                            buffer_, buffer_size_, 0,
                             (struct sockaddr *) &fromAddr, &fromAddrLen);
 
   if (buffer_length_ == 0) {
@@ -405,10 +1061,179 @@ LuaStackSize lens::Socket::recvMessage(lua_State *L) {
   } else {
     // found buffer_length_ bytes
     lua_pushlstring(L, buffer_, buffer_length_);
+    lua_pushnil(L);
+    pushAddress(L, &fromAddr);
 
     // mark buffer as empty
     buffer_i_ = buffer_length_;
-    return 1;
+    // data, nil, host, port
+    return 4;
+  }
+}
+
+// Holds the recvMessages slots during the call.
+struct BatchLease {
+  char *list[MAX_MSG_BATCH];
+  int count;
+  BatchLease(int cnt) : count(cnt) {
+    takeBuffers(MAX_DATAGRAM_SIZE, list, count);
+  }
+  ~BatchLease() {
+    giveBuffers(MAX_DATAGRAM_SIZE, list, count);
+  }
+};
+
+LuaStackSize lens::Socket::recvMessages(int max, lua_State *L) {
+  if (socket_type_ != lens::Socket::UDP) {
+    throw dub::Exception("recvMessages only works with UDP sockets.");
+  }
+  if (max < 1) max = 1;
+  if (max > MAX_MSG_BATCH) max = MAX_MSG_BATCH;
+
+  // Slots are shared with other sockets through the buffer pool instead of
+  // keeping max * MAX_DATAGRAM_SIZE bytes per socket.
+  BatchLease slots(max);
+  struct iovec iov[MAX_MSG_BATCH];
+  struct sockaddr_storage addrs[MAX_MSG_BATCH];
+  int lengths[MAX_MSG_BATCH];
+  int count;
+
+#ifdef __linux__
+  struct mmsghdr msgs[MAX_MSG_BATCH];
+  memset(msgs, 0, max * sizeof(struct mmsghdr));
+  for(int i = 0; i < max; ++i) {
+    iov[i].iov_base = slots.list[i];
+    iov[i].iov_len  = MAX_DATAGRAM_SIZE;
+    msgs[i].msg_hdr.msg_iov     = iov + i;
+    msgs[i].msg_hdr.msg_iovlen  = 1;
+    msgs[i].msg_hdr.msg_name    = addrs + i;
+    msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
   }
+  count = recvmmsg(socket_fd_, msgs, max, MSG_DONTWAIT, NULL);
+  for(int i = 0; i < count; ++i) {
+    lengths[i] = msgs[i].msg_len;
+  }
+#else
+  // One recvfrom per message.
+  for(count = 0; count < max; ++count) {
+    iov[count].iov_base = slots.list[count];
+    socklen_t len = sizeof(struct sockaddr_storage);
+    int sz = recvfrom(socket_fd_, iov[count].iov_base, MAX_DATAGRAM_SIZE,
+                      MSG_DONTWAIT, (struct sockaddr *)(addrs + count), &len);
+    if (sz < 0) {
+      if (count == 0) count = -1;
+      break;
+    }
+    lengths[count] = sz;
+  }
+#endif
+
+  if (count < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      lua_pushnil(L);
+      lua_pushboolean(L, true);
+      // <nil>, eagain
+      return 2;
+    } else {
+      throw dub::Exception("Could not receive (%s).", strerror(errno));
+    }
+  }
+
+  lua_createtable(L, count, 0);
+  int messages = lua_gettop(L);
+  lua_createtable(L, count, 0);
+  int hosts = lua_gettop(L);
+  lua_createtable(L, count, 0);
+  int ports = lua_gettop(L);
+  for(int i = 0; i < count; ++i) {
+    lua_pushlstring(L, (const char*)iov[i].iov_base, lengths[i]);
+    lua_rawseti(L, messages, i + 1);
+    pushAddress(L, addrs + i);
+    // <host> <port>
+    lua_rawseti(L, ports, i + 1);
+    lua_rawseti(L, hosts, i + 1);
+  }
+  // messages, hosts, ports
+  return 3;
+}
+
+int lens::Socket::sendMessages(lua_State *L) {
+  if (socket_type_ != lens::Socket::UDP) {
+    throw dub::Exception("sendMessages only works with UDP sockets.");
+  }
+  luaL_checktype(L, 2, LUA_TTABLE);
+  int first = lua_isnumber(L, 3) ? lua_tointeger(L, 3) : 1;
+
+  struct iovec iov[MAX_MSG_BATCH];
+  int total = 0;
+  while (true) {
+    // Collect next batch (strings stay alive in the list).
+    int count = 0;
+    for(; count < MAX_MSG_BATCH; ++count) {
+      lua_rawgeti(L, 2, first + total + count);
+      if (lua_isnil(L, -1)) {
+        lua_pop(L, 1);
+        break;
+      }
+      size_t len;
+      iov[count].iov_base = (void*)luaL_checklstring(L, -1, &len);
+      iov[count].iov_len  = len;
+      lua_pop(L, 1);
+    }
+    if (!count) return total;
+
+    int sent;
+#ifdef __linux__
+    struct mmsghdr msgs[MAX_MSG_BATCH];
+    memset(msgs, 0, count * sizeof(struct mmsghdr));
+    for(int i = 0; i < count; ++i) {
+      msgs[i].msg_hdr.msg_iov    = iov + i;
+      msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    sent = sendmmsg(socket_fd_, msgs, count, 0);
+#else
+    for(sent = 0; sent < count; ++sent) {
+      if (::send(socket_fd_, iov[sent].iov_base, iov[sent].iov_len, 0) < 0) {
+        if (sent == 0) sent = -1;
+        break;
+      }
+    }
+#endif
+    if (sent < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return total;
+      } else if (errno == ECONNREFUSED) {
+        // ICMP port unreachable from a previous datagram. Nothing was sent
+        // and the kernel cleared the error: retry the batch.
+        continue;
+      } else {
+        throw dub::Exception("Could not send messages (%s).", strerror(errno));
+      }
+    }
+    total += sent;
+    if (sent < count) {
+      // Partial batch (EAGAIN): let caller wait.
+      return total;
+    }
+  }
+}
+
+int lens::Socket::addressString(struct sockaddr_storage *addr, char *host) {
+  if (addr->ss_family == AF_INET6) {
+    struct sockaddr_in6 *a = (struct sockaddr_in6 *)addr;
+    inet_ntop(AF_INET6, &a->sin6_addr, host, INET6_ADDRSTRLEN);
+    return ntohs(a->sin6_port);
+  } else {
+    struct sockaddr_in *a = (struct sockaddr_in *)addr;
+    inet_ntop(AF_INET, &a->sin_addr, host, INET6_ADDRSTRLEN);
+    return ntohs(a->sin_port);
+  }
+}
+
+void lens::Socket::pushAddress(lua_State *L, struct sockaddr_storage *addr) {
+  char host[INET6_ADDRSTRLEN];
+  int port = addressString(addr, host);
+  lua_pushstring(L, host);
+  lua_pushnumber(L, port);
 }
 
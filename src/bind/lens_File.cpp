@@ -12,7 +12,7 @@
 using namespace lens;
 
 /** lens::File::File(const char *path, Mode mode)
- * include/lens/File.h:98
+ * include/lens/File.h:177
  */
 static int File_File(lua_State *L) {
   try {
@@ -30,7 +30,7 @@ static int File_File(lua_State *L) {
 }
 
 /** virtual lens::File::~File()
- * include/lens/File.h:112
+ * include/lens/File.h:200
  */
 static int File__File(lua_State *L) {
   try {
@@ -50,7 +50,7 @@ static int File__File(lua_State *L) {
 }
 
 /** int lens::File::fd()
- * include/lens/File.h:116
+ * include/lens/File.h:205
  */
 static int File_fd(lua_State *L) {
   try {
@@ -66,7 +66,7 @@ static int File_fd(lua_State *L) {
 }
 
 /** void lens::File::close()
- * include/lens/File.h:120
+ * include/lens/File.h:209
  */
 static int File_close(lua_State *L) {
   try {
@@ -82,7 +82,7 @@ static int File_close(lua_State *L) {
 }
 
 /** LuaStackSize lens::File::read(size_t sz, lua_State *L)
- * include/lens/File.h:129
+ * include/lens/File.h:231
  */
 static int File_read(lua_State *L) {
   try {
@@ -98,7 +98,7 @@ static int File_read(lua_State *L) {
 }
 
 /** LuaStackSize lens::File::readLine(lua_State *L)
- * include/lens/File.h:132
+ * include/lens/File.h:235
  */
 static int File_readLine(lua_State *L) {
   try {
@@ -113,7 +113,7 @@ static int File_readLine(lua_State *L) {
 }
 
 /** LuaStackSize lens::File::readAll(lua_State *L)
- * include/lens/File.h:135
+ * include/lens/File.h:240
  */
 static int File_readAll(lua_State *L) {
   try {
@@ -128,7 +128,7 @@ static int File_readAll(lua_State *L) {
 }
 
 /** LuaStackSize lens::File::write(lua_State *L)
- * include/lens/File.h:138
+ * include/lens/File.h:244
  */
 static int File_write(lua_State *L) {
   try {
@@ -142,6 +142,254 @@ static int File_write(lua_State *L) {
   return dub::error(L);
 }
 
+/** LuaStackSize lens::File::readAt(double offset, lua_State *L)
+ * include/lens/File.h:250
+ */
+static int File_readAt(lua_State *L) {
+  try {
+    File *self = *((File **)dub::checksdata(L, 1, "lens.File"));
+    double offset = dub::checknumber(L, 2);
+    return self->readAt(offset, L);
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "readAt: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "readAt: Unknown exception");
+  }
+  return dub::error(L);
+}
+
+/** LuaStackSize lens::File::writeAt(double offset, lua_State *L)
+ * include/lens/File.h:255
+ */
+static int File_writeAt(lua_State *L) {
+  try {
+    File *self = *((File **)dub::checksdata(L, 1, "lens.File"));
+    double offset = dub::checknumber(L, 2);
+    return self->writeAt(offset, L);
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "writeAt: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "writeAt: Unknown exception");
+  }
+  return dub::error(L);
+}
+
+/** void lens::File::setWriteBuffer(double size)
+ * include/lens/File.h:258
+ */
+static int File_setWriteBuffer(lua_State *L) {
+  try {
+    File *self = *((File **)dub::checksdata(L, 1, "lens.File"));
+    double size = dub::checknumber(L, 2);
+    self->setWriteBuffer(size);
+    return 0;
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "setWriteBuffer: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "setWriteBuffer: Unknown exception");
+  }
+  return dub::error(L);
+}
+
+/** int lens::File::flush()
+ * include/lens/File.h:264
+ */
+static int File_flush(lua_State *L) {
+  try {
+    File *self = *((File **)dub::checksdata(L, 1, "lens.File"));
+    lua_pushnumber(L, self->flush());
+    return 1;
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "flush: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "flush: Unknown exception");
+  }
+  return dub::error(L);
+}
+
+/** double lens::File::buffered()
+ * include/lens/File.h:267
+ */
+static int File_buffered(lua_State *L) {
+  try {
+    File *self = *((File **)dub::checksdata(L, 1, "lens.File"));
+    lua_pushnumber(L, self->buffered());
+    return 1;
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "buffered: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "buffered: Unknown exception");
+  }
+  return dub::error(L);
+}
+
+/** LuaStackSize lens::File::slice(double offset, double len, lua_State *L)
+ * include/lens/File.h:273
+ */
+static int File_slice(lua_State *L) {
+  try {
+    File *self = *((File **)dub::checksdata(L, 1, "lens.File"));
+    double offset = dub::checknumber(L, 2);
+    double len = dub::checknumber(L, 3);
+    return self->slice(offset, len, L);
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "slice: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "slice: Unknown exception");
+  }
+  return dub::error(L);
+}
+
+/** void lens::File::advise(int advice, double offset=0, double len=0)
+ * include/lens/File.h:277
+ */
+static int File_advise(lua_State *L) {
+  try {
+    File *self = *((File **)dub::checksdata(L, 1, "lens.File"));
+    int top__ = lua_gettop(L);
+    if (top__ >= 4) {
+      int advice = dub::checkint(L, 2);
+      double offset = dub::checknumber(L, 3);
+      double len = dub::checknumber(L, 4);
+      self->advise(advice, offset, len);
+      return 0;
+    } else if (top__ >= 3) {
+      int advice = dub::checkint(L, 2);
+      double offset = dub::checknumber(L, 3);
+      self->advise(advice, offset);
+      return 0;
+    } else {
+      int advice = dub::checkint(L, 2);
+      self->advise(advice);
+      return 0;
+    }
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "advise: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "advise: Unknown exception");
+  }
+  return dub::error(L);
+}
+
+/** double lens::File::size()
+ * include/lens/File.h:280
+ */
+static int File_size(lua_State *L) {
+  try {
+    File *self = *((File **)dub::checksdata(L, 1, "lens.File"));
+    lua_pushnumber(L, self->size());
+    return 1;
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "size: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "size: Unknown exception");
+  }
+  return dub::error(L);
+}
+
+
+/** void lens::File::startRead(double sz)
+ * include/lens/File.h:287
+ */
+static int File_startRead(lua_State *L) {
+  try {
+    File *self = *((File **)dub::checksdata(L, 1, "lens.File"));
+    double sz = dub::checknumber(L, 2);
+    self->startRead(sz);
+    return 0;
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "startRead: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "startRead: Unknown exception");
+  }
+  return dub::error(L);
+}
+
+/** void lens::File::startWrite(lua_State *L)
+ * include/lens/File.h:290
+ */
+static int File_startWrite(lua_State *L) {
+  try {
+    File *self = *((File **)dub::checksdata(L, 1, "lens.File"));
+    self->startWrite(L);
+    return 0;
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "startWrite: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "startWrite: Unknown exception");
+  }
+  return dub::error(L);
+}
+
+/** void lens::File::startSync(bool data_only=false)
+ * include/lens/File.h:294
+ */
+static int File_startSync(lua_State *L) {
+  try {
+    File *self = *((File **)dub::checksdata(L, 1, "lens.File"));
+    int top__ = lua_gettop(L);
+    if (top__ >= 2) {
+      bool data_only = dub::checkboolean(L, 2);
+      self->startSync(data_only);
+      return 0;
+    } else {
+      self->startSync();
+      return 0;
+    }
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "startSync: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "startSync: Unknown exception");
+  }
+  return dub::error(L);
+}
+
+/** int lens::File::ioFd()
+ * include/lens/File.h:297
+ */
+static int File_ioFd(lua_State *L) {
+  try {
+    File *self = *((File **)dub::checksdata(L, 1, "lens.File"));
+    lua_pushnumber(L, self->ioFd());
+    return 1;
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "ioFd: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "ioFd: Unknown exception");
+  }
+  return dub::error(L);
+}
+
+/** bool lens::File::ioDone()
+ * include/lens/File.h:302
+ */
+static int File_ioDone(lua_State *L) {
+  try {
+    File *self = *((File **)dub::checksdata(L, 1, "lens.File"));
+    lua_pushboolean(L, self->ioDone());
+    return 1;
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "ioDone: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "ioDone: Unknown exception");
+  }
+  return dub::error(L);
+}
+
+/** LuaStackSize lens::File::ioResult(lua_State *L)
+ * include/lens/File.h:307
+ */
+static int File_ioResult(lua_State *L) {
+  try {
+    File *self = *((File **)dub::checksdata(L, 1, "lens.File"));
+    return self->ioResult(L);
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "ioResult: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "ioResult: Unknown exception");
+  }
+  return dub::error(L);
+}
 
 
 // --=============================================== __tostring
@@ -163,6 +411,20 @@ static const struct luaL_Reg File_member_methods[] = {
   { "readLine"     , File_readLine        },
   { "readAll"      , File_readAll         },
   { "write"        , File_write           },
+  { "readAt"       , File_readAt          },
+  { "writeAt"      , File_writeAt         },
+  { "setWriteBuffer", File_setWriteBuffer  },
+  { "flush"        , File_flush           },
+  { "buffered"     , File_buffered        },
+  { "slice"        , File_slice           },
+  { "advise"       , File_advise          },
+  { "size"         , File_size            },
+  { "startRead"    , File_startRead       },
+  { "startWrite"   , File_startWrite      },
+  { "startSync"    , File_startSync       },
+  { "ioFd"         , File_ioFd            },
+  { "ioDone"       , File_ioDone          },
+  { "ioResult"     , File_ioResult        },
   { "__tostring"   , File___tostring      },
   { "deleted"      , dub::isDeleted       },
   { NULL, NULL},
@@ -174,7 +436,14 @@ static const struct dub::const_Reg File_const[] = {
   { "Read"         , File::Read           },
   { "Write"        , File::Write          },
   { "Append"       , File::Append         },
+  { "ReadWrite"    , File::ReadWrite      },
   { "Events"       , File::Events         },
+  { "Mmap"         , File::Mmap           },
+  { "Normal"       , File::Normal         },
+  { "Sequential"   , File::Sequential     },
+  { "Random"       , File::Random         },
+  { "WillNeed"     , File::WillNeed       },
+  { "DontNeed"     , File::DontNeed       },
   { "DeleteEvent"  , File::DeleteEvent    },
   { "WriteEvent"   , File::WriteEvent     },
   { "ExtendEvent"  , File::ExtendEvent    },
@@ -0,0 +1,149 @@
+/**
+ *
+ * MACHINE GENERATED FILE. DO NOT EDIT.
+ *
+ * Bindings for class Mailbox
+ *
+ * This file has been generated by dub 2.2.1.
+ */
+#include "dub/dub.h"
+#include "lens/Mailbox.h"
+
+using namespace lens;
+
+/** lens::Mailbox::Mailbox()
+ * include/lens/Mailbox.h:81
+ */
+static int Mailbox_Mailbox(lua_State *L) {
+  try {
+    Mailbox *retval__ = new Mailbox();
+    dub::pushudata(L, retval__, "lens.Mailbox", true);
+    return 1;
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "new: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "new: Unknown exception");
+  }
+  return dub::error(L);
+}
+
+/** lens::Mailbox::~Mailbox()
+ * include/lens/Mailbox.h:83
+ */
+static int Mailbox__Mailbox(lua_State *L) {
+  try {
+    DubUserdata *userdata = ((DubUserdata*)dub::checksdata_d(L, 1, "lens.Mailbox"));
+    if (userdata->gc) {
+      Mailbox *self = (Mailbox *)userdata->ptr;
+      delete self;
+    }
+    userdata->gc = false;
+    return 0;
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "__gc: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "__gc: Unknown exception");
+  }
+  return dub::error(L);
+}
+
+/** void lens::Mailbox::post(lua_State *L)
+ * include/lens/Mailbox.h:88
+ */
+static int Mailbox_post(lua_State *L) {
+  try {
+    Mailbox *self = *((Mailbox **)dub::checksdata(L, 1, "lens.Mailbox"));
+    self->post(L);
+    return 0;
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "post: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "post: Unknown exception");
+  }
+  return dub::error(L);
+}
+
+/** LuaStackSize lens::Mailbox::recv(lua_State *L)
+ * include/lens/Mailbox.h:93
+ */
+static int Mailbox_recv(lua_State *L) {
+  try {
+    Mailbox *self = *((Mailbox **)dub::checksdata(L, 1, "lens.Mailbox"));
+    return self->recv(L);
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "recv: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "recv: Unknown exception");
+  }
+  return dub::error(L);
+}
+
+/** int lens::Mailbox::pending()
+ * include/lens/Mailbox.h:97
+ */
+static int Mailbox_pending(lua_State *L) {
+  try {
+    Mailbox *self = *((Mailbox **)dub::checksdata(L, 1, "lens.Mailbox"));
+    lua_pushnumber(L, self->pending());
+    return 1;
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "pending: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "pending: Unknown exception");
+  }
+  return dub::error(L);
+}
+
+/** int lens::Mailbox::fd()
+ * include/lens/Mailbox.h:103
+ */
+static int Mailbox_fd(lua_State *L) {
+  try {
+    Mailbox *self = *((Mailbox **)dub::checksdata(L, 1, "lens.Mailbox"));
+    lua_pushnumber(L, self->fd());
+    return 1;
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "fd: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "fd: Unknown exception");
+  }
+  return dub::error(L);
+}
+
+
+
+// --=============================================== __tostring
+static int Mailbox___tostring(lua_State *L) {
+  Mailbox *self = *((Mailbox **)dub::checksdata_n(L, 1, "lens.Mailbox"));
+  lua_pushfstring(L, "lens.Mailbox: %p (%i)", self, self-> pending());
+  
+  return 1;
+}
+
+// --=============================================== METHODS
+
+static const struct luaL_Reg Mailbox_member_methods[] = {
+  { "new"          , Mailbox_Mailbox      },
+  { "__gc"         , Mailbox__Mailbox     },
+  { "post"         , Mailbox_post         },
+  { "recv"         , Mailbox_recv         },
+  { "pending"      , Mailbox_pending      },
+  { "fd"           , Mailbox_fd           },
+  { "__tostring"   , Mailbox___tostring   },
+  { "deleted"      , dub::isDeleted       },
+  { NULL, NULL},
+};
+
+extern "C" int luaopen_lens_Mailbox(lua_State *L)
+{
+  // Create the metatable which will contain all the member methods
+  luaL_newmetatable(L, "lens.Mailbox");
+  // <mt>
+
+  // register member methods
+  dub::fregister(L, Mailbox_member_methods);
+  // setup meta-table
+  dub::setup(L, "lens.Mailbox");
+  // <mt>
+  return 1;
+}
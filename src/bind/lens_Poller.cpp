@@ -11,13 +11,19 @@
 
 using namespace lens;
 
-/** lens::Poller::Poller(int reserve=8)
- * include/lens/Poller.h:145
+/** lens::Poller::Poller(int reserve=8, int backend=Default)
+ * include/lens/Poller.h:289
  */
 static int Poller_Poller(lua_State *L) {
   try {
     int top__ = lua_gettop(L);
-    if (top__ >= 1) {
+    if (top__ >= 2) {
+      int reserve = dub::checkint(L, 1);
+      int backend = dub::checkint(L, 2);
+      Poller *retval__ = new Poller(reserve, backend);
+      retval__->dub_pushobject(L, retval__, "lens.Poller", true);
+      return 1;
+    } else if (top__ >= 1) {
       int reserve = dub::checkint(L, 1);
       Poller *retval__ = new Poller(reserve);
       retval__->dub_pushobject(L, retval__, "lens.Poller", true);
@@ -36,7 +42,7 @@ static int Poller_Poller(lua_State *L) {
 }
 
 /** lens::Poller::~Poller()
- * include/lens/Poller.h:147
+ * include/lens/Poller.h:291
  */
 static int Poller__Poller(lua_State *L) {
   try {
@@ -56,7 +62,7 @@ static int Poller__Poller(lua_State *L) {
 }
 
 /** bool lens::Poller::poll(double wake_at)
- * include/lens/Poller.h:157
+ * include/lens/Poller.h:317
  */
 static int Poller_poll(lua_State *L) {
   try {
@@ -73,7 +79,7 @@ static int Poller_poll(lua_State *L) {
 }
 
 /** void lens::Poller::runGUI(double wake_at, lua_State *L)
- * include/lens/Poller.h:219
+ * include/lens/Poller.h:425
  */
 static int Poller_runGUI(lua_State *L) {
   try {
@@ -90,7 +96,7 @@ static int Poller_runGUI(lua_State *L) {
 }
 
 /** LuaStackSize lens::Poller::events(lua_State *L)
- * include/lens/Poller.h:260
+ * include/lens/Poller.h:466
  */
 static int Poller_events(lua_State *L) {
   try {
@@ -104,8 +110,39 @@ static int Poller_events(lua_State *L) {
   return dub::error(L);
 }
 
+/** LuaStackSize lens::Poller::fillEvents(lua_State *L)
+ * include/lens/Poller.h:487
+ */
+static int Poller_fillEvents(lua_State *L) {
+  try {
+    Poller *self = *((Poller **)dub::checksdata(L, 1, "lens.Poller"));
+    return self->fillEvents(L);
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "fillEvents: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "fillEvents: Unknown exception");
+  }
+  return dub::error(L);
+}
+
+/** int lens::Poller::backend()
+ * include/lens/Poller.h:641
+ */
+static int Poller_backend(lua_State *L) {
+  try {
+    Poller *self = *((Poller **)dub::checksdata(L, 1, "lens.Poller"));
+    lua_pushnumber(L, self->backend());
+    return 1;
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "backend: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "backend: Unknown exception");
+  }
+  return dub::error(L);
+}
+
 /** int lens::Poller::fflags(int idx)
- * include/lens/Poller.h:289
+ * include/lens/Poller.h:514
  */
 static int Poller_fflags(lua_State *L) {
   try {
@@ -122,7 +159,7 @@ static int Poller_fflags(lua_State *L) {
 }
 
 /** int lens::Poller::add(int fd, int filter, int fflags=0)
- * include/lens/Poller.h:338
+ * include/lens/Poller.h:563
  */
 static int Poller_add(lua_State *L) {
   try {
@@ -149,7 +186,7 @@ static int Poller_add(lua_State *L) {
 }
 
 /** void lens::Poller::modify(int idx, int filter, lua_State *L)
- * include/lens/Poller.h:345
+ * include/lens/Poller.h:570
  */
 static int Poller_modify(lua_State *L) {
   try {
@@ -167,7 +204,7 @@ static int Poller_modify(lua_State *L) {
 }
 
 /** void lens::Poller::remove(int idx)
- * include/lens/Poller.h:402
+ * include/lens/Poller.h:586
  */
 static int Poller_remove(lua_State *L) {
   try {
@@ -184,7 +221,7 @@ static int Poller_remove(lua_State *L) {
 }
 
 /** int lens::Poller::count()
- * include/lens/Poller.h:435
+ * include/lens/Poller.h:635
  */
 static int Poller_count(lua_State *L) {
   try {
@@ -200,7 +237,7 @@ static int Poller_count(lua_State *L) {
 }
 
 /** LuaStackSize lens::Poller::idxToPos(int idx, lua_State *L)
- * include/lens/Poller.h:442
+ * include/lens/Poller.h:657
  */
 static int Poller_idxToPos(lua_State *L) {
   try {
@@ -216,7 +253,7 @@ static int Poller_idxToPos(lua_State *L) {
 }
 
 /** LuaStackSize lens::Poller::posToIdx(int pos, lua_State *L)
- * include/lens/Poller.h:451
+ * include/lens/Poller.h:666
  */
 static int Poller_posToIdx(lua_State *L) {
   try {
@@ -232,7 +269,7 @@ static int Poller_posToIdx(lua_State *L) {
 }
 
 /** LuaStackSize lens::Poller::posToFd(int pos, lua_State *L)
- * include/lens/Poller.h:460
+ * include/lens/Poller.h:675
  */
 static int Poller_posToFd(lua_State *L) {
   try {
@@ -248,7 +285,7 @@ static int Poller_posToFd(lua_State *L) {
 }
 
 /** LuaStackSize lens::Poller::posToEvent(int pos, lua_State *L)
- * include/lens/Poller.h:473
+ * include/lens/Poller.h:688
  */
 static int Poller_posToEvent(lua_State *L) {
   try {
@@ -264,7 +301,7 @@ static int Poller_posToEvent(lua_State *L) {
 }
 
 /** static LuaStackSize lens::Poller::eventMap(int fflags, lua_State *L)
- * include/lens/Poller.h:300
+ * include/lens/Poller.h:525
  */
 static int Poller_eventMap(lua_State *L) {
   try {
@@ -296,6 +333,8 @@ static const struct luaL_Reg Poller_member_methods[] = {
   { "poll"         , Poller_poll          },
   { "runGUI"       , Poller_runGUI        },
   { "events"       , Poller_events        },
+  { "fillEvents"   , Poller_fillEvents    },
+  { "backend"      , Poller_backend       },
   { "fflags"       , Poller_fflags        },
   { "add"          , Poller_add           },
   { "modify"       , Poller_modify        },
@@ -316,6 +355,15 @@ static const struct dub::const_Reg Poller_const[] = {
   { "Read"         , Poller::Read         },
   { "Write"        , Poller::Write        },
   { "VNode"        , Poller::VNode        },
+  { "Edge"         , Poller::Edge         },
+  { "OneShot"      , Poller::OneShot      },
+  { "Hup"          , Poller::Hup          },
+  { "Error"        , Poller::Error        },
+  { "Default"      , Poller::Default      },
+  { "KQueue"       , Poller::KQueue       },
+  { "EPoll"        , Poller::EPoll        },
+  { "URing"        , Poller::URing        },
+  { "Poll"         , Poller::Poll         },
   { NULL, 0},
 };
 
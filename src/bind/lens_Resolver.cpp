@@ -0,0 +1,219 @@
+/**
+ *
+ * MACHINE GENERATED FILE. DO NOT EDIT.
+ *
+ * Bindings for class Resolver
+ *
+ * This file has been generated by dub 2.2.1.
+ */
+#include "dub/dub.h"
+#include "lens/Resolver.h"
+
+using namespace lens;
+
+/** lens::Resolver::~Resolver()
+ * include/lens/Resolver.h:71
+ */
+static int Resolver__Resolver(lua_State *L) {
+  try {
+    DubUserdata *userdata = ((DubUserdata*)dub::checksdata_d(L, 1, "lens.Resolver"));
+    if (userdata->gc) {
+      Resolver *self = (Resolver *)userdata->ptr;
+      delete self;
+    }
+    userdata->gc = false;
+    return 0;
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "__gc: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "__gc: Unknown exception");
+  }
+  return dub::error(L);
+}
+
+/** static Resolver* lens::Resolver::reverse(const char *host)
+ * include/lens/Resolver.h:75
+ */
+static int Resolver_reverse(lua_State *L) {
+  try {
+    const char *host = dub::checkstring(L, 1);
+    Resolver *retval__ = Resolver::reverse(host);
+    if (!retval__) return 0;
+    dub::pushudata(L, retval__, "lens.Resolver", true);
+    return 1;
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "reverse: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "reverse: Unknown exception");
+  }
+  return dub::error(L);
+}
+
+/** static Resolver* lens::Resolver::resolve(const char *host)
+ * include/lens/Resolver.h:80
+ */
+static int Resolver_resolve(lua_State *L) {
+  try {
+    const char *host = dub::checkstring(L, 1);
+    Resolver *retval__ = Resolver::resolve(host);
+    if (!retval__) return 0;
+    dub::pushudata(L, retval__, "lens.Resolver", true);
+    return 1;
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "resolve: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "resolve: Unknown exception");
+  }
+  return dub::error(L);
+}
+
+/** static LuaStackSize lens::Resolver::cached(const char *host, lua_State *L)
+ * include/lens/Resolver.h:85
+ */
+static int Resolver_cached(lua_State *L) {
+  try {
+    const char *host = dub::checkstring(L, 1);
+    return Resolver::cached(host, L);
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "cached: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "cached: Unknown exception");
+  }
+  return dub::error(L);
+}
+
+/** static void lens::Resolver::setTTL(double ttl)
+ * include/lens/Resolver.h:90
+ */
+static int Resolver_setTTL(lua_State *L) {
+  try {
+    double ttl = dub::checknumber(L, 1);
+    Resolver::setTTL(ttl);
+    return 0;
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "setTTL: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "setTTL: Unknown exception");
+  }
+  return dub::error(L);
+}
+
+/** static double lens::Resolver::ttl()
+ * include/lens/Resolver.h:92
+ */
+static int Resolver_ttl(lua_State *L) {
+  try {
+    lua_pushnumber(L, Resolver::ttl());
+    return 1;
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "ttl: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "ttl: Unknown exception");
+  }
+  return dub::error(L);
+}
+
+/** int lens::Resolver::fd()
+ * include/lens/Resolver.h:96
+ */
+static int Resolver_fd(lua_State *L) {
+  try {
+    Resolver *self = *((Resolver **)dub::checksdata(L, 1, "lens.Resolver"));
+    lua_pushnumber(L, self->fd());
+    return 1;
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "fd: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "fd: Unknown exception");
+  }
+  return dub::error(L);
+}
+
+/** bool lens::Resolver::done()
+ * include/lens/Resolver.h:100
+ */
+static int Resolver_done(lua_State *L) {
+  try {
+    Resolver *self = *((Resolver **)dub::checksdata(L, 1, "lens.Resolver"));
+    lua_pushboolean(L, self->done());
+    return 1;
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "done: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "done: Unknown exception");
+  }
+  return dub::error(L);
+}
+
+/** LuaStackSize lens::Resolver::result(lua_State *L)
+ * include/lens/Resolver.h:107
+ */
+static int Resolver_result(lua_State *L) {
+  try {
+    Resolver *self = *((Resolver **)dub::checksdata(L, 1, "lens.Resolver"));
+    return self->result(L);
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "result: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "result: Unknown exception");
+  }
+  return dub::error(L);
+}
+
+/** const char* lens::Resolver::host()
+ * include/lens/Resolver.h:109
+ */
+static int Resolver_host(lua_State *L) {
+  try {
+    Resolver *self = *((Resolver **)dub::checksdata(L, 1, "lens.Resolver"));
+    lua_pushstring(L, self->host());
+    return 1;
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "host: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "host: Unknown exception");
+  }
+  return dub::error(L);
+}
+
+
+
+// --=============================================== __tostring
+static int Resolver___tostring(lua_State *L) {
+  Resolver *self = *((Resolver **)dub::checksdata_n(L, 1, "lens.Resolver"));
+  lua_pushfstring(L, "lens.Resolver: %p (%s)", self, self-> host());
+  
+  return 1;
+}
+
+// --=============================================== METHODS
+
+static const struct luaL_Reg Resolver_member_methods[] = {
+  { "__gc"         , Resolver__Resolver   },
+  { "reverse"      , Resolver_reverse     },
+  { "resolve"      , Resolver_resolve     },
+  { "cached"       , Resolver_cached      },
+  { "setTTL"       , Resolver_setTTL      },
+  { "ttl"          , Resolver_ttl         },
+  { "fd"           , Resolver_fd          },
+  { "done"         , Resolver_done        },
+  { "result"       , Resolver_result      },
+  { "host"         , Resolver_host        },
+  { "__tostring"   , Resolver___tostring  },
+  { "deleted"      , dub::isDeleted       },
+  { NULL, NULL},
+};
+
+extern "C" int luaopen_lens_Resolver(lua_State *L)
+{
+  // Create the metatable which will contain all the member methods
+  luaL_newmetatable(L, "lens.Resolver");
+  // <mt>
+
+  // register member methods
+  dub::fregister(L, Resolver_member_methods);
+  // setup meta-table
+  dub::setup(L, "lens.Resolver");
+  // <mt>
+  return 1;
+}
@@ -0,0 +1,339 @@
+/**
+ *
+ * MACHINE GENERATED FILE. DO NOT EDIT.
+ *
+ * Bindings for class Scheduler
+ *
+ * This file has been generated by dub 2.2.1.
+ */
+#include "dub/dub.h"
+#include "lens/Scheduler.h"
+
+using namespace lens;
+
+/** lens::Scheduler::Scheduler()
+ * include/lens/Scheduler.h:125
+ */
+static int Scheduler_Scheduler(lua_State *L) {
+  try {
+    Scheduler *retval__ = new Scheduler();
+    retval__->dub_pushobject(L, retval__, "lens.Scheduler", true);
+    return 1;
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "new: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "new: Unknown exception");
+  }
+  return dub::error(L);
+}
+
+/** lens::Scheduler::~Scheduler()
+ * include/lens/Scheduler.h:127
+ */
+static int Scheduler__Scheduler(lua_State *L) {
+  try {
+    DubUserdata *userdata = ((DubUserdata*)dub::checksdata_d(L, 1, "lens.Scheduler"));
+    if (userdata->gc) {
+      Scheduler *self = (Scheduler *)userdata->ptr;
+      delete self;
+    }
+    userdata->gc = false;
+    return 0;
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "__gc: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "__gc: Unknown exception");
+  }
+  return dub::error(L);
+}
+
+/** void lens::Scheduler::setPoller(Poller *poller)
+ * include/lens/Scheduler.h:131
+ */
+static int Scheduler_setPoller(lua_State *L) {
+  try {
+    Scheduler *self = *((Scheduler **)dub::checksdata(L, 1, "lens.Scheduler"));
+    Poller *poller = *((Poller **)dub::checksdata(L, 2, "lens.Poller"));
+    self->setPoller(poller);
+    return 0;
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "setPoller: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "setPoller: Unknown exception");
+  }
+  return dub::error(L);
+}
+
+/** void lens::Scheduler::loop(lua_State *L)
+ * include/lens/Scheduler.h:137
+ */
+static int Scheduler_loop(lua_State *L) {
+  try {
+    Scheduler *self = *((Scheduler **)dub::checksdata(L, 1, "lens.Scheduler"));
+    self->loop(L);
+    return 0;
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "loop: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "loop: Unknown exception");
+  }
+  return dub::error(L);
+}
+
+/** void lens::Scheduler::runDue(lua_State *L)
+ * include/lens/Scheduler.h:141
+ */
+static int Scheduler_runDue(lua_State *L) {
+  try {
+    Scheduler *self = *((Scheduler **)dub::checksdata(L, 1, "lens.Scheduler"));
+    self->runDue(L);
+    return 0;
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "runDue: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "runDue: Unknown exception");
+  }
+  return dub::error(L);
+}
+
+/** void lens::Scheduler::runEvents(lua_State *L)
+ * include/lens/Scheduler.h:145
+ */
+static int Scheduler_runEvents(lua_State *L) {
+  try {
+    Scheduler *self = *((Scheduler **)dub::checksdata(L, 1, "lens.Scheduler"));
+    self->runEvents(L);
+    return 0;
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "runEvents: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "runEvents: Unknown exception");
+  }
+  return dub::error(L);
+}
+
+/** double lens::Scheduler::wakeAt()
+ * include/lens/Scheduler.h:149
+ */
+static int Scheduler_wakeAt(lua_State *L) {
+  try {
+    Scheduler *self = *((Scheduler **)dub::checksdata(L, 1, "lens.Scheduler"));
+    lua_pushnumber(L, self->wakeAt());
+    return 1;
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "wakeAt: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "wakeAt: Unknown exception");
+  }
+  return dub::error(L);
+}
+
+/** void lens::Scheduler::scheduleAt(lua_State *L)
+ * include/lens/Scheduler.h:156
+ */
+static int Scheduler_scheduleAt(lua_State *L) {
+  try {
+    Scheduler *self = *((Scheduler **)dub::checksdata(L, 1, "lens.Scheduler"));
+    self->scheduleAt(L);
+    return 0;
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "scheduleAt: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "scheduleAt: Unknown exception");
+  }
+  return dub::error(L);
+}
+
+/** void lens::Scheduler::unschedule(lua_State *L)
+ * include/lens/Scheduler.h:160
+ */
+static int Scheduler_unschedule(lua_State *L) {
+  try {
+    Scheduler *self = *((Scheduler **)dub::checksdata(L, 1, "lens.Scheduler"));
+    self->unschedule(L);
+    return 0;
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "unschedule: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "unschedule: Unknown exception");
+  }
+  return dub::error(L);
+}
+
+/** void lens::Scheduler::changeFdFilter(lua_State *L)
+ * include/lens/Scheduler.h:164
+ */
+static int Scheduler_changeFdFilter(lua_State *L) {
+  try {
+    Scheduler *self = *((Scheduler **)dub::checksdata(L, 1, "lens.Scheduler"));
+    self->changeFdFilter(L);
+    return 0;
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "changeFdFilter: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "changeFdFilter: Unknown exception");
+  }
+  return dub::error(L);
+}
+
+/** void lens::Scheduler::removeFd(lua_State *L)
+ * include/lens/Scheduler.h:168
+ */
+static int Scheduler_removeFd(lua_State *L) {
+  try {
+    Scheduler *self = *((Scheduler **)dub::checksdata(L, 1, "lens.Scheduler"));
+    self->removeFd(L);
+    return 0;
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "removeFd: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "removeFd: Unknown exception");
+  }
+  return dub::error(L);
+}
+
+/** void lens::Scheduler::finalizeThread(lua_State *L)
+ * include/lens/Scheduler.h:172
+ */
+static int Scheduler_finalizeThread(lua_State *L) {
+  try {
+    Scheduler *self = *((Scheduler **)dub::checksdata(L, 1, "lens.Scheduler"));
+    self->finalizeThread(L);
+    return 0;
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "finalizeThread: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "finalizeThread: Unknown exception");
+  }
+  return dub::error(L);
+}
+
+/** double lens::Scheduler::now()
+ * include/lens/Scheduler.h:176
+ */
+static int Scheduler_now(lua_State *L) {
+  try {
+    Scheduler *self = *((Scheduler **)dub::checksdata(L, 1, "lens.Scheduler"));
+    lua_pushnumber(L, self->now());
+    return 1;
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "now: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "now: Unknown exception");
+  }
+  return dub::error(L);
+}
+
+/** int lens::Scheduler::fdCount()
+ * include/lens/Scheduler.h:180
+ */
+static int Scheduler_fdCount(lua_State *L) {
+  try {
+    Scheduler *self = *((Scheduler **)dub::checksdata(L, 1, "lens.Scheduler"));
+    lua_pushnumber(L, self->fdCount());
+    return 1;
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "fdCount: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "fdCount: Unknown exception");
+  }
+  return dub::error(L);
+}
+
+/** bool lens::Scheduler::shouldRun()
+ * include/lens/Scheduler.h:184
+ */
+static int Scheduler_shouldRun(lua_State *L) {
+  try {
+    Scheduler *self = *((Scheduler **)dub::checksdata(L, 1, "lens.Scheduler"));
+    lua_pushboolean(L, self->shouldRun());
+    return 1;
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "shouldRun: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "shouldRun: Unknown exception");
+  }
+  return dub::error(L);
+}
+
+/** void lens::Scheduler::start()
+ * include/lens/Scheduler.h:190
+ */
+static int Scheduler_start(lua_State *L) {
+  try {
+    Scheduler *self = *((Scheduler **)dub::checksdata(L, 1, "lens.Scheduler"));
+    self->start();
+    return 0;
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "start: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "start: Unknown exception");
+  }
+  return dub::error(L);
+}
+
+/** void lens::Scheduler::stop()
+ * include/lens/Scheduler.h:196
+ */
+static int Scheduler_stop(lua_State *L) {
+  try {
+    Scheduler *self = *((Scheduler **)dub::checksdata(L, 1, "lens.Scheduler"));
+    self->stop();
+    return 0;
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "stop: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "stop: Unknown exception");
+  }
+  return dub::error(L);
+}
+
+
+
+// --=============================================== __tostring
+static int Scheduler___tostring(lua_State *L) {
+  Scheduler *self = *((Scheduler **)dub::checksdata_n(L, 1, "lens.Scheduler"));
+  lua_pushfstring(L, "lens.Scheduler: %p (%d)", self, self-> fdCount());
+  
+  return 1;
+}
+
+// --=============================================== METHODS
+
+static const struct luaL_Reg Scheduler_member_methods[] = {
+  { "new"          , Scheduler_Scheduler  },
+  { "__gc"         , Scheduler__Scheduler },
+  { "setPoller"    , Scheduler_setPoller  },
+  { "loop"         , Scheduler_loop       },
+  { "runDue"       , Scheduler_runDue     },
+  { "runEvents"    , Scheduler_runEvents  },
+  { "wakeAt"       , Scheduler_wakeAt     },
+  { "scheduleAt"   , Scheduler_scheduleAt },
+  { "unschedule"   , Scheduler_unschedule },
+  { "changeFdFilter", Scheduler_changeFdFilter},
+  { "removeFd"     , Scheduler_removeFd   },
+  { "finalizeThread", Scheduler_finalizeThread},
+  { "now"          , Scheduler_now        },
+  { "fdCount"      , Scheduler_fdCount    },
+  { "shouldRun"    , Scheduler_shouldRun  },
+  { "start"        , Scheduler_start      },
+  { "stop"         , Scheduler_stop       },
+  { "__tostring"   , Scheduler___tostring },
+  { "deleted"      , dub::isDeleted       },
+  { NULL, NULL},
+};
+
+
+extern "C" int luaopen_lens_Scheduler(lua_State *L)
+{
+  // Create the metatable which will contain all the member methods
+  luaL_newmetatable(L, "lens.Scheduler");
+  // <mt>
+
+  // register member methods
+  dub::fregister(L, Scheduler_member_methods);
+  // setup meta-table
+  dub::setup(L, "lens.Scheduler");
+  // <mt>
+  return 1;
+}
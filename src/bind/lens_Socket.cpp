@@ -11,15 +11,24 @@
 
 using namespace lens;
 
-/** lens::Socket::Socket(int socket_type)
- * include/lens/Socket.h:91
+/** lens::Socket::Socket(int socket_type, int buffer_size=MAX_BUFF_SIZE)
+ * include/lens/Socket.h:176
  */
 static int Socket_Socket(lua_State *L) {
   try {
-    int socket_type = dub::checkint(L, 1);
-    Socket *retval__ = new Socket(socket_type);
-    retval__->dub_pushobject(L, retval__, "lens.Socket", true);
-    return 1;
+    int top__ = lua_gettop(L);
+    if (top__ >= 2) {
+      int socket_type = dub::checkint(L, 1);
+      int buffer_size = dub::checkint(L, 2);
+      Socket *retval__ = new Socket(socket_type, buffer_size);
+      retval__->dub_pushobject(L, retval__, "lens.Socket", true);
+      return 1;
+    } else {
+      int socket_type = dub::checkint(L, 1);
+      Socket *retval__ = new Socket(socket_type);
+      retval__->dub_pushobject(L, retval__, "lens.Socket", true);
+      return 1;
+    }
   } catch (std::exception &e) {
     lua_pushfstring(L, "new: %s", e.what());
   } catch (...) {
@@ -29,7 +38,7 @@ static int Socket_Socket(lua_State *L) {
 }
 
 /** virtual lens::Socket::~Socket()
- * include/lens/Socket.h:105
+ * include/lens/Socket.h:204
  */
 static int Socket__Socket(lua_State *L) {
   try {
@@ -49,7 +58,7 @@ static int Socket__Socket(lua_State *L) {
 }
 
 /** void lens::Socket::close()
- * include/lens/Socket.h:109
+ * include/lens/Socket.h:213
  */
 static int Socket_close(lua_State *L) {
   try {
@@ -64,14 +73,20 @@ static int Socket_close(lua_State *L) {
   return dub::error(L);
 }
 
-/** int lens::Socket::bind(const char *localhost=NULL, int port=0)
- * include/lens/Socket.h:119
+/** int lens::Socket::bind(const char *localhost=NULL, int port=0, int flags=0)
+ * include/lens/Socket.h:224
  */
 static int Socket_bind(lua_State *L) {
   try {
     Socket *self = *((Socket **)dub::checksdata(L, 1, "lens.Socket"));
     int top__ = lua_gettop(L);
-    if (top__ >= 3) {
+    if (top__ >= 4) {
+      const char *localhost = dub::checkstring(L, 2);
+      int port = dub::checkint(L, 3);
+      int flags = dub::checkint(L, 4);
+      lua_pushnumber(L, self->bind(localhost, port, flags));
+      return 1;
+    } else if (top__ >= 3) {
       const char *localhost = dub::checkstring(L, 2);
       int port = dub::checkint(L, 3);
       lua_pushnumber(L, self->bind(localhost, port));
@@ -92,16 +107,25 @@ static int Socket_bind(lua_State *L) {
   return dub::error(L);
 }
 
-/** bool lens::Socket::connect(const char *host, int port)
- * include/lens/Socket.h:124
+/** bool lens::Socket::connect(const char *host, int port, const char *address=NULL)
+ * include/lens/Socket.h:233
  */
 static int Socket_connect(lua_State *L) {
   try {
     Socket *self = *((Socket **)dub::checksdata(L, 1, "lens.Socket"));
-    const char *host = dub::checkstring(L, 2);
-    int port = dub::checkint(L, 3);
-    lua_pushboolean(L, self->connect(host, port));
-    return 1;
+    int top__ = lua_gettop(L);
+    if (top__ >= 4) {
+      const char *host = dub::checkstring(L, 2);
+      int port = dub::checkint(L, 3);
+      const char *address = dub::checkstring(L, 4);
+      lua_pushboolean(L, self->connect(host, port, address));
+      return 1;
+    } else {
+      const char *host = dub::checkstring(L, 2);
+      int port = dub::checkint(L, 3);
+      lua_pushboolean(L, self->connect(host, port));
+      return 1;
+    }
   } catch (std::exception &e) {
     lua_pushfstring(L, "connect: %s", e.what());
   } catch (...) {
@@ -111,7 +135,7 @@ static int Socket_connect(lua_State *L) {
 }
 
 /** void lens::Socket::connectFinish()
- * include/lens/Socket.h:128
+ * include/lens/Socket.h:237
  */
 static int Socket_connectFinish(lua_State *L) {
   try {
@@ -127,7 +151,7 @@ static int Socket_connectFinish(lua_State *L) {
 }
 
 /** void lens::Socket::listen(int backlog=BACKLOG)
- * include/lens/Socket.h:133
+ * include/lens/Socket.h:242
  */
 static int Socket_listen(lua_State *L) {
   try {
@@ -150,7 +174,7 @@ static int Socket_listen(lua_State *L) {
 }
 
 /** LuaStackSize lens::Socket::accept(lua_State *L)
- * include/lens/Socket.h:138
+ * include/lens/Socket.h:248
  */
 static int Socket_accept(lua_State *L) {
   try {
@@ -164,8 +188,24 @@ static int Socket_accept(lua_State *L) {
   return dub::error(L);
 }
 
+/** LuaStackSize lens::Socket::acceptMany(int max, lua_State *L)
+ * include/lens/Socket.h:255
+ */
+static int Socket_acceptMany(lua_State *L) {
+  try {
+    Socket *self = *((Socket **)dub::checksdata(L, 1, "lens.Socket"));
+    int max = dub::checkint(L, 2);
+    return self->acceptMany(max, L);
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "acceptMany: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "acceptMany: Unknown exception");
+  }
+  return dub::error(L);
+}
+
 /** LuaStackSize lens::Socket::recvLine(lua_State *L)
- * include/lens/Socket.h:144
+ * include/lens/Socket.h:262
  */
 static int Socket_recvLine(lua_State *L) {
   try {
@@ -180,7 +220,7 @@ static int Socket_recvLine(lua_State *L) {
 }
 
 /** LuaStackSize lens::Socket::recvBytes(int sz, lua_State *L)
- * include/lens/Socket.h:150
+ * include/lens/Socket.h:268
  */
 static int Socket_recvBytes(lua_State *L) {
   try {
@@ -196,7 +236,7 @@ static int Socket_recvBytes(lua_State *L) {
 }
 
 /** LuaStackSize lens::Socket::recvMessage(lua_State *L)
- * include/lens/Socket.h:156
+ * include/lens/Socket.h:274
  */
 static int Socket_recvMessage(lua_State *L) {
   try {
@@ -210,8 +250,40 @@ static int Socket_recvMessage(lua_State *L) {
   return dub::error(L);
 }
 
+/** LuaStackSize lens::Socket::recvMessages(int max, lua_State *L)
+ * include/lens/Socket.h:280
+ */
+static int Socket_recvMessages(lua_State *L) {
+  try {
+    Socket *self = *((Socket **)dub::checksdata(L, 1, "lens.Socket"));
+    int max = dub::checkint(L, 2);
+    return self->recvMessages(max, L);
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "recvMessages: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "recvMessages: Unknown exception");
+  }
+  return dub::error(L);
+}
+
+/** int lens::Socket::sendMessages(lua_State *L)
+ * include/lens/Socket.h:287
+ */
+static int Socket_sendMessages(lua_State *L) {
+  try {
+    Socket *self = *((Socket **)dub::checksdata(L, 1, "lens.Socket"));
+    lua_pushnumber(L, self->sendMessages(L));
+    return 1;
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "sendMessages: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "sendMessages: Unknown exception");
+  }
+  return dub::error(L);
+}
+
 /** int lens::Socket::send(lua_State *L)
- * include/lens/Socket.h:162
+ * include/lens/Socket.h:294
  */
 static int Socket_send(lua_State *L) {
   try {
@@ -226,8 +298,236 @@ static int Socket_send(lua_State *L) {
   return dub::error(L);
 }
 
+/** int lens::Socket::flush()
+ * include/lens/Socket.h:299
+ */
+static int Socket_flush(lua_State *L) {
+  try {
+    Socket *self = *((Socket **)dub::checksdata(L, 1, "lens.Socket"));
+    lua_pushnumber(L, self->flush());
+    return 1;
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "flush: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "flush: Unknown exception");
+  }
+  return dub::error(L);
+}
+
+/** int lens::Socket::pending() const
+ * include/lens/Socket.h:303
+ */
+static int Socket_pending(lua_State *L) {
+  try {
+    Socket *self = *((Socket **)dub::checksdata(L, 1, "lens.Socket"));
+    lua_pushnumber(L, self->pending());
+    return 1;
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "pending: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "pending: Unknown exception");
+  }
+  return dub::error(L);
+}
+
+/** void lens::Socket::setWatermark(int bytes)
+ * include/lens/Socket.h:310
+ */
+static int Socket_setWatermark(lua_State *L) {
+  try {
+    Socket *self = *((Socket **)dub::checksdata(L, 1, "lens.Socket"));
+    int bytes = dub::checkint(L, 2);
+    self->setWatermark(bytes);
+    return 0;
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "setWatermark: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "setWatermark: Unknown exception");
+  }
+  return dub::error(L);
+}
+
+/** int lens::Socket::watermark() const
+ * include/lens/Socket.h:314
+ */
+static int Socket_watermark(lua_State *L) {
+  try {
+    Socket *self = *((Socket **)dub::checksdata(L, 1, "lens.Socket"));
+    lua_pushnumber(L, self->watermark());
+    return 1;
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "watermark: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "watermark: Unknown exception");
+  }
+  return dub::error(L);
+}
+
+/** int lens::Socket::recvSpace() const
+ * include/lens/Socket.h:323
+ */
+static int Socket_recvSpace(lua_State *L) {
+  try {
+    Socket *self = *((Socket **)dub::checksdata(L, 1, "lens.Socket"));
+    lua_pushnumber(L, self->recvSpace());
+    return 1;
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "recvSpace: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "recvSpace: Unknown exception");
+  }
+  return dub::error(L);
+}
+
+/** void lens::Socket::feed(lua_State *L)
+ * include/lens/Socket.h:330
+ */
+static int Socket_feed(lua_State *L) {
+  try {
+    Socket *self = *((Socket **)dub::checksdata(L, 1, "lens.Socket"));
+    self->feed(L);
+    return 0;
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "feed: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "feed: Unknown exception");
+  }
+  return dub::error(L);
+}
+
+/** LuaStackSize lens::Socket::queued(lua_State *L)
+ * include/lens/Socket.h:337
+ */
+static int Socket_queued(lua_State *L) {
+  try {
+    Socket *self = *((Socket **)dub::checksdata(L, 1, "lens.Socket"));
+    return self->queued(L);
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "queued: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "queued: Unknown exception");
+  }
+  return dub::error(L);
+}
+
+/** int lens::Socket::consume(int sent)
+ * include/lens/Socket.h:342
+ */
+static int Socket_consume(lua_State *L) {
+  try {
+    Socket *self = *((Socket **)dub::checksdata(L, 1, "lens.Socket"));
+    int sent = dub::checkint(L, 2);
+    lua_pushnumber(L, self->consume(sent));
+    return 1;
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "consume: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "consume: Unknown exception");
+  }
+  return dub::error(L);
+}
+
+/** LuaStackSize lens::Socket::recvFrame(lua_State *L)
+ * include/lens/Socket.h:350
+ */
+static int Socket_recvFrame(lua_State *L) {
+  try {
+    Socket *self = *((Socket **)dub::checksdata(L, 1, "lens.Socket"));
+    return self->recvFrame(L);
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "recvFrame: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "recvFrame: Unknown exception");
+  }
+  return dub::error(L);
+}
+
+/** int lens::Socket::sendFrame(lua_State *L)
+ * include/lens/Socket.h:356
+ */
+static int Socket_sendFrame(lua_State *L) {
+  try {
+    Socket *self = *((Socket **)dub::checksdata(L, 1, "lens.Socket"));
+    lua_pushnumber(L, self->sendFrame(L));
+    return 1;
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "sendFrame: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "sendFrame: Unknown exception");
+  }
+  return dub::error(L);
+}
+
+/** LuaStackSize lens::Socket::recvValue(lua_State *L)
+ * include/lens/Socket.h:363
+ */
+static int Socket_recvValue(lua_State *L) {
+  try {
+    Socket *self = *((Socket **)dub::checksdata(L, 1, "lens.Socket"));
+    return self->recvValue(L);
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "recvValue: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "recvValue: Unknown exception");
+  }
+  return dub::error(L);
+}
+
+/** int lens::Socket::sendValue(lua_State *L)
+ * include/lens/Socket.h:368
+ */
+static int Socket_sendValue(lua_State *L) {
+  try {
+    Socket *self = *((Socket **)dub::checksdata(L, 1, "lens.Socket"));
+    lua_pushnumber(L, self->sendValue(L));
+    return 1;
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "sendValue: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "sendValue: Unknown exception");
+  }
+  return dub::error(L);
+}
+
+/** double lens::Socket::sendFile(int fd, double offset, double len)
+ * include/lens/Socket.h:375
+ */
+static int Socket_sendFile(lua_State *L) {
+  try {
+    Socket *self = *((Socket **)dub::checksdata(L, 1, "lens.Socket"));
+    int fd = dub::checkint(L, 2);
+    double offset = dub::checknumber(L, 3);
+    double len = dub::checknumber(L, 4);
+    lua_pushnumber(L, self->sendFile(fd, offset, len));
+    return 1;
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "sendFile: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "sendFile: Unknown exception");
+  }
+  return dub::error(L);
+}
+
+/** int lens::Socket::splice(int fd, int len)
+ * include/lens/Socket.h:383
+ */
+static int Socket_splice(lua_State *L) {
+  try {
+    Socket *self = *((Socket **)dub::checksdata(L, 1, "lens.Socket"));
+    int fd = dub::checkint(L, 2);
+    int len = dub::checkint(L, 3);
+    lua_pushnumber(L, self->splice(fd, len));
+    return 1;
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "splice: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "splice: Unknown exception");
+  }
+  return dub::error(L);
+}
+
 /** const char* lens::Socket::localHost() const
- * include/lens/Socket.h:166
+ * include/lens/Socket.h:387
  */
 static int Socket_localHost(lua_State *L) {
   try {
@@ -243,7 +543,7 @@ static int Socket_localHost(lua_State *L) {
 }
 
 /** int lens::Socket::localPort() const
- * include/lens/Socket.h:172
+ * include/lens/Socket.h:393
  */
 static int Socket_localPort(lua_State *L) {
   try {
@@ -259,7 +559,7 @@ static int Socket_localPort(lua_State *L) {
 }
 
 /** const char* lens::Socket::remoteHost() const
- * include/lens/Socket.h:178
+ * include/lens/Socket.h:399
  */
 static int Socket_remoteHost(lua_State *L) {
   try {
@@ -275,7 +575,7 @@ static int Socket_remoteHost(lua_State *L) {
 }
 
 /** int lens::Socket::remotePort() const
- * include/lens/Socket.h:184
+ * include/lens/Socket.h:405
  */
 static int Socket_remotePort(lua_State *L) {
   try {
@@ -290,8 +590,24 @@ static int Socket_remotePort(lua_State *L) {
   return dub::error(L);
 }
 
+/** int lens::Socket::bufferSize() const
+ * include/lens/Socket.h:417
+ */
+static int Socket_bufferSize(lua_State *L) {
+  try {
+    Socket *self = *((Socket **)dub::checksdata(L, 1, "lens.Socket"));
+    lua_pushnumber(L, self->bufferSize());
+    return 1;
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "bufferSize: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "bufferSize: Unknown exception");
+  }
+  return dub::error(L);
+}
+
 /** int lens::Socket::fd() const
- * include/lens/Socket.h:190
+ * include/lens/Socket.h:411
  */
 static int Socket_fd(lua_State *L) {
   try {
@@ -327,15 +643,33 @@ static const struct luaL_Reg Socket_member_methods[] = {
   { "connectFinish", Socket_connectFinish },
   { "listen"       , Socket_listen        },
   { "accept"       , Socket_accept        },
+  { "acceptMany"   , Socket_acceptMany    },
   { "recvLine"     , Socket_recvLine      },
   { "recvBytes"    , Socket_recvBytes     },
   { "recvMessage"  , Socket_recvMessage   },
+  { "recvMessages" , Socket_recvMessages  },
   { "send"         , Socket_send          },
+  { "flush"        , Socket_flush         },
+  { "pending"      , Socket_pending       },
+  { "setWatermark" , Socket_setWatermark  },
+  { "watermark"    , Socket_watermark     },
+  { "recvSpace"    , Socket_recvSpace     },
+  { "feed"         , Socket_feed          },
+  { "queued"       , Socket_queued        },
+  { "consume"      , Socket_consume       },
+  { "sendMessages" , Socket_sendMessages  },
+  { "recvFrame"    , Socket_recvFrame     },
+  { "sendFrame"    , Socket_sendFrame     },
+  { "recvValue"    , Socket_recvValue     },
+  { "sendValue"    , Socket_sendValue     },
+  { "sendFile"     , Socket_sendFile      },
+  { "splice"       , Socket_splice        },
   { "localHost"    , Socket_localHost     },
   { "localPort"    , Socket_localPort     },
   { "remoteHost"   , Socket_remoteHost    },
   { "remotePort"   , Socket_remotePort    },
   { "fd"           , Socket_fd            },
+  { "bufferSize"   , Socket_bufferSize    },
   { "__tostring"   , Socket___tostring    },
   { "deleted"      , dub::isDeleted       },
   { NULL, NULL},
@@ -345,6 +679,8 @@ static const struct luaL_Reg Socket_member_methods[] = {
 static const struct dub::const_Reg Socket_const[] = {
   { "TCP"          , Socket::TCP          },
   { "UDP"          , Socket::UDP          },
+  { "ReuseAddr"    , Socket::ReuseAddr    },
+  { "ReusePort"    , Socket::ReusePort    },
   { NULL, 0},
 };
 
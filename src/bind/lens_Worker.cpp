@@ -0,0 +1,117 @@
+/**
+ *
+ * MACHINE GENERATED FILE. DO NOT EDIT.
+ *
+ * Bindings for class Worker
+ *
+ * This file has been generated by dub 2.2.1.
+ */
+#include "dub/dub.h"
+#include "lens/Worker.h"
+
+using namespace lens;
+
+/** lens::Worker::Worker(const char *code, lua_State *L)
+ * include/lens/Worker.h:76
+ */
+static int Worker_Worker(lua_State *L) {
+  try {
+    const char *code = dub::checkstring(L, 1);
+    Worker *retval__ = new Worker(code, L);
+    dub::pushudata(L, retval__, "lens.Worker", true);
+    return 1;
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "new: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "new: Unknown exception");
+  }
+  return dub::error(L);
+}
+
+/** lens::Worker::~Worker()
+ * include/lens/Worker.h:80
+ */
+static int Worker__Worker(lua_State *L) {
+  try {
+    DubUserdata *userdata = ((DubUserdata*)dub::checksdata_d(L, 1, "lens.Worker"));
+    if (userdata->gc) {
+      Worker *self = (Worker *)userdata->ptr;
+      delete self;
+    }
+    userdata->gc = false;
+    return 0;
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "__gc: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "__gc: Unknown exception");
+  }
+  return dub::error(L);
+}
+
+/** void lens::Worker::join()
+ * include/lens/Worker.h:84
+ */
+static int Worker_join(lua_State *L) {
+  try {
+    Worker *self = *((Worker **)dub::checksdata(L, 1, "lens.Worker"));
+    self->join();
+    return 0;
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "join: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "join: Unknown exception");
+  }
+  return dub::error(L);
+}
+
+/** bool lens::Worker::running()
+ * include/lens/Worker.h:86
+ */
+static int Worker_running(lua_State *L) {
+  try {
+    Worker *self = *((Worker **)dub::checksdata(L, 1, "lens.Worker"));
+    lua_pushboolean(L, self->running());
+    return 1;
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "running: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "running: Unknown exception");
+  }
+  return dub::error(L);
+}
+
+
+
+// --=============================================== __tostring
+static int Worker___tostring(lua_State *L) {
+  Worker *self = *((Worker **)dub::checksdata_n(L, 1, "lens.Worker"));
+  lua_pushfstring(L, "lens.Worker: %p (%s)", self, self-> running() ? "running" : "done");
+  
+  return 1;
+}
+
+// --=============================================== METHODS
+
+static const struct luaL_Reg Worker_member_methods[] = {
+  { "new"          , Worker_Worker        },
+  { "__gc"         , Worker__Worker       },
+  { "join"         , Worker_join          },
+  { "running"      , Worker_running       },
+  { "__tostring"   , Worker___tostring    },
+  { "deleted"      , dub::isDeleted       },
+  { NULL, NULL},
+};
+
+extern "C" int luaopen_lens_Worker(lua_State *L)
+{
+  // Create the metatable which will contain all the member methods
+  luaL_newmetatable(L, "lens.Worker");
+  // <mt>
+
+  // register member methods
+  dub::fregister(L, Worker_member_methods);
+  // setup meta-table
+  dub::setup(L, "lens.Worker");
+  // <mt>
+  return 1;
+}
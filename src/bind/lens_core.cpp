@@ -9,19 +9,28 @@
 #include "dub/dub.h"
 #include "lens/File.h"
 #include "lens/Finalizer.h"
+#include "lens/Mailbox.h"
 #include "lens/Poller.h"
 #include "lens/Popen.h"
+#include "lens/Resolver.h"
+#include "lens/Scheduler.h"
 #include "lens/Socket.h"
+#include "lens/Worker.h"
 #include "lens/lens.h"
+#include "lens/msgpack.h"
 
 using namespace lens;
 
 extern "C" {
 int luaopen_lens_File(lua_State *L);
 int luaopen_lens_Finalizer(lua_State *L);
+int luaopen_lens_Mailbox(lua_State *L);
 int luaopen_lens_Poller(lua_State *L);
 int luaopen_lens_Popen(lua_State *L);
+int luaopen_lens_Resolver(lua_State *L);
+int luaopen_lens_Scheduler(lua_State *L);
 int luaopen_lens_Socket(lua_State *L);
+int luaopen_lens_Worker(lua_State *L);
 }
 
 /** void lens::init()
@@ -70,11 +79,41 @@ static int lens_millisleep(lua_State *L) {
   return lua_error(L);
 }
 
+/** LuaStackSize lens::pack(lua_State *L)
+ * include/lens/msgpack.h:50
+ */
+static int lens_pack(lua_State *L) {
+  try {
+    return lens::pack(L);
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "lens.pack: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "lens.pack: Unknown exception");
+  }
+  return lua_error(L);
+}
+
+/** LuaStackSize lens::unpack(lua_State *L)
+ * include/lens/msgpack.h:53
+ */
+static int lens_unpack(lua_State *L) {
+  try {
+    return lens::unpack(L);
+  } catch (std::exception &e) {
+    lua_pushfstring(L, "lens.unpack: %s", e.what());
+  } catch (...) {
+    lua_pushfstring(L, "lens.unpack: Unknown exception");
+  }
+  return lua_error(L);
+}
+
 // --=============================================== FUNCTIONS
 static const struct luaL_Reg lens_functions[] = {
   { "init"         , lens_init            },
   { "elapsed"      , lens_elapsed         },
   { "millisleep"   , lens_millisleep      },
+  { "pack"         , lens_pack            },
+  { "unpack"       , lens_unpack          },
   { NULL, NULL},
 };
 
@@ -93,6 +132,10 @@ extern "C" int luaopen_lens_core(lua_State *L) {
   // <lens.Finalizer>
   lua_setfield(L, -2, "Finalizer");
   
+  luaopen_lens_Mailbox(L);
+  // <lens.Mailbox>
+  lua_setfield(L, -2, "Mailbox");
+  
   luaopen_lens_Poller(L);
   // <lens.Poller>
   lua_setfield(L, -2, "Poller");
@@ -101,10 +144,22 @@ extern "C" int luaopen_lens_core(lua_State *L) {
   // <lens.Popen>
   lua_setfield(L, -2, "Popen");
   
+  luaopen_lens_Resolver(L);
+  // <lens.Resolver>
+  lua_setfield(L, -2, "Resolver");
+  
+  luaopen_lens_Scheduler(L);
+  // <lens.Scheduler>
+  lua_setfield(L, -2, "Scheduler");
+  
   luaopen_lens_Socket(L);
   // <lens.Socket>
   lua_setfield(L, -2, "Socket");
   
+  luaopen_lens_Worker(L);
+  // <lens.Worker>
+  lua_setfield(L, -2, "Worker");
+  
   // <lib>
   return 1;
 }
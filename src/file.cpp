@@ -29,73 +29,87 @@
 #include "lens/File.h"
 
 #include <errno.h>
+#include <stdlib.h>   // malloc
+#include <sys/stat.h> // fstat
+#include <sys/mman.h> // mmap
+#include <string.h>   // memchr
+#include <poll.h>     // poll
+#include <sys/uio.h>  // pwritev
+#include <new>        // std::bad_alloc
 using namespace lens;
 
-// Read 'sz' bytes from fd. Returns string or false and error message.
-// local sz = 1024
-// local op, data = f:read(sz)
-// while File.op == File.EAGAIN
-//   local l
+// Read 'sz' bytes from fd. Returns string and op.
+// local data, op = f:read(sz)
+// while op == File.Wait do
+//   local d
 //   yield('read', f:fd())
-//   op, l = f:read(sz - string.len(data))
-//   data = data .. l
-// end
-// if op == File.OK then
-//   return line
-// else
-//   return false, File.Message[op]
+//   d, op = f:read(sz - #data)
+//   data = data .. d
 // end
 LuaStackSize File::read(size_t sz, lua_State *L) {
   // This should not happen. Error.
   if (fd_ == 0) throw dub::Exception("Cannot read from a closed file.");
-  if (!(mode_ == Read)) throw dub::Exception("File mode not compatible with read operation.");
-  // TODO
-  return 0;
-}
+  if (ioBusy()) throw dub::Exception("Cannot read during an async operation.");
+  if (!(mode_ == Read || mode_ == ReadWrite || mode_ == Mmap)) throw dub::Exception("File mode not compatible with read operation.");
+  flushWrites();
+
+  if (mode_ == Mmap) {
+    size_t avail = map_size_ - map_i_;
+    if (sz > avail) sz = avail;
+    lua_pushlstring(L, map_ + map_i_, sz);
+    map_i_ += sz;
+    lua_pushnumber(L, sz ? (int)File::OK : (int)File::End);
+    return 2;
+  }
 
-/*
-int lk::Socket::recvBytes(lua_State *L, int sz) {
   luaL_Buffer buffer;
+  luaL_buffinit(L, &buffer);
 
-  if (buffer_i_ < buffer_length_) {
-    if (sz <= (buffer_length_-buffer_i_)) {
-      // everything is in the buffer already
-      lua_pushlstring(L, buffer_ + buffer_i_, sz);
-      buffer_i_ += sz;
-      return 1;
-    }
-    luaL_buffinit(L, &buffer);
-    // add current content
-    luaL_addlstring(&buffer, buffer_ + buffer_i_, buffer_length_ - buffer_i_);
-    sz -= buffer_length_ - buffer_i_;
-  } else {
-    luaL_buffinit(L, &buffer);
+  // Data left by readLine.
+  size_t avail = buffer_length_ - buffer_i_;
+  if (avail) {
+    if (avail > sz) avail = sz;
+    luaL_addlstring(&buffer, buffer_ + buffer_i_, avail);
+    buffer_i_ += avail;
+    sz -= avail;
   }
 
+  int op = readInto(&buffer, sz);
+  luaL_pushresult(&buffer);
+  lua_pushnumber(L, op);
+  return 2;
+}
+
+int File::readInto(luaL_Buffer *buffer, size_t sz) {
   while (sz) {
-    // read more data
-    // we prefer not reading too much so that we might simplify read operation
-    // with a single pushlstring
-    buffer_length_ = ::recv(socket_fd_, buffer_, sz < MAX_BUFF_SIZE ? sz : MAX_BUFF_SIZE, 0);
-    if (buffer_length_ == 0) {
-      // connection closed
-      // abort
-      return 0;
-    } else if (buffer_length_ < 0) {
-      buffer_length_ = 0;
-      throw dub::Exception("Could not receive (%s).", strerror(errno));
+    // Read directly in the Lua buffer.
+#if LUA_VERSION_NUM >= 502
+    size_t chunk = sz < MAX_READ_CHUNK ? sz : MAX_READ_CHUNK;
+    char *ptr = luaL_prepbuffsize(buffer, chunk);
+#else
+    size_t chunk = sz < LUAL_BUFFERSIZE ? sz : LUAL_BUFFERSIZE;
+    char *ptr = luaL_prepbuffer(buffer);
+#endif
+    ssize_t n = ::read(fd_, ptr, chunk);
+    if (n > 0) {
+      luaL_addsize(buffer, n);
+      sz -= n;
+    } else if (n == 0) {
+      return File::End;
+    } else {
+      int err = errno;
+      switch(err) {
+        case EINTR: // on interruption, just redo
+          break;
+        case EAGAIN:
+          return File::Wait;
+        default:
+          throw dub::Exception("Could not read (%s).", strerror(err));
+      }
     }
-    
-    luaL_addlstring(&buffer, buffer_, buffer_length_);
-
-    sz -= buffer_length_;
-    buffer_i_ = buffer_length_;
-  }                             
-  
-  luaL_pushresult(&buffer);
-  return 1;
+  }
+  return File::OK;
 }
-*/
 
 // Read a line from fd. Returns string or nil on EOF
 // function readLine()
@@ -116,36 +130,46 @@ int lk::Socket::recvBytes(lua_State *L, int sz) {
 // Return op code and string.
 LuaStackSize File::readLine(lua_State *L) {
   if (fd_ == 0) throw dub::Exception("Cannot read from a closed file.");
-  if (!(mode_ == Read)) throw dub::Exception("File mode not compatible with read operation.");
+  if (ioBusy()) throw dub::Exception("Cannot read during an async operation.");
+  if (!(mode_ == Read || mode_ == ReadWrite || mode_ == Mmap)) throw dub::Exception("File mode not compatible with read operation.");
+  flushWrites();
+
+  size_t delim_len;
+  const char *delim = luaL_optlstring(L, 2, "\n", &delim_len);
+  if (delim_len != 1) {
+    throw dub::Exception("Line delimiter must be a single character (found '%s').", delim);
+  }
+  bool strip_cr = *delim == '\n' && !lua_toboolean(L, 3);
+
+  if (mode_ == Mmap) {
+    return readMappedLine(*delim, strip_cr, L);
+  }
 
   bool has_data = buffer_i_ < buffer_length_;
   luaL_Buffer buffer;
   luaL_buffinit(L, &buffer);
 
   while (true) {
-    while (buffer_i_ < buffer_length_) {
-      char c = buffer_[buffer_i_++];
-      // printf("recvLine (%c)\n", c);
-      if (c == '\n') {
-        // found end of line
-        // push string
-        luaL_pushresult(&buffer);
-        lua_pushnumber(L, (int)File::OK);
-        return 2;
-      } else if (c != '\r') {
-        // ignore \r
-        // add char to lua buffer
-        luaL_putchar(&buffer, c);
-      }
+    if (lens::scanLine(&buffer, buffer_, &buffer_i_, buffer_length_, *delim, strip_cr)) {
+      // found end of line
+      // push string
+      luaL_pushresult(&buffer);
+      lua_pushnumber(L, (int)File::OK);
+      return 2;
     }
       
-    // Need to fill buffer
+    // Need to fill buffer. Keep a trailing '\r' until we know if it is
+    // followed by '\n'.
+    int keep = buffer_length_ - buffer_i_;
+    if (keep) buffer_[0] = buffer_[buffer_i_];
     buffer_i_      = 0;
-    buffer_length_ = 0;
+    buffer_length_ = keep;
 
     // read more data
-    buffer_length_ = ::read(fd_, buffer_, MAX_BUFF_SIZE);
-    if (buffer_length_ == 0) {
+    int sz = ::read(fd_, buffer_ + keep, MAX_BUFF_SIZE - keep);
+    if (sz == 0) {
+      // Drop the trailing '\r'.
+      buffer_length_ = 0;
       if (has_data) {
         // EOF == same as end of line
         luaL_pushresult(&buffer);
@@ -158,8 +182,7 @@ LuaStackSize File::readLine(lua_State *L) {
         lua_pushnumber(L, (int)File::End);
         return 2;
       }
-    } else if (buffer_length_ < 0) {
-      buffer_length_ = 0;
+    } else if (sz < 0) {
       int err = errno;
       switch(err) {
         case EINTR: // on interruption, just redo
@@ -172,74 +195,340 @@ LuaStackSize File::readLine(lua_State *L) {
       }
     } else {
       // All good, we have some more data to process
+      buffer_length_ += sz;
       has_data = true;
     }
   }                             
   return 0;
 }
 
+// Read `size` bytes from a regular file (less if it was truncated). Returns
+// the number of bytes read or -1 on error.
+static ssize_t readFull(int fd, char *data, size_t size) {
+  size_t got = 0;
+  while (got < size) {
+    ssize_t n = ::read(fd, data + got, size - got);
+    if (n > 0) {
+      got += n;
+    } else if (n == 0) {
+      // File was truncated.
+      break;
+    } else if (errno != EINTR) {
+      return -1;
+    }
+  }
+  return got;
+}
+
 // Read everyting until EOF is reached.
 LuaStackSize File::readAll(lua_State *L) {
-  // TODO
-  return 0;
-}
+  if (fd_ == 0) throw dub::Exception("Cannot read from a closed file.");
+  if (ioBusy()) throw dub::Exception("Cannot read during an async operation.");
+  if (!(mode_ == Read || mode_ == ReadWrite || mode_ == Mmap)) throw dub::Exception("File mode not compatible with read operation.");
+  flushWrites();
 
-/*
-LuaStackSize lk::Socket::recvAll(lua_State *L) {
-  if (socket_type_ == lk::Socket::UDP) {
+  if (mode_ == Mmap) {
+    lua_pushlstring(L, map_ + map_i_, map_size_ - map_i_);
+    map_i_ = map_size_;
+    lua_pushnumber(L, (int)File::End);
+    return 2;
+  }
 
-    struct sockaddr_in fromAddr;
-    socklen_t fromAddrLen = sizeof(fromAddr);
+  // Parts are concatenated at the end.
+  int parts = 0;
 
-    // TODO: store latest fromAddr.
-    buffer_length_ = recvfrom(socket_fd_, buffer_, MAX_BUFF_SIZE, 0,
-		 (struct sockaddr *) &fromAddr, &fromAddrLen);
-    if (buffer_length_ < 0) return 0;
+  // Data left by readLine.
+  if (buffer_i_ < buffer_length_) {
+    lua_pushlstring(L, buffer_ + buffer_i_, buffer_length_ - buffer_i_);
+    ++parts;
+    buffer_i_ = buffer_length_ = 0;
+  }
 
-    // Single packet: do not wait for disconnection.
-    lua_pushlstring(L, buffer_, buffer_length_);
-    return 1;
+  struct stat info;
+  off_t pos;
+  if (!fstat(fd_, &info) && S_ISREG(info.st_mode) &&
+      (pos = lseek(fd_, 0, SEEK_CUR)) >= 0 && info.st_size > pos) {
+    // Regular file: we know the size.
+    size_t size = info.st_size - pos;
+    if (size >= MMAP_THRESHOLD) {
+      // Map the file instead of copying it through read.
+      off_t offset = pos - pos % sysconf(_SC_PAGESIZE);
+      size_t len = size + (pos - offset);
+      void *map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd_, offset);
+      if (map == MAP_FAILED) {
+        throw dub::Exception("Could not map file (%s).", strerror(errno));
+      }
+      madvise(map, len, MADV_SEQUENTIAL);
+      lua_pushlstring(L, (char*)map + (pos - offset), size);
+      munmap(map, len);
+      lseek(fd_, pos + size, SEEK_SET);
+    } else {
+#if LUA_VERSION_NUM >= 502
+      // Read straight into the Lua string buffer.
+      luaL_Buffer content;
+      ssize_t got = readFull(fd_, luaL_buffinitsize(L, &content, size), size);
+      if (got < 0) {
+        throw dub::Exception("Could not read (%s).", strerror(errno));
+      }
+      luaL_pushresultsize(&content, got);
+#else
+      // Single allocation.
+      char *data = (char*)malloc(size);
+      if (!data) {
+        throw dub::Exception("Could not allocate %i bytes.", (int)size);
+      }
+      ssize_t got = readFull(fd_, data, size);
+      if (got < 0) {
+        int err = errno;
+        free(data);
+        throw dub::Exception("Could not read (%s).", strerror(err));
+      }
+      lua_pushlstring(L, data, got);
+      free(data);
+#endif
+    }
+    ++parts;
+  }
+
+  // Pipes or data appended since fstat.
+  luaL_Buffer buffer;
+  luaL_buffinit(L, &buffer);
+  int op;
+  do {
+    op = readInto(&buffer, MAX_READ_CHUNK);
+  } while (op == File::OK);
+  luaL_pushresult(&buffer);
+  ++parts;
+
+  lua_concat(L, parts);
+  lua_pushnumber(L, op);
+  return 2;
+}
+
+void File::map(const char *path) {
+  struct stat info;
+  if (fstat(fd_, &info)) {
+    int err = errno;
+    ::close(fd_);
+    fd_ = 0;
+    throw dub::Exception("Could not stat file '%s' (%s).", path, strerror(err));
+  }
+  map_size_ = info.st_size;
+  if (!map_size_) {
+    // Empty file: nothing to map.
+    return;
+  }
+  void *ptr = mmap(NULL, map_size_, PROT_READ, MAP_SHARED, fd_, 0);
+  if (ptr == MAP_FAILED) {
+    int err = errno;
+    ::close(fd_);
+    fd_ = 0;
+    throw dub::Exception("Could not map file '%s' (%s).", path, strerror(err));
+  }
+  map_ = (char*)ptr;
+  // Default for readLine and read.
+  madvise(map_, map_size_, MADV_SEQUENTIAL);
+}
+
+LuaStackSize File::readMappedLine(char delim, bool strip_cr, lua_State *L) {
+  if (map_i_ >= map_size_) {
+    // Reading past end of file
+    lua_pushlstring(L, "", 0);
+    lua_pushnumber(L, (int)File::End);
+    return 2;
+  }
+  const char *start = map_ + map_i_;
+  size_t avail = map_size_ - map_i_;
+  const char *end = (const char*)memchr(start, delim, avail);
+  size_t len;
+  if (end) {
+    len = end - start;
+    map_i_ += len + 1;
+    if (strip_cr && len && start[len - 1] == '\r') --len;
   } else {
-    luaL_Buffer buffer;
-    luaL_buffinit(L, &buffer);
+    // EOF == same as end of line
+    len = avail;
+    map_i_ = map_size_;
+  }
+  lua_pushlstring(L, start, len);
+  lua_pushnumber(L, (int)File::OK);
+  return 2;
+}
 
-    if (buffer_i_ < buffer_length_) {
-      luaL_addlstring(&buffer, buffer_ + buffer_i_, buffer_length_ - buffer_i_);
-    }
+LuaStackSize File::slice(double offset, double len, lua_State *L) {
+  if (mode_ != Mmap) throw dub::Exception("slice only works in Mmap mode.");
+  if (offset < 0 || len < 0) throw dub::Exception("Invalid slice (negative offset or length).");
+  if (offset >= map_size_) {
+    lua_pushlstring(L, "", 0);
+    return 1;
+  }
+  size_t start = offset;
+  size_t sz = len;
+  if (sz > map_size_ - start) sz = map_size_ - start;
+  lua_pushlstring(L, map_ + start, sz);
+  return 1;
+}
 
-    while (true) {
-      // read more data
-      buffer_length_ = ::recv(socket_fd_, buffer_, MAX_BUFF_SIZE, 0);
-      if (buffer_length_ == 0) {
-        // connection closed
-        // done
-        return 0;
-      } else if (buffer_length_ < 0) {
-        buffer_length_ = 0;
-        if (errno == EAGAIN) {
-          break;
-        } else {
-          throw dub::Exception("Could not receive (%s).", strerror(errno));
-        }
+void File::advise(int advice, double offset, double len) {
+  if (mode_ != Mmap) throw dub::Exception("advise only works in Mmap mode.");
+  if (!map_ || offset >= map_size_) return;
+  // madvise needs a page aligned address.
+  size_t start = offset;
+  start -= start % sysconf(_SC_PAGESIZE);
+  size_t sz = len > 0 ? (size_t)(offset + len) - start : map_size_ - start;
+  if (sz > map_size_ - start) sz = map_size_ - start;
+  if (madvise(map_ + start, sz, advice)) {
+    throw dub::Exception("Could not advise (%s).", strerror(errno));
+  }
+}
+
+// local header, body = f:readAt(offset, 16, 112)
+LuaStackSize File::readAt(double offset, lua_State *L) {
+  if (fd_ == 0) throw dub::Exception("Cannot read from a closed file.");
+  if (ioBusy()) throw dub::Exception("Cannot read during an async operation.");
+  if (!(mode_ == Read || mode_ == ReadWrite || mode_ == Mmap)) throw dub::Exception("File mode not compatible with read operation.");
+  if (offset < 0) throw dub::Exception("Invalid offset (negative).");
+  flushWrites();
+
+  int top = lua_gettop(L);
+  if (top < 3) throw dub::Exception("Missing length.");
+  size_t total = 0;
+  for (int i = 3; i <= top; ++i) {
+    double len = dub::checknumber(L, i);
+    if (len < 0) throw dub::Exception("Invalid length (negative).");
+    total += (size_t)len;
+  }
+
+  const char *data;
+  size_t got = 0;
+  if (mode_ == Mmap) {
+    data = map_;
+    if (offset < map_size_) {
+      data += (size_t)offset;
+      got = map_size_ - (size_t)offset;
+      if (got > total) got = total;
+    }
+  } else {
+    // Temporary buffer owned by Lua (released even if pushing fails).
+    char *buf = (char*)lua_newuserdata(L, total);
+    data = buf;
+    off_t pos = offset;
+    while (got < total) {
+      ssize_t n = ::pread(fd_, buf + got, total - got, pos + got);
+      if (n > 0) {
+        got += n;
+      } else if (n == 0) {
+        break;
+      } else if (errno != EINTR) {
+        throw dub::Exception("Could not read (%s).", strerror(errno));
       }
-      luaL_addlstring(&buffer, buffer_, buffer_length_);
-    }                             
-    
-    luaL_pushresult(&buffer);
+    }
+  }
+
+  if (got == 0 && total > 0) {
+    lua_pushnil(L);
     return 1;
   }
+
+  for (int i = 3; i <= top; ++i) {
+    size_t len = lua_tonumber(L, i);
+    if (len > got) len = got;
+    lua_pushlstring(L, data, len);
+    data += len;
+    got  -= len;
+  }
+  return top - 2;
 }
-*/
 
+// Largest number of strings passed to one pwritev call.
+#define WRITE_AT_MAX_IOV 64
+
+LuaStackSize File::writeAt(double offset, lua_State *L) {
+  if (fd_ == 0) throw dub::Exception("Cannot write to a closed file.");
+  if (ioBusy()) throw dub::Exception("Cannot write during an async operation.");
+  if (!(mode_ == Write || mode_ == ReadWrite)) throw dub::Exception("File mode not compatible with write operation.");
+  if (offset < 0) throw dub::Exception("Invalid offset (negative).");
+  // Older buffered data must not overwrite this write later.
+  flushWrites();
+
+  int top = lua_gettop(L);
+  off_t pos = offset;
+  size_t total = 0;
+  // Current string and bytes of this string already written.
+  int i = 3;
+  size_t done = 0;
+
+  while (i <= top) {
+    struct iovec iov[WRITE_AT_MAX_IOV];
+    int cnt = 0;
+    for (int j = i; j <= top && cnt < WRITE_AT_MAX_IOV; ++j, ++cnt) {
+      size_t sz;
+      const char *str = dub::checklstring(L, j, &sz);
+      if (j == i) {
+        str += done;
+        sz  -= done;
+      }
+      iov[cnt].iov_base = (void*)str;
+      iov[cnt].iov_len  = sz;
+    }
+
+#ifdef __APPLE__
+    // pwritev is missing before macOS 11.
+    ssize_t n = ::pwrite(fd_, iov[0].iov_base, iov[0].iov_len, pos + total);
+#else
+    ssize_t n = ::pwritev(fd_, iov, cnt, pos + total);
+#endif
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      throw dub::Exception("Could not write (%s).", strerror(errno));
+    }
+    total += n;
+
+    // Skip fully written strings.
+    size_t left = n;
+    for (int k = 0; k < cnt; ++k) {
+      if (left < iov[k].iov_len) {
+        done = (k == 0 ? done : 0) + left;
+        break;
+      }
+      left -= iov[k].iov_len;
+      ++i;
+      done = 0;
+    }
+  }
+
+  lua_pushnumber(L, total);
+  return 1;
+}
 
 // Return op and written size
 LuaStackSize File::write(lua_State *L) {
   if (fd_ == 0) throw dub::Exception("Cannot write to a closed file.");
-  if (!(mode_ == Write || mode_ == Append)) throw dub::Exception("File mode not compatible with write operation.");
+  if (!(mode_ == Write || mode_ == Append || mode_ == ReadWrite)) throw dub::Exception("File mode not compatible with write operation.");
 
   size_t sz;
   const char *str = dub::checklstring(L, 2, &sz);
 
+  if (ioBusy()) {
+    // The async write holds older data (or the async read uses the file
+    // position): keep buffering until it is done.
+    wbuf_.append(str, sz);
+    lua_pushnumber(L, sz);
+    lua_pushnumber(L, (int)File::OK);
+    return 2;
+  }
+
+  if (!wbuf_.empty() || (wbuf_size_ && sz < wbuf_size_)) {
+    // Coalesce. Large writes with an empty buffer are not copied.
+    wbuf_.append(str, sz);
+    int op = wbuf_.size() >= wbuf_size_ ? flush() : (int)File::OK;
+    // All the data is accepted: on Wait, the caller waits for the fd and
+    // writes an empty string to retry the flush.
+    lua_pushnumber(L, sz);
+    lua_pushnumber(L, op);
+    return 2;
+  }
+
   ssize_t todo = sz;
 
   for (ssize_t n; todo; ) {
@@ -270,3 +559,213 @@ LuaStackSize File::write(lua_State *L) {
     return 2;
   }
 }
+
+int File::flush() {
+  if (wbuf_.empty()) return File::OK;
+  if (fd_ == 0) throw dub::Exception("Cannot write to a closed file.");
+  if (ioBusy()) throw dub::Exception("Cannot flush during an async read or write.");
+
+  size_t done = 0;
+  size_t todo = wbuf_.size();
+  while (done < todo) {
+    ssize_t n = ::write(fd_, wbuf_.data() + done, todo - done);
+    if (n >= 0) {
+      done += n;
+    } else if (errno == EAGAIN) {
+      break;
+    } else if (errno != EINTR) {
+      int err = errno;
+      wbuf_.erase(0, done);
+      throw dub::Exception("Could not write (%s).", strerror(err));
+    }
+  }
+  wbuf_.erase(0, done);
+  return wbuf_.empty() ? File::OK : File::Wait;
+}
+
+void File::flushWrites() {
+  if (flush() == File::Wait) {
+    throw dub::Exception("Cannot flush write buffer (write would block).");
+  }
+}
+
+void File::flushOnClose() {
+  try {
+    while (flush() == File::Wait) {
+      struct pollfd pfd = { fd_, POLLOUT, 0 };
+      ::poll(&pfd, 1, -1);
+    }
+  } catch (std::exception &e) {
+    // Nothing to report to in a destructor.
+  }
+  wbuf_.clear();
+}
+
+// Async operations: the blocking call runs in a lens::Pool thread and the Lua
+// thread yields on the job fd.
+//
+// f:startRead(sz)
+// while not f:ioDone() do
+//   yield('read', f:ioFd(), lens.Poller.OneShot)
+// end
+// local data = f:ioResult()
+void File::IOJob::run() {
+  error = 0;
+  switch(op) {
+    case ReadOp: {
+      // data may already contain bytes left by readLine.
+      size_t start = data.size();
+      size_t got = 0;
+      try {
+        data.resize(start + size);
+      } catch (std::bad_alloc &e) {
+        // Do not let the exception end the pool thread.
+        error = ENOMEM;
+        break;
+      }
+      while (got < size) {
+        ssize_t n = ::read(file_fd, &data[start + got], size - got);
+        if (n > 0) {
+          got += n;
+        } else if (n == 0) {
+          break;
+        } else if (errno != EINTR) {
+          // EAGAIN on a non-blocking pipe: return what we have.
+          if (errno != EAGAIN) error = errno;
+          break;
+        }
+      }
+      data.resize(start + got);
+      break;
+    }
+    default: {
+      // WriteOp (data is empty for sync operations).
+      const char *str = data.data();
+      size_t todo = data.size();
+      written = 0;
+      while (todo) {
+        ssize_t n = ::write(file_fd, str + written, todo);
+        if (n >= 0) {
+          written += n;
+          todo -= n;
+        } else if (errno == EAGAIN) {
+          struct pollfd pfd = { file_fd, POLLOUT, 0 };
+          ::poll(&pfd, 1, -1);
+        } else if (errno != EINTR) {
+          error = errno;
+          return;
+        }
+      }
+      if (op == SyncOp) {
+        if (::fsync(file_fd)) error = errno;
+      } else if (op == DataSyncOp) {
+#ifdef __linux__
+        if (::fdatasync(file_fd)) error = errno;
+#else
+        if (::fsync(file_fd)) error = errno;
+#endif
+      }
+    }
+  }
+}
+
+File::IOJob *File::ioJob(int op) {
+  if (fd_ == 0) throw dub::Exception("Cannot start operation on a closed file.");
+  if (io_pending_) throw dub::Exception("An async operation is already running.");
+  if (io_) {
+    io_->reset();
+  } else {
+    io_ = new IOJob();
+  }
+  io_->file_fd = fd_;
+  io_->op = op;
+  io_->size = 0;
+  io_->written = 0;
+  io_->error = 0;
+  io_->data.clear();
+  return io_;
+}
+
+void File::startRead(double sz) {
+  if (!(mode_ == Read || mode_ == ReadWrite)) throw dub::Exception("File mode not compatible with read operation.");
+  IOJob *job = ioJob(IOJob::ReadOp);
+  flushWrites();
+
+  // Data left by readLine.
+  size_t avail = buffer_length_ - buffer_i_;
+  size_t size = sz;
+  if (avail) {
+    if (avail > size) avail = size;
+    job->data.assign(buffer_ + buffer_i_, avail);
+    buffer_i_ += avail;
+    size -= avail;
+  }
+  job->size = size;
+
+  Pool::submit(job, Pool::DiskQueue);
+  io_pending_ = true;
+}
+
+void File::startWrite(lua_State *L) {
+  if (!(mode_ == Write || mode_ == Append || mode_ == ReadWrite)) throw dub::Exception("File mode not compatible with write operation.");
+  size_t sz;
+  const char *str = dub::checklstring(L, 2, &sz);
+  IOJob *job = ioJob(IOJob::WriteOp);
+  // Buffered data goes first.
+  job->data.swap(wbuf_);
+  job->size = job->data.size();
+  job->data.append(str, sz);
+  Pool::submit(job, Pool::DiskQueue);
+  io_pending_ = true;
+}
+
+void File::startSync(bool data_only) {
+  IOJob *job = ioJob(data_only ? IOJob::DataSyncOp : IOJob::SyncOp);
+  // Write buffered data here: writes made while the sync runs cannot pass it.
+  if (flush() == File::Wait) {
+    throw dub::Exception("Cannot sync (write would block).");
+  }
+  Pool::submit(job, Pool::DiskQueue);
+  io_pending_ = true;
+}
+
+LuaStackSize File::ioResult(lua_State *L) {
+  if (!io_pending_) throw dub::Exception("No async operation started.");
+  if (!io_->done()) throw dub::Exception("Async operation not done.");
+  io_pending_ = false;
+
+  if (io_->error) {
+    throw dub::Exception("Could not %s (%s).",
+        io_->op == IOJob::ReadOp ? "read" : io_->op == IOJob::WriteOp ? "write" : "sync",
+        strerror(io_->error));
+  }
+
+  switch(io_->op) {
+    case IOJob::ReadOp:
+      if (io_->data.empty()) {
+        lua_pushnil(L);
+      } else {
+        lua_pushlstring(L, io_->data.data(), io_->data.size());
+      }
+      break;
+    case IOJob::WriteOp:
+      lua_pushnumber(L, io_->written - io_->size);
+      break;
+    default:
+      lua_pushboolean(L, true);
+  }
+
+  if (io_->data.capacity() > MAX_READ_CHUNK) {
+    // Do not keep large buffers around.
+    std::string().swap(io_->data);
+  }
+  return 1;
+}
+
+void File::waitIO() {
+  struct pollfd pfd = { io_->fd(), POLLIN, 0 };
+  while (!io_->done()) {
+    ::poll(&pfd, 1, -1);
+  }
+  io_pending_ = false;
+}
@@ -7,3 +7,169 @@ void Poller::runGUI(double wake_at, lua_State *L) {
   if (gui_running_) return;
   throw dub::Exception("Poller::runGUI is not implemented on linux yet...");
 }
+
+#ifdef LUBYK_POLLER_EPOLL
+// ============================================== epoll
+void Poller::linkFd(int idx, int fd) {
+  if (fd < 0) {
+    throw dub::Exception("Invalid file descriptor '%i'.", fd);
+  }
+  if (fd >= fds_size_) {
+    // grow fd table
+    int size = fds_size_ ? fds_size_ : 32;
+    while (size <= fd) size *= 2;
+    FdState *ptr = (FdState*)realloc(fds_, size * sizeof(FdState));
+    if (!ptr) {
+      throw dub::Exception("Could not reallocate %i file descriptors.", size);
+    }
+    fds_ = ptr;
+    // head = -1, events = 0
+    for(int i = fds_size_; i < size; ++i) {
+      fds_[i].head   = -1;
+      fds_[i].events = 0;
+      fds_[i].added  = false;
+    }
+    fds_size_ = size;
+  }
+  idx_next_[idx] = fds_[fd].head;
+  fds_[fd].head  = idx;
+  setEPollEvent(fd);
+}
+
+void Poller::unlinkFd(int idx, int fd) {
+  if (fd < 0 || fd >= fds_size_) return;
+  int *ptr = &fds_[fd].head;
+  while (*ptr != -1) {
+    if (*ptr == idx) {
+      *ptr = idx_next_[idx];
+      break;
+    }
+    ptr = idx_next_ + *ptr;
+  }
+  idx_next_[idx] = -1;
+  setEPollEvent(fd);
+}
+
+int Poller::epollWait(double wake_at, double timeout) {
+  if (timer_fd_ == -1 || timeout == 0) {
+    // epoll expects milliseconds
+    // negative timeout == wait forever
+    return ::epoll_wait(epoll_, events_data_, MAX_REVENT_COUNT, timeout * 1000);
+  }
+
+  if (timeout < 0) {
+    wake_at = -1;
+  }
+
+  if (wake_at != timer_at_) {
+    // Arm (or disarm) timer. This also clears previous expirations.
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    if (wake_at >= 0) {
+      // lens::elapsed uses CLOCK_MONOTONIC: wake_at is an absolute time.
+      spec.it_value.tv_sec  = wake_at;
+      spec.it_value.tv_nsec = (wake_at - spec.it_value.tv_sec) * 1000000000;
+      if (!spec.it_value.tv_sec && !spec.it_value.tv_nsec) {
+        // 0 disarms the timer
+        spec.it_value.tv_nsec = 1;
+      }
+    }
+    if (timerfd_settime(timer_fd_, TFD_TIMER_ABSTIME, &spec, NULL)) {
+      return -1;
+    }
+    timer_at_ = wake_at;
+  }
+
+  int count = ::epoll_wait(epoll_, events_data_, MAX_REVENT_COUNT, -1);
+  for(int i = 0; i < count; ++i) {
+    if (events_data_[i].data.fd == timer_fd_) {
+      // Timer fired: consume expiration and remove event.
+      uint64_t expirations;
+      if (::read(timer_fd_, &expirations, sizeof(expirations)) < 0) {
+        // EAGAIN: already consumed
+      }
+      timer_at_ = -1;
+      events_data_[i] = events_data_[--count];
+      break;
+    }
+  }
+  return count;
+}
+
+void Poller::setEPollEvent(int fd) {
+  FdState *state = fds_ + fd;
+
+  // Union of events from all armed items watching this fd. The fd is edge
+  // triggered (or one-shot) only if all items request it.
+  int events = 0;
+  int mode   = ModeMask;
+  for(int idx = state->head; idx != -1; idx = idx_next_[idx]) {
+    Pollitem *item = pollitems_ + idx_to_pos_[idx];
+    if (item->mode & Fired) continue;
+    events |= item->events;
+    mode   &= item->mode;
+  }
+
+  if (state->events == -1) {
+    // Not in epoll set.
+    if (events) return;
+    // No more items on this fd.
+    --ready_count_;
+    state->events = 0;
+    return;
+  }
+
+  if (events) {
+    if (mode & Edge)    events |= EPOLLET;
+    if (mode & OneShot) events |= EPOLLONESHOT;
+  }
+
+  if (events == state->events) return;
+
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  // POLLIN == EPOLLIN, POLLOUT == EPOLLOUT
+  ev.events  = events;
+  ev.data.fd = fd;
+
+  int res;
+  if (!events && state->head != -1) {
+    // Only fired OneShot items: disarm but keep the fd in the set so that
+    // re-arming is a single MOD.
+    res = ::epoll_ctl(epoll_, EPOLL_CTL_MOD, fd, &ev);
+    if (res < 0 && (errno == EBADF || errno == ENOENT)) {
+      res = 0;
+      state->added = false;
+    }
+  } else if (!events) {
+    res = ::epoll_ctl(epoll_, EPOLL_CTL_DEL, fd, &ev);
+    // A closed fd is automatically removed from the epoll set.
+    if (res < 0 && (errno == EBADF || errno == ENOENT)) res = 0;
+    state->added = false;
+  } else if (!state->added) {
+    res = ::epoll_ctl(epoll_, EPOLL_CTL_ADD, fd, &ev);
+    if (res < 0 && errno == EEXIST) {
+      res = ::epoll_ctl(epoll_, EPOLL_CTL_MOD, fd, &ev);
+    }
+  } else {
+    res = ::epoll_ctl(epoll_, EPOLL_CTL_MOD, fd, &ev);
+    if (res < 0 && errno == ENOENT) {
+      // fd was closed and reopened.
+      res = ::epoll_ctl(epoll_, EPOLL_CTL_ADD, fd, &ev);
+    }
+  }
+
+  if (res < 0) {
+    if (errno == EPERM) {
+      // Regular files and directories do not support epoll. They are always
+      // ready for ::poll() so we keep the same behavior.
+      state->events = -1;
+      ++ready_count_;
+      return;
+    }
+    throw dub::Exception("An error occured during epoll_ctl (%s).", strerror(errno));
+  }
+  if (events) state->added = true;
+  state->events = events;
+}
+#endif // LUBYK_POLLER_EPOLL
@@ -0,0 +1,624 @@
+/*
+  ==============================================================================
+
+   This file is part of the LUBYK project (http://lubyk.org)
+   Copyright (c) 2007-2014 by Gaspard Bucher (http://teti.ch).
+
+  ------------------------------------------------------------------------------
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+
+  ==============================================================================
+*/
+#include "lens/Poller.h"
+
+#ifdef LUBYK_POLLER_URING
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>    // mmap
+#include <sys/syscall.h> // syscall
+#include <sys/socket.h>  // MSG_NOSIGNAL
+#include <endian.h>      // __BYTE_ORDER
+
+#ifndef __NR_io_uring_setup
+#define __NR_io_uring_setup 425
+#endif
+#ifndef __NR_io_uring_enter
+#define __NR_io_uring_enter 426
+#endif
+#ifndef IORING_FEAT_RSRC_TAGS
+#define IORING_FEAT_RSRC_TAGS (1U << 10)
+#endif
+
+// user_data for requests without interesting completion (poll remove).
+#define URING_IGNORE 0xffffffffffffffffULL
+
+using namespace lens;
+
+/** io_uring rings and per item poll state.
+ *
+ * Each item is watched with a one shot IORING_OP_POLL_ADD. When the poll
+ * completes, the item is re-armed on the next wait so that we keep the same
+ * level-triggered behavior as epoll. Edge items use a multishot poll
+ * (IORING_POLL_ADD_MULTI) which stays armed and completes on each new edge.
+ * OneShot items are only re-armed by Poller::modify. All changes (add,
+ * modify, remove) are queued in the submission ring and sent with the next
+ * wait in a single io_uring_enter call.
+ *
+ * An item can also run a recv or send instead of the poll (see
+ * Poller::submitRecv). The data lives in a per idx buffer owned by the
+ * poller. When such an operation is cancelled, the kernel can still use the
+ * buffer until the cancelled request completes: the buffer is then kept in
+ * the orphans list until its completion is reaped.
+ */
+struct Poller::URingState {
+  enum State {
+    Idle = 0,
+    // POLL_ADD (or operation) to submit on next wait.
+    Pending,
+    // POLL_ADD (or operation) submitted.
+    Armed,
+  };
+
+  /** Completion I/O running on an item instead of POLL_ADD.
+   */
+  struct Op {
+    // NoOp, RecvOp or SendOp.
+    char type;
+    // Type of the completed operation (NoOp until it completes).
+    char done;
+    // Bytes received or sent, -errno on failure.
+    int result;
+    // Bytes to receive or to send.
+    size_t len;
+    char *buf;
+    size_t buf_size;
+  };
+
+  /** Buffer of a cancelled operation still in use by the kernel.
+   */
+  struct Orphan {
+    unsigned long long user_data;
+    char *buf;
+    Orphan *next;
+  };
+
+  int fd;
+
+  // Submission ring
+  unsigned *sq_head;
+  unsigned *sq_tail;
+  unsigned *sq_mask;
+  unsigned *sq_array;
+  unsigned sq_entries;
+  struct io_uring_sqe *sqes;
+
+  // Completion ring
+  unsigned *cq_head;
+  unsigned *cq_tail;
+  unsigned *cq_mask;
+  struct io_uring_cqe *cqes;
+
+  // Mapped memory
+  void *sq_ptr;
+  size_t sq_size;
+  void *cq_ptr;
+  size_t cq_size;
+  size_t sqes_size;
+
+  // Entries queued but not yet submitted.
+  unsigned to_submit;
+
+  // Per idx poll state (see State).
+  char *state;
+
+  // Per idx generation used to ignore completions from cancelled polls.
+  unsigned *gen;
+
+  // Per idx completion I/O.
+  Op *ops;
+
+  // Buffers waiting for the completion of a cancelled operation.
+  Orphan *orphans;
+
+  // Size of state and gen arrays.
+  int idx_size;
+
+  // Items waiting for a POLL_ADD.
+  int *pending;
+  int pending_count;
+  int pending_size;
+
+  // Ready items collected during last wait.
+  int events[MAX_REVENT_COUNT];
+
+  // Poll revents of the ready items.
+  int revents[MAX_REVENT_COUNT];
+
+  int enter(unsigned to_submit, unsigned min_complete, unsigned flags,
+            void *arg, size_t argsz) {
+    return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, argsz);
+  }
+
+  /** Submit queued entries without waiting.
+   */
+  void flush() {
+    while (to_submit) {
+      int res = enter(to_submit, 0, 0, NULL, 0);
+      if (res < 0) {
+        if (errno == EINTR) continue;
+        throw dub::Exception("An error occured during io_uring_enter (%s).", strerror(errno));
+      }
+      to_submit -= res;
+    }
+  }
+
+  /** Queue a new submission entry.
+   */
+  void push(int opcode, int sfd, unsigned op_flags, unsigned len,
+            unsigned long long addr, unsigned long long user_data) {
+    unsigned tail = *sq_tail;
+    if (tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) >= sq_entries) {
+      // ring full
+      flush();
+    }
+    unsigned i = tail & *sq_mask;
+    struct io_uring_sqe *sqe = sqes + i;
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    sqe->opcode    = opcode;
+    sqe->fd        = sfd;
+    sqe->len       = len;
+    sqe->addr      = addr;
+    sqe->user_data = user_data;
+#if __BYTE_ORDER == __BIG_ENDIAN
+    if (opcode == IORING_OP_POLL_ADD) {
+      op_flags = (op_flags << 16) | (op_flags >> 16);
+    }
+#endif
+    // poll events or msg_flags (recv, send)
+    sqe->poll32_events = op_flags;
+    sq_array[i] = i;
+    __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ++to_submit;
+  }
+
+  /** Mark idx for a POLL_ADD on next wait.
+   */
+  void queue(int idx) {
+    if (state[idx] == Pending) return;
+    if (pending_count >= pending_size) {
+      int size = pending_size * 2;
+      int *ptr = (int*)realloc(pending, size * sizeof(int));
+      if (!ptr) {
+        throw dub::Exception("Could not reallocate %i pending polls.", size);
+      }
+      pending      = ptr;
+      pending_size = size;
+    }
+    state[idx] = Pending;
+    pending[pending_count++] = idx;
+  }
+
+  /** Cancel the submitted poll or operation for idx.
+   */
+  void cancel(int idx) {
+    Op *op = ops + idx;
+    if (state[idx] == Armed) {
+      if (op->type) {
+        push(IORING_OP_ASYNC_CANCEL, -1, 0, 0, userData(idx), URING_IGNORE);
+        orphan(userData(idx), op);
+      } else {
+        push(IORING_OP_POLL_REMOVE, -1, 0, 0, userData(idx), URING_IGNORE);
+      }
+    }
+    op->type = NoOp;
+    op->done = NoOp;
+    // Ignore completions from previous polls.
+    ++gen[idx];
+    state[idx] = Idle;
+  }
+
+  /** Keep the buffer of a cancelled operation until its completion.
+   */
+  void orphan(unsigned long long user_data, Op *op) {
+    Orphan *o = (Orphan*)malloc(sizeof(Orphan));
+    if (!o) {
+      // Leak the buffer: the kernel may still write to it.
+      op->buf      = NULL;
+      op->buf_size = 0;
+      return;
+    }
+    o->user_data = user_data;
+    o->buf       = op->buf;
+    o->next      = orphans;
+    orphans      = o;
+    op->buf      = NULL;
+    op->buf_size = 0;
+  }
+
+  /** Release the buffer of a cancelled operation once it completed.
+   */
+  void adopt(unsigned long long user_data) {
+    for(Orphan **o = &orphans; *o; o = &(*o)->next) {
+      if ((*o)->user_data == user_data) {
+        Orphan *done = *o;
+        *o = done->next;
+        free(done->buf);
+        free(done);
+        return;
+      }
+    }
+  }
+
+  /** Make sure the buffer of idx can hold len bytes.
+   */
+  void reserve(int idx, size_t len) {
+    Op *op = ops + idx;
+    if (op->buf_size >= len) return;
+    char *buf = (char*)realloc(op->buf, len);
+    if (!buf) {
+      throw dub::Exception("Could not allocate I/O buffer (%i bytes).", (int)len);
+    }
+    op->buf      = buf;
+    op->buf_size = len;
+  }
+
+  unsigned long long userData(int idx) {
+    return ((unsigned long long)gen[idx] << 32) | (unsigned)idx;
+  }
+
+  /** Cancel running operations and wait until the kernel is done with their
+   * buffers.
+   */
+  void drain() {
+    for(int idx = 0; idx < idx_size; ++idx) {
+      if (ops[idx].type && state[idx] == Armed) cancel(idx);
+    }
+    while (orphans) {
+      int res = enter(to_submit, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+      if (res < 0) {
+        if (errno == EINTR) continue;
+        // Leak the buffers.
+        break;
+      }
+      to_submit -= (unsigned)res <= to_submit ? res : to_submit;
+      unsigned head = *cq_head;
+      unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+      for(; head != tail; ++head) {
+        adopt(cqes[head & *cq_mask].user_data);
+      }
+      __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+    }
+  }
+
+  void release() {
+    if (ops && sqes) drain();
+    if (ops) {
+      for(int idx = 0; idx < idx_size; ++idx) {
+        if (ops[idx].buf) free(ops[idx].buf);
+      }
+      free(ops);
+    }
+    while (orphans) {
+      Orphan *o = orphans;
+      orphans = o->next;
+      free(o);
+    }
+    if (sqes)    munmap(sqes, sqes_size);
+    if (cq_ptr && cq_ptr != sq_ptr) munmap(cq_ptr, cq_size);
+    if (sq_ptr)  munmap(sq_ptr, sq_size);
+    if (state)   free(state);
+    if (gen)     free(gen);
+    if (pending) free(pending);
+    ::close(fd);
+    free(this);
+  }
+};
+
+bool Poller::setupURing(unsigned entries) {
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+
+  int fd = syscall(__NR_io_uring_setup, entries, &params);
+  if (fd < 0) return false;
+
+  // We need timeouts in io_uring_enter (5.11), no dropped completions and
+  // multishot poll (5.13, which has no feature flag: RSRC_TAGS came with it).
+  if (!(params.features & IORING_FEAT_EXT_ARG) ||
+      !(params.features & IORING_FEAT_NODROP) ||
+      !(params.features & IORING_FEAT_RSRC_TAGS)) {
+    ::close(fd);
+    return false;
+  }
+
+  URingState *u = (URingState*)calloc(1, sizeof(URingState));
+  if (!u) {
+    ::close(fd);
+    return false;
+  }
+  u->fd = fd;
+
+  u->sq_size   = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  u->cq_size   = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  u->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    if (u->cq_size > u->sq_size) u->sq_size = u->cq_size;
+    u->cq_size = u->sq_size;
+  }
+
+  u->sq_ptr = mmap(NULL, u->sq_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  if (u->sq_ptr == MAP_FAILED) {
+    u->sq_ptr = NULL;
+    u->release();
+    return false;
+  }
+
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    u->cq_ptr = u->sq_ptr;
+  } else {
+    u->cq_ptr = mmap(NULL, u->cq_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    if (u->cq_ptr == MAP_FAILED) {
+      u->cq_ptr = NULL;
+      u->release();
+      return false;
+    }
+  }
+
+  u->sqes = (struct io_uring_sqe*)mmap(NULL, u->sqes_size, PROT_READ | PROT_WRITE,
+                                       MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+  if (u->sqes == MAP_FAILED) {
+    u->sqes = NULL;
+    u->release();
+    return false;
+  }
+
+  char *sq = (char*)u->sq_ptr;
+  u->sq_head    = (unsigned*)(sq + params.sq_off.head);
+  u->sq_tail    = (unsigned*)(sq + params.sq_off.tail);
+  u->sq_mask    = (unsigned*)(sq + params.sq_off.ring_mask);
+  u->sq_array   = (unsigned*)(sq + params.sq_off.array);
+  u->sq_entries = params.sq_entries;
+
+  char *cq = (char*)u->cq_ptr;
+  u->cq_head = (unsigned*)(cq + params.cq_off.head);
+  u->cq_tail = (unsigned*)(cq + params.cq_off.tail);
+  u->cq_mask = (unsigned*)(cq + params.cq_off.ring_mask);
+  u->cqes    = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+
+  u->idx_size     = idx_size_;
+  u->state        = (char*)calloc(u->idx_size, sizeof(char));
+  u->gen          = (unsigned*)calloc(u->idx_size, sizeof(unsigned));
+  u->ops          = (URingState::Op*)calloc(u->idx_size, sizeof(URingState::Op));
+  u->pending_size = pollitems_size_;
+  u->pending      = (int*)malloc(u->pending_size * sizeof(int));
+  if (!u->state || !u->gen || !u->ops || !u->pending) {
+    u->release();
+    return false;
+  }
+
+  uring_ = u;
+  return true;
+}
+
+void Poller::closeURing() {
+  uring_->release();
+  uring_ = NULL;
+}
+
+int Poller::uringWait(double timeout) {
+  URingState *u = uring_;
+
+  // Queue new polls and re-arm polls that fired during last wait.
+  for(int i = 0; i < u->pending_count; ++i) {
+    int idx = u->pending[i];
+    if (u->state[idx] != URingState::Pending) continue;
+    Pollitem *item = pollitems_ + idx_to_pos_[idx];
+    URingState::Op *op = u->ops + idx;
+    if (op->type == RecvOp) {
+      u->push(IORING_OP_RECV, item->fd, 0, op->len,
+              (unsigned long long)(uintptr_t)op->buf, u->userData(idx));
+    } else if (op->type == SendOp) {
+      u->push(IORING_OP_SEND, item->fd, MSG_NOSIGNAL, op->len,
+              (unsigned long long)(uintptr_t)op->buf, u->userData(idx));
+    } else {
+      unsigned flags = (item->mode & ModeMask) == Edge ? IORING_POLL_ADD_MULTI : 0;
+      u->push(IORING_OP_POLL_ADD, item->fd, item->events, flags, 0, u->userData(idx));
+    }
+    u->state[idx] = URingState::Armed;
+  }
+  u->pending_count = 0;
+
+  struct __kernel_timespec ts;
+  struct io_uring_getevents_arg arg;
+  memset(&arg, 0, sizeof(arg));
+
+  unsigned min_complete = 0;
+  unsigned flags = IORING_ENTER_EXT_ARG;
+  if (timeout != 0) {
+    min_complete = 1;
+    flags |= IORING_ENTER_GETEVENTS;
+    if (timeout > 0) {
+      ts.tv_sec  = (long long)timeout;
+      ts.tv_nsec = (long long)((timeout - ts.tv_sec) * 1000000000);
+      arg.ts = (unsigned long long)(uintptr_t)&ts;
+    }
+  }
+
+  int res = u->enter(u->to_submit, min_complete, flags, &arg, sizeof(arg));
+  if (res < 0) {
+    switch(errno) {
+      case ETIME:  // timed out
+      case EAGAIN: // completion ring busy: reap what we have
+      case EBUSY:
+        break;
+      default:
+        return -1;
+    }
+  } else if ((unsigned)res <= u->to_submit) {
+    u->to_submit -= res;
+  }
+
+  // Reap completions
+  int count = 0;
+  unsigned head = *u->cq_head;
+  unsigned tail = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+  while (head != tail && count < MAX_REVENT_COUNT) {
+    struct io_uring_cqe *cqe = u->cqes + (head & *u->cq_mask);
+    unsigned long long user_data = cqe->user_data;
+    ++head;
+    if (user_data == URING_IGNORE) continue;
+
+    int idx      = (int)(user_data & 0xffffffff);
+    unsigned gen = (unsigned)(user_data >> 32);
+    if (idx >= u->idx_size || u->gen[idx] != gen ||
+        u->state[idx] != URingState::Armed) {
+      // cancelled or removed
+      if (u->orphans) u->adopt(user_data);
+      continue;
+    }
+    Pollitem *item = pollitems_ + idx_to_pos_[idx];
+    URingState::Op *op = u->ops + idx;
+    if (op->type) {
+      // Operation done: report as a OneShot event until the next submit.
+      op->result = cqe->res;
+      op->done   = op->type;
+      op->type   = NoOp;
+      u->state[idx] = URingState::Idle;
+      item->mode |= Fired;
+      if (cqe->res < 0) {
+        u->revents[count] = POLLERR;
+      } else {
+        u->revents[count] = op->done == RecvOp ? POLLIN : POLLOUT;
+      }
+      u->events[count++] = idx;
+      continue;
+    }
+    if (cqe->flags & IORING_CQE_F_MORE) {
+      // Multishot poll (Edge) still armed.
+    } else if (item->mode & OneShot) {
+      // Wait for modify() to re-arm.
+      u->state[idx] = URingState::Idle;
+      item->mode |= Fired;
+    } else {
+      // Level-triggered or ended multishot: re-arm on next wait.
+      u->state[idx] = URingState::Idle;
+      u->queue(idx);
+      if (cqe->res == -ECANCELED) {
+        // Multishot poll ended by the kernel: not an event.
+        continue;
+      }
+    }
+    // res is the poll mask or -errno
+    u->revents[count] = cqe->res < 0 ? POLLERR : cqe->res;
+    u->events[count++] = idx;
+  }
+  __atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+  return count;
+}
+
+int Poller::uringEvent(int i, int *revents) {
+  *revents = uring_->revents[i];
+  return uring_->events[i];
+}
+
+void Poller::uringAdd(int idx) {
+  URingState *u = uring_;
+  if (idx >= u->idx_size) {
+    // grow per idx state
+    int size = idx_size_;
+    char *state = (char*)realloc(u->state, size * sizeof(char));
+    if (!state) {
+      throw dub::Exception("Could not reallocate %i pollitems.", size);
+    }
+    u->state = state;
+    unsigned *gen = (unsigned*)realloc(u->gen, size * sizeof(unsigned));
+    if (!gen) {
+      throw dub::Exception("Could not reallocate %i pollitems.", size);
+    }
+    u->gen = gen;
+    URingState::Op *ops = (URingState::Op*)realloc(u->ops, size * sizeof(URingState::Op));
+    if (!ops) {
+      throw dub::Exception("Could not reallocate %i pollitems.", size);
+    }
+    u->ops = ops;
+    memset(u->state + u->idx_size, 0, (size - u->idx_size) * sizeof(char));
+    memset(u->gen   + u->idx_size, 0, (size - u->idx_size) * sizeof(unsigned));
+    memset(u->ops   + u->idx_size, 0, (size - u->idx_size) * sizeof(URingState::Op));
+    u->idx_size = size;
+  }
+  ++u->gen[idx];
+  u->state[idx] = URingState::Idle;
+  u->queue(idx);
+}
+
+void Poller::uringModify(int idx) {
+  URingState *u = uring_;
+  if (u->state[idx] == URingState::Pending) {
+    // Not submitted yet: POLL_ADD will use new item values.
+    return;
+  }
+  u->cancel(idx);
+  u->queue(idx);
+}
+
+void Poller::uringRemove(int idx) {
+  URingState *u = uring_;
+  u->cancel(idx);
+  URingState::Op *op = u->ops + idx;
+  if (op->buf) {
+    // Do not keep buffers for free idx.
+    free(op->buf);
+    op->buf      = NULL;
+    op->buf_size = 0;
+  }
+}
+
+void Poller::uringSubmit(int idx, int type, const char *data, size_t len) {
+  URingState *u = uring_;
+  if (u->state[idx] == URingState::Armed) {
+    // Replace the current poll.
+    u->cancel(idx);
+  }
+  URingState::Op *op = u->ops + idx;
+  // Keep at least one byte so that the buffer address is valid.
+  u->reserve(idx, len ? len : 1);
+  if (type == SendOp) memcpy(op->buf, data, len);
+  op->type = type;
+  op->done = NoOp;
+  op->len  = len;
+  u->queue(idx);
+}
+
+LuaStackSize Poller::uringCompletion(int idx, lua_State *L) {
+  URingState *u = uring_;
+  if (idx >= u->idx_size) return 0;
+  URingState::Op *op = u->ops + idx;
+  if (!op->done) return 0;
+  if (op->done == RecvOp && op->result > 0) {
+    lua_pushlstring(L, op->buf, op->result);
+  } else {
+    lua_pushnumber(L, op->result);
+  }
+  op->done = NoOp;
+  return 1;
+}
+
+#endif // LUBYK_POLLER_URING
@@ -0,0 +1,177 @@
+/*
+  ==============================================================================
+
+   This file is part of the LUBYK project (http://lubyk.org)
+   Copyright (c) 2007-2014 by Gaspard Bucher (http://teti.ch).
+
+  ------------------------------------------------------------------------------
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+
+  ==============================================================================
+*/
+#include "lens/Mailbox.h"
+
+#include <errno.h>
+#include <string.h> // memcpy
+#include <unistd.h> // pipe, read, write
+#include <fcntl.h>  // fcntl
+#include <stdint.h> // uint64_t
+
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
+using namespace lens;
+
+Mailbox::Mailbox() {
+  queue_ = (Queue*)malloc(sizeof(Queue));
+  if (!queue_) {
+    throw dub::Exception("Could not allocate mailbox.");
+  }
+  queue_->refcount  = 1;
+  queue_->stub.next = NULL;
+  queue_->head      = &queue_->stub;
+  queue_->tail      = &queue_->stub;
+  queue_->pending   = 0;
+#ifdef __linux__
+  int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  queue_->fds[0] = fd;
+  queue_->fds[1] = fd;
+  if (fd == -1) {
+#else
+  if (pipe(queue_->fds) == 0) {
+    fcntl(queue_->fds[0], F_SETFL, O_NONBLOCK);
+    fcntl(queue_->fds[1], F_SETFL, O_NONBLOCK);
+    fcntl(queue_->fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(queue_->fds[1], F_SETFD, FD_CLOEXEC);
+  } else {
+#endif
+    int err = errno;
+    free(queue_);
+    queue_ = NULL;
+    throw dub::Exception("Could not create mailbox wake up fd (%s).", strerror(err));
+  }
+}
+
+Mailbox::Mailbox(Queue *queue)
+  : queue_(queue) {
+  retain(queue_);
+}
+
+Mailbox::~Mailbox() {
+  release(queue_);
+}
+
+void Mailbox::post(lua_State *L) {
+  size_t len;
+  const char *str = luaL_checklstring(L, 2, &len);
+  Message *msg = (Message*)malloc(sizeof(Message) + len);
+  if (!msg) {
+    throw dub::Exception("Could not allocate message of %i bytes.", (int)len);
+  }
+  msg->len = len;
+  memcpy(msg->data, str, len);
+  push(queue_, msg);
+
+  if (__atomic_fetch_add(&queue_->pending, 1, __ATOMIC_ACQ_REL) == 0) {
+    // Mailbox was empty: wake up receiver.
+#ifdef __linux__
+    uint64_t one = 1;
+    if (::write(queue_->fds[1], &one, sizeof(one)) < 0) {
+#else
+    char one = 1;
+    if (::write(queue_->fds[1], &one, 1) < 0) {
+#endif
+      // EAGAIN: fd is already readable.
+    }
+  }
+}
+
+LuaStackSize Mailbox::recv(lua_State *L) {
+  Message *msg = pop(queue_);
+  if (msg) {
+    __atomic_sub_fetch(&queue_->pending, 1, __ATOMIC_ACQ_REL);
+    lua_pushlstring(L, msg->data, msg->len);
+    free(msg);
+    return 1;
+  }
+
+  // Empty: clear wake up fd before the caller checks pending and waits.
+#ifdef __linux__
+  uint64_t count;
+  if (::read(queue_->fds[0], &count, sizeof(count)) < 0) {
+    // EAGAIN
+  }
+#else
+  char buf[64];
+  while (::read(queue_->fds[0], buf, sizeof(buf)) > 0) {}
+#endif
+  lua_pushnil(L);
+  return 1;
+}
+
+void Mailbox::retain(Queue *queue) {
+  __atomic_add_fetch(&queue->refcount, 1, __ATOMIC_RELAXED);
+}
+
+void Mailbox::release(Queue *queue) {
+  if (__atomic_sub_fetch(&queue->refcount, 1, __ATOMIC_ACQ_REL)) return;
+  // Last reference: free messages that were never received.
+  Message *msg;
+  while ((msg = pop(queue))) {
+    free(msg);
+  }
+  ::close(queue->fds[0]);
+  if (queue->fds[1] != queue->fds[0]) ::close(queue->fds[1]);
+  free(queue);
+}
+
+// Intrusive MPSC queue (Dmitry Vyukov).
+void Mailbox::push(Queue *q, Message *msg) {
+  msg->next = NULL;
+  Message *prev = __atomic_exchange_n(&q->head, msg, __ATOMIC_ACQ_REL);
+  __atomic_store_n(&prev->next, msg, __ATOMIC_RELEASE);
+}
+
+Mailbox::Message *Mailbox::pop(Queue *q) {
+  Message *tail = q->tail;
+  Message *next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+  if (tail == &q->stub) {
+    if (!next) return NULL;
+    q->tail = next;
+    tail = next;
+    next = __atomic_load_n(&next->next, __ATOMIC_ACQUIRE);
+  }
+  if (next) {
+    q->tail = next;
+    return tail;
+  }
+  if (tail != __atomic_load_n(&q->head, __ATOMIC_ACQUIRE)) {
+    // A producer is linking a new message.
+    return NULL;
+  }
+  push(q, &q->stub);
+  next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+  if (next) {
+    q->tail = next;
+    return tail;
+  }
+  return NULL;
+}
@@ -0,0 +1,300 @@
+/*
+  ==============================================================================
+
+   This file is part of the LUBYK project (http://lubyk.org)
+   Copyright (c) 2007-2014 by Gaspard Bucher (http://teti.ch).
+
+  ------------------------------------------------------------------------------
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+
+  ==============================================================================
+*/
+#include "lens/msgpack.h"
+
+#include <math.h>   // floor
+#include <stdint.h> // int64_t
+#include <string.h> // memcpy
+
+// Big endian helpers.
+static inline void putBE(std::string &out, uint64_t v, int bytes) {
+  char buf[8];
+  for(int i = bytes - 1; i >= 0; --i) {
+    buf[i] = (char)(v & 0xff);
+    v >>= 8;
+  }
+  out.append(buf, bytes);
+}
+
+static inline uint64_t getBE(const unsigned char *p, int bytes) {
+  uint64_t v = 0;
+  for(int i = 0; i < bytes; ++i) {
+    v = (v << 8) | p[i];
+  }
+  return v;
+}
+
+static void packNumber(std::string &out, double d) {
+  if (d == floor(d) && d >= -9223372036854775808.0 && d < 9223372036854775808.0) {
+    int64_t i = (int64_t)d;
+    if (i >= 0) {
+      if (i < 128) {
+        // positive fixint
+        out += (char)i;
+      } else if (i < 0x100) {
+        out += (char)0xcc;
+        putBE(out, i, 1);
+      } else if (i < 0x10000) {
+        out += (char)0xcd;
+        putBE(out, i, 2);
+      } else if (i < 0x100000000LL) {
+        out += (char)0xce;
+        putBE(out, i, 4);
+      } else {
+        out += (char)0xcf;
+        putBE(out, i, 8);
+      }
+    } else {
+      if (i >= -32) {
+        // negative fixint
+        out += (char)i;
+      } else if (i >= -128) {
+        out += (char)0xd0;
+        putBE(out, (uint64_t)i, 1);
+      } else if (i >= -32768) {
+        out += (char)0xd1;
+        putBE(out, (uint64_t)i, 2);
+      } else if (i >= -2147483648LL) {
+        out += (char)0xd2;
+        putBE(out, (uint64_t)i, 4);
+      } else {
+        out += (char)0xd3;
+        putBE(out, (uint64_t)i, 8);
+      }
+    }
+  } else {
+    uint64_t bits;
+    memcpy(&bits, &d, 8);
+    out += (char)0xcb;
+    putBE(out, bits, 8);
+  }
+}
+
+static void packHeader(std::string &out, size_t n, int fix, int fix_max, unsigned char c16) {
+  if (fix && n <= (size_t)fix_max) {
+    out += (char)(fix | n);
+  } else if (n < 0x100 && c16 == 0xda) {
+    // str8
+    out += (char)0xd9;
+    putBE(out, n, 1);
+  } else if (n < 0x10000) {
+    out += (char)c16;
+    putBE(out, n, 2);
+  } else {
+    // 32 bit variant follows the 16 bit one.
+    out += (char)(c16 + 1);
+    putBE(out, n, 4);
+  }
+}
+
+void lens::msgpackPack(lua_State *L, int index, std::string &out, int depth) {
+  if (index < 0) index = lua_gettop(L) + index + 1;
+
+  switch(lua_type(L, index)) {
+    case LUA_TNIL:
+      out += (char)0xc0;
+      break;
+    case LUA_TBOOLEAN:
+      out += (char)(lua_toboolean(L, index) ? 0xc3 : 0xc2);
+      break;
+    case LUA_TNUMBER:
+      packNumber(out, lua_tonumber(L, index));
+      break;
+    case LUA_TSTRING: {
+      size_t len;
+      const char *str = lua_tolstring(L, index, &len);
+      packHeader(out, len, 0xa0, 31, 0xda);
+      out.append(str, len);
+      break;
+    }
+    case LUA_TTABLE: {
+      if (depth >= MSGPACK_MAX_DEPTH) {
+        throw dub::Exception("Cannot pack value (too many nested tables).");
+      }
+      lua_checkstack(L, 3);
+      // Count keys to know if we have an array.
+      size_t count = 0;
+      double max_key = 0;
+      bool is_array = true;
+      lua_pushnil(L);
+      while (lua_next(L, index)) {
+        ++count;
+        if (is_array) {
+          double k = lua_type(L, -2) == LUA_TNUMBER ? lua_tonumber(L, -2) : 0;
+          if (k < 1 || k != floor(k)) {
+            is_array = false;
+          } else if (k > max_key) {
+            max_key = k;
+          }
+        }
+        lua_pop(L, 1);
+      }
+      // Keys must be 1..count (no holes).
+      is_array = is_array && max_key == count;
+
+      if (is_array) {
+        packHeader(out, count, 0x90, 15, 0xdc);
+        for(size_t i = 1; i <= count; ++i) {
+          lua_rawgeti(L, index, i);
+          msgpackPack(L, -1, out, depth + 1);
+          lua_pop(L, 1);
+        }
+      } else {
+        packHeader(out, count, 0x80, 15, 0xde);
+        lua_pushnil(L);
+        while (lua_next(L, index)) {
+          msgpackPack(L, -2, out, depth + 1);
+          msgpackPack(L, -1, out, depth + 1);
+          lua_pop(L, 1);
+        }
+      }
+      break;
+    }
+    default:
+      throw dub::Exception("Cannot pack value of type '%s'.", luaL_typename(L, index));
+  }
+}
+
+#define NEED(n) if (size < (size_t)(n)) throw dub::Exception("Cannot unpack value (truncated data).")
+
+size_t lens::msgpackUnpack(lua_State *L, const char *data, size_t size, int depth) {
+  const unsigned char *p = (const unsigned char *)data;
+  NEED(1);
+  unsigned char c = p[0];
+  size_t len = 0;
+  size_t hdr = 1;
+  // 0: scalar, 1: string, 2: array, 3: map
+  int kind = 0;
+
+  if (c < 0x80) {
+    lua_pushnumber(L, c);
+    return 1;
+  } else if (c >= 0xe0) {
+    lua_pushnumber(L, (int8_t)c);
+    return 1;
+  } else if (c < 0x90) {
+    kind = 3; len = c & 0x0f;
+  } else if (c < 0xa0) {
+    kind = 2; len = c & 0x0f;
+  } else if (c < 0xc0) {
+    kind = 1; len = c & 0x1f;
+  } else {
+    switch(c) {
+      case 0xc0: lua_pushnil(L); return 1;
+      case 0xc2: lua_pushboolean(L, false); return 1;
+      case 0xc3: lua_pushboolean(L, true); return 1;
+      // bin and str
+      case 0xc4: case 0xd9: NEED(2); kind = 1; len = p[1]; hdr = 2; break;
+      case 0xc5: case 0xda: NEED(3); kind = 1; len = getBE(p + 1, 2); hdr = 3; break;
+      case 0xc6: case 0xdb: NEED(5); kind = 1; len = getBE(p + 1, 4); hdr = 5; break;
+      case 0xca: {
+        NEED(5);
+        uint32_t bits = getBE(p + 1, 4);
+        float f;
+        memcpy(&f, &bits, 4);
+        lua_pushnumber(L, f);
+        return 5;
+      }
+      case 0xcb: {
+        NEED(9);
+        uint64_t bits = getBE(p + 1, 8);
+        double d;
+        memcpy(&d, &bits, 8);
+        lua_pushnumber(L, d);
+        return 9;
+      }
+      case 0xcc: NEED(2); lua_pushnumber(L, p[1]); return 2;
+      case 0xcd: NEED(3); lua_pushnumber(L, getBE(p + 1, 2)); return 3;
+      case 0xce: NEED(5); lua_pushnumber(L, getBE(p + 1, 4)); return 5;
+      case 0xcf: NEED(9); lua_pushnumber(L, (double)getBE(p + 1, 8)); return 9;
+      case 0xd0: NEED(2); lua_pushnumber(L, (int8_t)p[1]); return 2;
+      case 0xd1: NEED(3); lua_pushnumber(L, (int16_t)getBE(p + 1, 2)); return 3;
+      case 0xd2: NEED(5); lua_pushnumber(L, (int32_t)getBE(p + 1, 4)); return 5;
+      case 0xd3: NEED(9); lua_pushnumber(L, (double)(int64_t)getBE(p + 1, 8)); return 9;
+      case 0xdc: NEED(3); kind = 2; len = getBE(p + 1, 2); hdr = 3; break;
+      case 0xdd: NEED(5); kind = 2; len = getBE(p + 1, 4); hdr = 5; break;
+      case 0xde: NEED(3); kind = 3; len = getBE(p + 1, 2); hdr = 3; break;
+      case 0xdf: NEED(5); kind = 3; len = getBE(p + 1, 4); hdr = 5; break;
+      default:
+        throw dub::Exception("Cannot unpack value (unsupported type 0x%02x).", c);
+    }
+  }
+
+  if (kind == 1) {
+    NEED(hdr + len);
+    lua_pushlstring(L, data + hdr, len);
+    return hdr + len;
+  }
+
+  if (depth >= MSGPACK_MAX_DEPTH) {
+    throw dub::Exception("Cannot unpack value (too many nested tables).");
+  }
+  // Each element needs at least one byte: do not trust len to size the table.
+  if (len > size - hdr) {
+    throw dub::Exception("Cannot unpack value (truncated data).");
+  }
+  lua_checkstack(L, 3);
+  size_t used = hdr;
+  if (kind == 2) {
+    lua_createtable(L, len, 0);
+    for(size_t i = 1; i <= len; ++i) {
+      used += msgpackUnpack(L, data + used, size - used, depth + 1);
+      lua_rawseti(L, -2, i);
+    }
+  } else {
+    lua_createtable(L, 0, len);
+    for(size_t i = 0; i < len; ++i) {
+      used += msgpackUnpack(L, data + used, size - used, depth + 1);
+      used += msgpackUnpack(L, data + used, size - used, depth + 1);
+      if (lua_isnil(L, -2)) {
+        throw dub::Exception("Cannot unpack value (nil key in map).");
+      }
+      lua_rawset(L, -3);
+    }
+  }
+  return used;
+}
+
+LuaStackSize lens::pack(lua_State *L) {
+  luaL_checkany(L, 1);
+  std::string out;
+  msgpackPack(L, 1, out);
+  lua_pushlstring(L, out.data(), out.size());
+  return 1;
+}
+
+LuaStackSize lens::unpack(lua_State *L) {
+  size_t size;
+  const char *data = luaL_checklstring(L, 1, &size);
+  size_t used = msgpackUnpack(L, data, size);
+  if (used != size) {
+    throw dub::Exception("Cannot unpack value (%i trailing bytes).", (int)(size - used));
+  }
+  return 1;
+}
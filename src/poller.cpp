@@ -30,13 +30,23 @@
 
 using namespace lens;
 
-pthread_key_t Poller::sThisKey = 0;
+pthread_key_t Poller::sThisKey;
 
-Poller::Poller(int reserve)
+pthread_once_t Poller::sThisKeyOnce = PTHREAD_ONCE_INIT;
+
+Poller::Poller(int reserve, int backend)
       : pollitems_(NULL)
       , pollitems_size_(0)
       , idx_to_pos_(NULL)
       , pos_to_idx_(NULL)
+      , idx_size_(0)
+      , idx_count_(0)
+      , free_idx_(NULL)
+      , free_count_(0)
+      , reserve_(0)
+      , ready_idx_(NULL)
+      , ready_rev_(NULL)
+      , ready_size_(0)
       , used_count_(0)
       , event_count_(0)
       , interrupted_(false)
@@ -44,7 +54,7 @@ Poller::Poller(int reserve)
   {
   // create a key to find 'lua_State' in current thread (used to handle
   // interrupts in Poller::poll.
-  if (!sThisKey) pthread_key_create(&sThisKey, NULL);
+  pthread_once(&sThisKeyOnce, sCreateKey);
 
   if (reserve <= 0) reserve = 10;
   pollitems_ = (Poller::Pollitem*)calloc(reserve, sizeof(Poller::Pollitem));
@@ -67,15 +77,147 @@ Poller::Poller(int reserve)
     idx_to_pos_ = NULL;
     throw dub::Exception("Could not pre-allocate %i pollitems", reserve);
   }
+
+  free_idx_ = (int*)malloc(reserve * sizeof(int));
+  if (free_idx_ == NULL) {
+    free(pollitems_);
+    pollitems_ = NULL;
+    free(idx_to_pos_);
+    idx_to_pos_ = NULL;
+    free(pos_to_idx_);
+    pos_to_idx_ = NULL;
+    throw dub::Exception("Could not pre-allocate %i pollitems", reserve);
+  }
   pollitems_size_ = reserve;
+  idx_size_       = reserve;
+  reserve_        = reserve;
 
   memset(idx_to_pos_, -1, reserve * sizeof(int));
   memset(pos_to_idx_, -1, reserve * sizeof(int));
 
 #ifdef LUBYK_POLLER_KEVENT
   kqueue_ = kqueue();
+#elif defined(LUBYK_POLLER_EPOLL)
+  fds_         = NULL;
+  fds_size_    = 0;
+  ready_count_ = 0;
+  epoll_       = epoll_create(reserve);
+  idx_next_    = (int*)malloc(reserve * sizeof(int));
+  if (epoll_ == -1 || idx_next_ == NULL) {
+    int err = errno;
+    free(pollitems_);
+    pollitems_ = NULL;
+    free(idx_to_pos_);
+    idx_to_pos_ = NULL;
+    free(pos_to_idx_);
+    pos_to_idx_ = NULL;
+    free(free_idx_);
+    free_idx_ = NULL;
+    if (idx_next_) free(idx_next_);
+    idx_next_ = NULL;
+    if (epoll_ != -1) ::close(epoll_);
+    throw dub::Exception("Could not create epoll instance (%s).", strerror(err));
+  }
+  memset(idx_next_, -1, reserve * sizeof(int));
+
+  // Precise wake up. Fallback to millisecond timeouts if timerfd is not
+  // available.
+  timer_at_ = -1;
+  timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (timer_fd_ != -1) {
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events  = EPOLLIN;
+    ev.data.fd = timer_fd_;
+    if (epoll_ctl(epoll_, EPOLL_CTL_ADD, timer_fd_, &ev)) {
+      ::close(timer_fd_);
+      timer_fd_ = -1;
+    }
+  }
+#ifdef LUBYK_POLLER_URING
+  uring_ = NULL;
+  if (backend == URing) {
+    // Silently fallback to epoll if io_uring is not available.
+    setupURing(256);
+  }
+#endif
 #endif
   setupInterruptHook();
 }
 
+void Poller::resizeItems(int size) {
+  int old_size = pollitems_size_;
+  // A failed realloc when shrinking keeps the larger block: this is fine.
+  Pollitem *ptr = (Pollitem*)realloc(pollitems_, size * sizeof(Pollitem));
+  if (ptr) {
+    pollitems_ = ptr;
+  } else if (size > old_size) {
+    throw dub::Exception("Could not reallocate %i pollitems.", size);
+  }
+  int *sptr = (int*)realloc(pos_to_idx_, size * sizeof(int));
+  if (sptr) {
+    pos_to_idx_ = sptr;
+  } else if (size > old_size) {
+    throw dub::Exception("Could not reallocate %i pollitems.", size);
+  }
+  if (size > old_size) {
+    // clear new space
+    memset(pos_to_idx_ + old_size, -1, (size - old_size) * sizeof(int));
+    memset(pollitems_  + old_size,  0, (size - old_size) * sizeof(Pollitem));
+  }
+  pollitems_size_ = size;
+}
+
+void Poller::resizeIdx(int size) {
+  int old_size = idx_size_;
+  int *sptr = (int*)realloc(idx_to_pos_, size * sizeof(int));
+  if (sptr) {
+    idx_to_pos_ = sptr;
+  } else if (size > old_size) {
+    throw dub::Exception("Could not reallocate %i pollitems.", size);
+  }
+  sptr = (int*)realloc(free_idx_, size * sizeof(int));
+  if (sptr) {
+    free_idx_ = sptr;
+  } else if (size > old_size) {
+    throw dub::Exception("Could not reallocate %i pollitems.", size);
+  }
+#ifdef LUBYK_POLLER_EPOLL
+  sptr = (int*)realloc(idx_next_, size * sizeof(int));
+  if (sptr) {
+    idx_next_ = sptr;
+  } else if (size > old_size) {
+    throw dub::Exception("Could not reallocate %i pollitems.", size);
+  }
+#endif
+  if (size > old_size) {
+    // clear new space
+    memset(idx_to_pos_ + old_size, -1, (size - old_size) * sizeof(int));
+#ifdef LUBYK_POLLER_EPOLL
+    memset(idx_next_   + old_size, -1, (size - old_size) * sizeof(int));
+#endif
+  }
+  idx_size_ = size;
+}
+
+void Poller::shrink() {
+  int size = pollitems_size_ / 2;
+  if (size < reserve_) size = reserve_;
+  resizeItems(size);
+
+  // Items can be kept by a long running thread: we can only shrink idx
+  // arrays down to idx_count_.
+  if (idx_count_ <= size && size < idx_size_) {
+    // Remove stale entries from the free list.
+    int j = 0;
+    for(int i = 0; i < free_count_; ++i) {
+      if (free_idx_[i] < idx_count_) {
+        free_idx_[j++] = free_idx_[i];
+      }
+    }
+    free_count_ = j;
+    resizeIdx(size);
+  }
+}
+
 
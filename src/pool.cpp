@@ -0,0 +1,183 @@
+/*
+  ==============================================================================
+
+   This file is part of the LUBYK project (http://lubyk.org)
+   Copyright (c) 2007-2014 by Gaspard Bucher (http://teti.ch).
+
+  ------------------------------------------------------------------------------
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+
+  ==============================================================================
+*/
+#include "lens/Pool.h"
+
+#include <errno.h>
+#include <string.h> // strerror
+#include <unistd.h> // pipe, read, write
+#include <fcntl.h>  // fcntl
+#include <stdint.h> // uint64_t
+
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
+using namespace lens;
+
+namespace {
+struct PoolQueue {
+  pthread_mutex_t mutex;
+  pthread_cond_t  cond;
+  Pool::Job *head;
+  Pool::Job *tail;
+  // Jobs waiting in the list.
+  int queued;
+  int threads;
+  int idle;
+  // Started threads not yet waiting for jobs.
+  int starting;
+};
+} // namespace
+
+// Shared by all Lua states (workers included). Indexed by Pool::Queue.
+static PoolQueue pool_queues[POOL_QUEUES] = {
+  { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, NULL, 0, 0, 0, 0 },
+  { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, NULL, 0, 0, 0, 0 },
+};
+
+Pool::Job::Job()
+  : refcount_(1)
+  , done_(0)
+  , next_(NULL) {
+#ifdef __linux__
+  int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  fds_[0] = fd;
+  fds_[1] = fd;
+  if (fd == -1) {
+#else
+  if (pipe(fds_) == 0) {
+    fcntl(fds_[0], F_SETFL, O_NONBLOCK);
+    fcntl(fds_[1], F_SETFL, O_NONBLOCK);
+    fcntl(fds_[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds_[1], F_SETFD, FD_CLOEXEC);
+  } else {
+#endif
+    throw dub::Exception("Could not create job wake up fd (%s).", strerror(errno));
+  }
+}
+
+Pool::Job::~Job() {
+  ::close(fds_[0]);
+  if (fds_[1] != fds_[0]) ::close(fds_[1]);
+}
+
+void Pool::Job::reset() {
+#ifdef __linux__
+  uint64_t count;
+  if (::read(fds_[0], &count, sizeof(count)) < 0) {
+    // EAGAIN
+  }
+#else
+  char buf[64];
+  while (::read(fds_[0], buf, sizeof(buf)) > 0) {}
+#endif
+  __atomic_store_n(&done_, 0, __ATOMIC_RELEASE);
+}
+
+void Pool::submit(Job *job, Queue queue) {
+  PoolQueue *q = &pool_queues[queue];
+  __atomic_add_fetch(&job->refcount_, 1, __ATOMIC_RELAXED);
+  job->next_ = NULL;
+  pthread_mutex_lock(&q->mutex);
+  if (q->tail) {
+    q->tail->next_ = job;
+  } else {
+    q->head = job;
+  }
+  q->tail = job;
+  ++q->queued;
+
+  // Idle threads may not have picked the previous jobs yet: start threads
+  // until each queued job has one.
+  while (q->queued > q->idle + q->starting && q->threads < POOL_MAX_THREADS) {
+    pthread_t thread;
+    int err = lens::startThread(&thread, sRun, q);
+    if (err) {
+      if (!q->threads) {
+        // Nobody to run the job (this is the only queued job).
+        q->head = q->tail = NULL;
+        q->queued = 0;
+        pthread_mutex_unlock(&q->mutex);
+        __atomic_sub_fetch(&job->refcount_, 1, __ATOMIC_RELAXED);
+        throw dub::Exception("Could not start pool thread (%s).", strerror(err));
+      }
+      // Running threads will pick the job.
+      break;
+    }
+    pthread_detach(thread);
+    ++q->threads;
+    ++q->starting;
+  }
+  pthread_cond_signal(&q->cond);
+  pthread_mutex_unlock(&q->mutex);
+}
+
+void Pool::release(Job *job) {
+  if (__atomic_sub_fetch(&job->refcount_, 1, __ATOMIC_ACQ_REL)) return;
+  delete job;
+}
+
+void *Pool::sRun(void *data) {
+  PoolQueue *q = (PoolQueue*)data;
+  pthread_mutex_lock(&q->mutex);
+  --q->starting;
+  while (true) {
+    while (!q->head) {
+      ++q->idle;
+      pthread_cond_wait(&q->cond, &q->mutex);
+      --q->idle;
+    }
+    Job *job = q->head;
+    q->head = job->next_;
+    if (!q->head) q->tail = NULL;
+    --q->queued;
+    pthread_mutex_unlock(&q->mutex);
+
+    try {
+      job->run();
+    } catch (...) {
+      // Jobs store their errors. An exception escaping the thread would
+      // terminate the process.
+    }
+    __atomic_store_n(&job->done_, 1, __ATOMIC_RELEASE);
+#ifdef __linux__
+    uint64_t one = 1;
+    if (::write(job->fds_[1], &one, sizeof(one)) < 0) {
+#else
+    char one = 1;
+    if (::write(job->fds_[1], &one, 1) < 0) {
+#endif
+      // EAGAIN: fd is already readable.
+    }
+    release(job);
+
+    pthread_mutex_lock(&q->mutex);
+  }
+  return NULL;
+}
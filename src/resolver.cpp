@@ -0,0 +1,197 @@
+/*
+  ==============================================================================
+
+   This file is part of the LUBYK project (http://lubyk.org)
+   Copyright (c) 2007-2014 by Gaspard Bucher (http://teti.ch).
+
+  ------------------------------------------------------------------------------
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+
+  ==============================================================================
+*/
+#include "lens/Resolver.h"
+
+#include <string.h>     // memset
+#include <sys/socket.h>
+#include <netdb.h>      // getaddrinfo, getnameinfo
+#include <arpa/inet.h>  // inet_pton, inet_ntop
+#include <pthread.h>
+
+#include <map>
+
+using namespace lens;
+
+struct CacheEntry {
+  std::string address;
+  double expires;
+};
+
+typedef std::map<std::string, CacheEntry> Cache;
+
+// Shared by all Lua states (workers included).
+static pthread_mutex_t cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static Cache *cache = NULL;
+static double cache_ttl = RESOLVER_DEFAULT_TTL;
+
+static void cacheStore(const std::string &host, const std::string &address) {
+  pthread_mutex_lock(&cache_mutex);
+  if (cache_ttl > 0) {
+    if (!cache) cache = new Cache();
+    double now = elapsed();
+    if (cache->size() >= RESOLVER_MAX_CACHE) {
+      // Remove expired entries.
+      for(Cache::iterator it = cache->begin(); it != cache->end(); ) {
+        if (it->second.expires <= now) {
+          cache->erase(it++);
+        } else {
+          ++it;
+        }
+      }
+      if (cache->size() >= RESOLVER_MAX_CACHE) {
+        cache->clear();
+      }
+    }
+    CacheEntry &entry = (*cache)[host];
+    entry.address = address;
+    entry.expires = now + cache_ttl;
+  }
+  pthread_mutex_unlock(&cache_mutex);
+}
+
+Resolver::Resolver(Lookup *job)
+  : job_(job) {
+}
+
+Resolver::~Resolver() {
+  Pool::release(job_);
+}
+
+Resolver *Resolver::reverse(const char *host) {
+  return start(host, true);
+}
+
+Resolver *Resolver::resolve(const char *host) {
+  return start(host, false);
+}
+
+Resolver *Resolver::start(const char *host, bool reverse) {
+  Lookup *job = new Lookup();
+  job->host    = host;
+  job->reverse = reverse;
+  try {
+    Pool::submit(job, Pool::NameQueue);
+  } catch (...) {
+    Pool::release(job);
+    throw;
+  }
+  return new Resolver(job);
+}
+
+LuaStackSize Resolver::result(lua_State *L) {
+  if (!job_->done()) {
+    throw dub::Exception("Lookup not done.");
+  }
+  if (!job_->error.empty()) {
+    lua_pushnil(L);
+    lua_pushstring(L, job_->error.c_str());
+    return 2;
+  }
+  lua_pushstring(L, job_->name.c_str());
+  return 1;
+}
+
+LuaStackSize Resolver::cached(const char *host, lua_State *L) {
+  unsigned char buf[sizeof(struct in6_addr)];
+  if (inet_pton(AF_INET, host, buf) == 1 || inet_pton(AF_INET6, host, buf) == 1) {
+    // Numeric
+    lua_pushstring(L, host);
+    return 1;
+  }
+
+  int count = 0;
+  pthread_mutex_lock(&cache_mutex);
+  if (cache) {
+    Cache::iterator it = cache->find(host);
+    if (it != cache->end()) {
+      if (it->second.expires > elapsed()) {
+        lua_pushstring(L, it->second.address.c_str());
+        count = 1;
+      } else {
+        cache->erase(it);
+      }
+    }
+  }
+  pthread_mutex_unlock(&cache_mutex);
+  return count;
+}
+
+void Resolver::setTTL(double ttl) {
+  pthread_mutex_lock(&cache_mutex);
+  cache_ttl = ttl;
+  if (ttl <= 0 && cache) {
+    cache->clear();
+  }
+  pthread_mutex_unlock(&cache_mutex);
+}
+
+double Resolver::ttl() {
+  pthread_mutex_lock(&cache_mutex);
+  double ttl = cache_ttl;
+  pthread_mutex_unlock(&cache_mutex);
+  return ttl;
+}
+
+void Resolver::Lookup::run() {
+  struct addrinfo hints, *res;
+  memset(&hints, 0, sizeof(hints));
+  // we do not care if we get an IPv4 or IPv6 address
+  hints.ai_family = AF_UNSPEC;
+  // One entry per address.
+  hints.ai_socktype = SOCK_STREAM;
+  if (reverse) {
+    // Only parse the address (no lookup).
+    hints.ai_flags = AI_NUMERICHOST;
+  }
+
+  int status = getaddrinfo(host.c_str(), NULL, &hints, &res);
+  if (status) {
+    error = gai_strerror(status);
+    return;
+  }
+
+  char buffer[NI_MAXHOST];
+  if (reverse) {
+    status = getnameinfo(res->ai_addr, res->ai_addrlen, buffer, sizeof(buffer),
+                         NULL, 0, NI_NAMEREQD);
+  } else {
+    // First address (sorted by preference).
+    status = getnameinfo(res->ai_addr, res->ai_addrlen, buffer, sizeof(buffer),
+                         NULL, 0, NI_NUMERICHOST);
+  }
+  freeaddrinfo(res);
+  if (status) {
+    error = gai_strerror(status);
+  } else {
+    name = buffer;
+    if (!reverse) {
+      cacheStore(host, name);
+    }
+  }
+}
@@ -0,0 +1,612 @@
+/*
+  ==============================================================================
+
+   This file is part of the LUBYK project (http://lubyk.org)
+   Copyright (c) 2007-2014 by Gaspard Bucher (http://teti.ch).
+
+  ------------------------------------------------------------------------------
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+
+  ==============================================================================
+*/
+#include "lens/Scheduler.h"
+
+#include <stdio.h>  // printf
+#include <string.h> // strcmp
+
+using namespace lens;
+
+#if LUA_VERSION_NUM >= 504
+static inline int resumeCoroutine(lua_State *co, lua_State *L, int narg) {
+  int nres;
+  return lua_resume(co, L, narg, &nres);
+}
+#elif LUA_VERSION_NUM > 501
+static inline int resumeCoroutine(lua_State *co, lua_State *L, int narg) {
+  return lua_resume(co, L, narg);
+}
+#else
+static inline int resumeCoroutine(lua_State *co, lua_State *L, int narg) {
+  return lua_resume(co, narg);
+}
+#endif
+
+Scheduler::Scheduler()
+  : poller_(NULL)
+  , now_(0)
+  , should_run_(false)
+  , fd_count_(0)
+  , at_(NULL)
+  , at_seq_(NULL)
+  , at_pos_(NULL)
+  , at_next_(NULL)
+  , at_state_(NULL)
+  , at_size_(0)
+  , at_free_(-1)
+  , heap_(NULL)
+  , heap_count_(0)
+  , seq_(0)
+  , due_(NULL)
+  , due_size_(0)
+  , due_count_(0) {
+}
+
+Scheduler::~Scheduler() {
+  if (at_)       free(at_);
+  if (at_seq_)   free(at_seq_);
+  if (at_pos_)   free(at_pos_);
+  if (at_next_)  free(at_next_);
+  if (at_state_) free(at_state_);
+  if (heap_)     free(heap_);
+  if (due_)      free(due_);
+}
+
+void Scheduler::loop(lua_State *L) {
+  if (!poller_) {
+    throw dub::Exception("Cannot run without a poller.");
+  }
+  Frame f;
+  prepare(L, &f);
+  while (should_run_) {
+    dueThreads(L, &f);
+
+    if (!should_run_) break;
+
+    double wake_at = wakeAt();
+    if (fd_count_ == 0 && wake_at == -1) {
+      // No more at events and no more fd
+      should_run_ = false;
+      break;
+    }
+
+    if (!poller_->poll(wake_at)) {
+      // interrupted
+      should_run_ = false;
+      printf("\n");
+      break;
+    }
+
+    eventThreads(L, &f);
+  }
+}
+
+void Scheduler::runDue(lua_State *L) {
+  Frame f;
+  prepare(L, &f);
+  dueThreads(L, &f);
+}
+
+void Scheduler::runEvents(lua_State *L) {
+  if (!poller_) {
+    throw dub::Exception("Cannot run without a poller.");
+  }
+  Frame f;
+  prepare(L, &f);
+  eventThreads(L, &f);
+}
+
+void Scheduler::scheduleAt(lua_State *L) {
+  // <self> <thread>
+  Frame f;
+  prepare(L, &f);
+  scheduleThread(L, &f, 2);
+}
+
+void Scheduler::unschedule(lua_State *L) {
+  // <self> <thread>
+  Frame f;
+  prepare(L, &f);
+  unscheduleThread(L, &f, 2);
+}
+
+void Scheduler::changeFdFilter(lua_State *L) {
+  // <self> <thread> <fd> <filter> (<flags>)
+  if (!poller_) {
+    throw dub::Exception("Cannot wait on file descriptor without a poller.");
+  }
+  int fd     = dub::checkint(L, 3);
+  int filter = dub::checkint(L, 4);
+  int flags  = lua_gettop(L) > 4 ? dub::checkint(L, 5) : 0;
+  Frame f;
+  prepare(L, &f);
+  changeFilter(L, &f, 2, fd, filter, flags);
+}
+
+void Scheduler::removeFd(lua_State *L) {
+  // <self> <thread>
+  Frame f;
+  prepare(L, &f);
+  removeThreadFd(L, &f, 2);
+}
+
+void Scheduler::finalizeThread(lua_State *L) {
+  // <self> <thread>
+  Frame f;
+  prepare(L, &f);
+  finalize(L, &f, 2);
+}
+
+// ============================================== PRIVATE
+
+void Scheduler::prepare(lua_State *L, Frame *f) {
+  f->self = 1;
+  lua_getfield(L, 1, "operations");
+  f->operations = lua_gettop(L);
+  lua_getfield(L, 1, "idx_to_thread");
+  f->idx_to_thread = lua_gettop(L);
+  lua_getfield(L, 1, "at_threads");
+  f->at_threads = lua_gettop(L);
+  if (!lua_istable(L, f->idx_to_thread) || !lua_istable(L, f->at_threads)) {
+    throw dub::Exception("Scheduler not initialized (use lens.Scheduler()).");
+  }
+}
+
+void Scheduler::dueThreads(lua_State *L, Frame *f) {
+  now_ = elapsed();
+  // Extract current elements from the queue so that newly added threads do
+  // not alter the list (and we give fair chances for threads to run).
+  int base  = due_count_;
+  while (heap_count_ && at_[heap_[0]] <= now_) {
+    int slot = heap_[0];
+    unlinkSlot(slot);
+    at_state_[slot] = Due;
+    if (due_count_ >= due_size_) {
+      int size = due_size_ ? due_size_ * 2 : 32;
+      int *ptr = (int*)realloc(due_, size * sizeof(int));
+      if (!ptr) {
+        throw dub::Exception("Could not reallocate %i threads.", size);
+      }
+      due_      = ptr;
+      due_size_ = size;
+    }
+    due_[due_count_++] = slot;
+  }
+  int end = due_count_;
+
+  for(int i = base; i < end; ++i) {
+    int slot = due_[i];
+    // Skip killed or rescheduled threads.
+    if (at_state_[slot] != Due) continue;
+    if (!should_run_) {
+      // Keep for next run.
+      at_state_[slot] = Queued;
+      linkSlot(slot);
+      continue;
+    }
+    lua_rawgeti(L, f->at_threads, slot + 1);
+    int t = lua_gettop(L);
+    if (lua_isnil(L, t)) {
+      lua_pop(L, 1);
+      continue;
+    }
+    releaseSlot(L, f, t, slot);
+    while (runThread(L, f, t) && should_run_) {
+      // run same thread again
+    }
+    lua_settop(L, t - 1);
+  }
+  due_count_ = base;
+}
+
+void Scheduler::eventThreads(lua_State *L, Frame *f) {
+  // First collect events so that running the threads (and possibly adding
+  // new file descriptors) does not alter the list.
+  int count = poller_->readyEvents();
+  for(int i = 0; i < count && should_run_; ++i) {
+    int idx = poller_->ready_idx_[i];
+    lua_rawgeti(L, f->idx_to_thread, idx);
+    int t = lua_gettop(L);
+    if (lua_isnil(L, t)) {
+      // Removed by a thread that ran before.
+      lua_pop(L, 1);
+      continue;
+    }
+    lua_getfield(L, t, "filter");
+    int filter = lua_tointeger(L, -1);
+    lua_pop(L, 1);
+    if ((filter & Poller::FilterMask) == Poller::VNode) {
+      lua_pushnumber(L, poller_->fflags(idx));
+    } else if (poller_->completion(idx, L)) {
+      // Result of a 'recv' or 'send' operation.
+    } else {
+      // Read, Write, Hup and Error bits
+      lua_pushnumber(L, poller_->ready_rev_[i]);
+    }
+    lua_setfield(L, t, "retval");
+    while (runThread(L, f, t) && should_run_) {
+      // run fd thread again
+    }
+    lua_settop(L, t - 1);
+  }
+}
+
+bool Scheduler::runThread(lua_State *L, Frame *f, int t) {
+  int top = lua_gettop(L);
+  lua_getfield(L, t, "at");
+  if (lua_tonumber(L, -1) == 0) {
+    // thread starting now
+    lua_pushnumber(L, now_);
+    lua_setfield(L, t, "at");
+  }
+  lua_getfield(L, t, "co");
+  lua_State *co = lua_tothread(L, -1);
+  if (!co) {
+    // killed
+    lua_settop(L, top);
+    return false;
+  }
+  // <at> <co>
+  lua_getfield(L, t, "retval");
+  lua_xmove(L, co, 1);
+  // Do not keep the value (string, socket) alive or pass it to the next
+  // resume.
+  lua_pushnil(L);
+  lua_setfield(L, t, "retval");
+
+  bool again = false;
+  int status = resumeCoroutine(co, L, 1);
+  if (status == LUA_YIELD) {
+    // Keep operation and two arguments.
+    lua_settop(co, 3);
+    lua_xmove(co, L, 3);
+    // <at> <co> <a> <b> <c>
+    again = operation(L, f, t, top + 3);
+  } else if (status == 0) {
+    // Coroutine function finished
+    finalize(L, f, t);
+  } else {
+    // Error
+    lua_xmove(co, L, 1);
+    // <at> <co> <err>
+    int err = lua_gettop(L);
+    lua_getfield(L, f->self, "threadError");
+    lua_pushvalue(L, f->self);
+    lua_pushvalue(L, t);
+    lua_pushvalue(L, err);
+    // <at> <co> <err> <func> <self> <thread> <err>
+    lua_call(L, 3, 0);
+  }
+  lua_settop(L, top);
+  return again;
+}
+
+bool Scheduler::operation(lua_State *L, Frame *f, int t, int a) {
+  // <a> <b> <c>
+  int b = a + 1;
+  int c = a + 2;
+  if (lua_type(L, a) != LUA_TSTRING) {
+    if (lua_isnil(L, a)) {
+      // Plain yield: wait for someone to schedule the thread.
+      return false;
+    }
+    throw dub::Exception("Invalid operation '%s'.", luaL_typename(L, a));
+  }
+
+  const char *op = lua_tostring(L, a);
+  if (!strcmp(op, "read") || !strcmp(op, "write")) {
+    if (!lua_isnumber(L, b)) {
+      throw dub::Exception("Missing fd value. Check waitRead calls.");
+    }
+    int filter = op[0] == 'r' ? Poller::Read : Poller::Write;
+    // Optional Edge or OneShot mode.
+    filter += lua_tointeger(L, c);
+    changeFilter(L, f, t, lua_tointeger(L, b), filter, 0);
+    return false;
+  } else if (!strcmp(op, "recv") || !strcmp(op, "send")) {
+    // Completion I/O: the poller does the call and the thread is resumed
+    // with the result (see Poller::completion).
+    if (!lua_isnumber(L, b)) {
+      throw dub::Exception("Missing fd value. Check %s calls.", op);
+    }
+    bool recv = op[0] == 'r';
+    if (!poller_->completionIO()) {
+      // Not supported: resume with false so that the thread waits for
+      // readiness instead.
+      lua_pushboolean(L, false);
+      lua_setfield(L, t, "retval");
+      return true;
+    }
+    int filter = (recv ? Poller::Read : Poller::Write) + Poller::OneShot;
+    changeFilter(L, f, t, lua_tointeger(L, b), filter, 0);
+    lua_getfield(L, t, "idx");
+    int idx = lua_tointeger(L, -1);
+    lua_pop(L, 1);
+    if (recv) {
+      poller_->submitRecv(idx, dub::checkint(L, c));
+    } else {
+      size_t len;
+      const char *data = luaL_checklstring(L, c, &len);
+      poller_->submitSend(idx, data, len);
+    }
+    return false;
+  } else if (!strcmp(op, "sleep") || !strcmp(op, "wait")) {
+    double at;
+    if (op[0] == 's') {
+      at = elapsed() + lua_tonumber(L, b);
+    } else {
+      lua_getfield(L, t, "at");
+      at = lua_tonumber(L, -1) + lua_tonumber(L, b);
+      lua_pop(L, 1);
+    }
+    lua_pushnumber(L, at);
+    lua_setfield(L, t, "at");
+    removeThreadFd(L, f, t);
+    scheduleThread(L, f, t);
+    return false;
+  }
+
+  lua_getfield(L, f->operations, op);
+  if (!lua_isfunction(L, -1)) {
+    throw dub::Exception("Invalid operation '%s'.", op);
+  }
+  lua_pushvalue(L, f->self);
+  lua_pushvalue(L, t);
+  lua_pushvalue(L, b);
+  lua_pushvalue(L, c);
+  // <func> <self> <thread> <b> <c>
+  lua_call(L, 4, 1);
+  // Return true to resume running thread immediately.
+  return lua_toboolean(L, -1);
+}
+
+void Scheduler::scheduleThread(lua_State *L, Frame *f, int t) {
+  lua_getfield(L, t, "at");
+  double at = lua_tonumber(L, -1);
+  lua_getfield(L, t, "at_slot");
+  int slot;
+  if (lua_isnumber(L, -1)) {
+    slot = lua_tointeger(L, -1);
+    if (at_state_[slot] == Queued) {
+      // Move in queue.
+      unlinkSlot(slot);
+    }
+  } else {
+    slot = allocSlot();
+    lua_pushnumber(L, slot);
+    lua_setfield(L, t, "at_slot");
+    lua_pushvalue(L, t);
+    lua_rawseti(L, f->at_threads, slot + 1);
+  }
+  lua_pop(L, 2);
+  at_[slot]       = at;
+  at_seq_[slot]   = seq_++;
+  at_state_[slot] = Queued;
+  linkSlot(slot);
+}
+
+void Scheduler::unscheduleThread(lua_State *L, Frame *f, int t) {
+  lua_getfield(L, t, "at_slot");
+  if (lua_isnumber(L, -1)) {
+    int slot = lua_tointeger(L, -1);
+    if (at_state_[slot] == Queued) {
+      unlinkSlot(slot);
+    }
+    releaseSlot(L, f, t, slot);
+  }
+  lua_pop(L, 1);
+}
+
+void Scheduler::changeFilter(lua_State *L, Frame *f, int t, int fd, int filter, int flags) {
+  lua_getfield(L, t, "fd");
+  if (!lua_isnil(L, -1)) {
+    lua_getfield(L, t, "idx");
+    int idx = lua_tointeger(L, -1);
+    lua_pop(L, 1);
+    if (lua_tointeger(L, -1) != fd) {
+      // changed fd
+      lua_pushnumber(L, fd);
+      lua_setfield(L, t, "fd");
+    }
+    poller_->modifyItem(idx, filter, fd, flags);
+  } else {
+    // add fd
+    int idx = poller_->add(fd, filter, flags);
+    ++fd_count_;
+    lua_pushnumber(L, fd);
+    lua_setfield(L, t, "fd");
+    lua_pushnumber(L, idx);
+    lua_setfield(L, t, "idx");
+    lua_pushvalue(L, t);
+    lua_rawseti(L, f->idx_to_thread, idx);
+  }
+  lua_pop(L, 1);
+  // We need this information in case we change poller and to retrieve filter
+  // flags.
+  lua_pushnumber(L, filter);
+  lua_setfield(L, t, "filter");
+}
+
+void Scheduler::removeThreadFd(lua_State *L, Frame *f, int t) {
+  lua_getfield(L, t, "idx");
+  if (lua_isnil(L, -1)) {
+    lua_pop(L, 1);
+    return;
+  }
+  int idx = lua_tointeger(L, -1);
+  lua_pop(L, 1);
+  lua_pushnil(L);
+  lua_rawseti(L, f->idx_to_thread, idx);
+
+  lua_getfield(L, t, "fd");
+  if (!lua_isnil(L, -1)) {
+    poller_->remove(idx);
+    lua_pushnil(L);
+    lua_setfield(L, t, "fd");
+    --fd_count_;
+  }
+  lua_pop(L, 1);
+  lua_pushnil(L);
+  lua_setfield(L, t, "idx");
+}
+
+void Scheduler::finalize(lua_State *L, Frame *f, int t) {
+  unscheduleThread(L, f, t);
+  removeThreadFd(L, f, t);
+  lua_pushnil(L);
+  lua_setfield(L, t, "co");
+
+  lua_getfield(L, t, "joins");
+  if (lua_istable(L, -1)) {
+    int joins = lua_gettop(L);
+    lua_pushnil(L);
+    lua_setfield(L, t, "joins");
+    for(int i = 1; ; ++i) {
+      lua_rawgeti(L, joins, i);
+      if (lua_isnil(L, -1)) {
+        lua_pop(L, 1);
+        break;
+      }
+      scheduleThread(L, f, lua_gettop(L));
+      lua_pop(L, 1);
+    }
+  }
+  lua_pop(L, 1);
+}
+
+void Scheduler::releaseSlot(lua_State *L, Frame *f, int t, int slot) {
+  lua_pushnil(L);
+  lua_rawseti(L, f->at_threads, slot + 1);
+  lua_pushnil(L);
+  lua_setfield(L, t, "at_slot");
+  at_state_[slot] = Free;
+  at_next_[slot]  = at_free_;
+  at_free_        = slot;
+}
+
+int Scheduler::allocSlot() {
+  if (at_free_ == -1) {
+    int size = at_size_ ? at_size_ * 2 : 32;
+    double *at = (double*)realloc(at_, size * sizeof(double));
+    if (!at) {
+      throw dub::Exception("Could not reallocate %i threads.", size);
+    }
+    at_ = at;
+    unsigned int *seq = (unsigned int*)realloc(at_seq_, size * sizeof(unsigned int));
+    if (!seq) {
+      throw dub::Exception("Could not reallocate %i threads.", size);
+    }
+    at_seq_ = seq;
+    int *ptr = (int*)realloc(at_pos_, size * sizeof(int));
+    if (!ptr) {
+      throw dub::Exception("Could not reallocate %i threads.", size);
+    }
+    at_pos_ = ptr;
+    ptr = (int*)realloc(at_next_, size * sizeof(int));
+    if (!ptr) {
+      throw dub::Exception("Could not reallocate %i threads.", size);
+    }
+    at_next_ = ptr;
+    ptr = (int*)realloc(heap_, size * sizeof(int));
+    if (!ptr) {
+      throw dub::Exception("Could not reallocate %i threads.", size);
+    }
+    heap_ = ptr;
+    char *state = (char*)realloc(at_state_, size * sizeof(char));
+    if (!state) {
+      throw dub::Exception("Could not reallocate %i threads.", size);
+    }
+    at_state_ = state;
+    // Chain new slots in free list.
+    for(int i = at_size_; i < size; ++i) {
+      at_state_[i] = Free;
+      at_pos_[i]   = -1;
+      at_next_[i]  = i + 1 < size ? i + 1 : -1;
+    }
+    at_free_ = at_size_;
+    at_size_ = size;
+  }
+  int slot = at_free_;
+  at_free_ = at_next_[slot];
+  return slot;
+}
+
+void Scheduler::linkSlot(int slot) {
+  // heap_ has room for all slots.
+  int pos = heap_count_++;
+  heap_[pos]    = slot;
+  at_pos_[slot] = pos;
+  siftUp(pos);
+}
+
+void Scheduler::unlinkSlot(int slot) {
+  int pos  = at_pos_[slot];
+  int last = heap_[--heap_count_];
+  at_pos_[slot] = -1;
+  if (last != slot) {
+    // Move last element in the hole and restore heap order.
+    heap_[pos]    = last;
+    at_pos_[last] = pos;
+    if (pos > 0 && before(last, heap_[(pos - 1) / 2])) {
+      siftUp(pos);
+    } else {
+      siftDown(pos);
+    }
+  }
+}
+
+void Scheduler::siftUp(int pos) {
+  int slot = heap_[pos];
+  while (pos > 0) {
+    int parent = (pos - 1) / 2;
+    if (!before(slot, heap_[parent])) break;
+    heap_[pos] = heap_[parent];
+    at_pos_[heap_[pos]] = pos;
+    pos = parent;
+  }
+  heap_[pos]    = slot;
+  at_pos_[slot] = pos;
+}
+
+void Scheduler::siftDown(int pos) {
+  int slot = heap_[pos];
+  while (true) {
+    int child = 2 * pos + 1;
+    if (child >= heap_count_) break;
+    if (child + 1 < heap_count_ && before(heap_[child + 1], heap_[child])) {
+      ++child;
+    }
+    if (!before(heap_[child], slot)) break;
+    heap_[pos] = heap_[child];
+    at_pos_[heap_[pos]] = pos;
+    pos = child;
+  }
+  heap_[pos]    = slot;
+  at_pos_[slot] = pos;
+}
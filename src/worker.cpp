@@ -0,0 +1,136 @@
+/*
+  ==============================================================================
+
+   This file is part of the LUBYK project (http://lubyk.org)
+   Copyright (c) 2007-2014 by Gaspard Bucher (http://teti.ch).
+
+  ------------------------------------------------------------------------------
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+
+  ==============================================================================
+*/
+#include "lens/Worker.h"
+
+#include <stdio.h>  // fprintf
+#include <string.h> // memcpy
+
+extern "C" {
+#include <lualib.h>
+}
+
+using namespace lens;
+
+Worker::Worker(const char *code, lua_State *L)
+  : job_(NULL)
+  , joined_(false) {
+  int top = lua_gettop(L);
+  for(int i = 2; i <= top; ++i) {
+    // Check arguments before allocating anything.
+    dub::checksdata(L, i, "lens.Mailbox");
+  }
+  Job *job = (Job*)calloc(1, sizeof(Job));
+  if (!job) {
+    throw dub::Exception("Could not allocate worker.");
+  }
+  // One reference for the Worker and one for the thread.
+  job->refcount = 2;
+  job->code_len = strlen(code);
+  job->code     = (char*)malloc(job->code_len + 1);
+  if (top > 1) {
+    job->queues = (Mailbox::Queue**)malloc((top - 1) * sizeof(Mailbox::Queue*));
+  }
+  if (!job->code || (top > 1 && !job->queues)) {
+    job->refcount = 1;
+    release(job);
+    throw dub::Exception("Could not allocate worker.");
+  }
+  memcpy(job->code, code, job->code_len + 1);
+
+  for(int i = 2; i <= top; ++i) {
+    Mailbox *mbox = *((Mailbox **)dub::checksdata(L, i, "lens.Mailbox"));
+    Mailbox::retain(mbox->queue_);
+    job->queues[job->queue_count++] = mbox->queue_;
+  }
+
+  int err = lens::startThread(&thread_, sRun, job);
+  if (err) {
+    job->refcount = 1;
+    release(job);
+    throw dub::Exception("Could not start worker thread (%s).", strerror(err));
+  }
+  job_ = job;
+}
+
+Worker::~Worker() {
+  if (!joined_) {
+    // Keep running until the code returns.
+    pthread_detach(thread_);
+  }
+  release(job_);
+}
+
+void Worker::join() {
+  if (joined_) return;
+  pthread_join(thread_, NULL);
+  joined_ = true;
+}
+
+void *Worker::sRun(void *data) {
+  Job *job = (Job*)data;
+  int status = 1;
+  lua_State *L = luaL_newstate();
+  if (L) {
+    luaL_openlibs(L);
+
+    // Load mailbox methods (this also loads lens.core).
+    lua_getglobal(L, "require");
+    lua_pushstring(L, "lens.Mailbox");
+    status = lua_pcall(L, 1, 0, 0);
+    if (!status) {
+      status = luaL_loadbuffer(L, job->code, job->code_len, "lens.Worker");
+    }
+    if (!status) {
+      for(int i = 0; i < job->queue_count; ++i) {
+        // The Mailbox shares the queue and releases it on garbage collection.
+        dub::pushudata(L, new Mailbox(job->queues[i]), "lens.Mailbox", true);
+      }
+      status = lua_pcall(L, job->queue_count, 0, 0);
+    }
+    if (status) {
+      fprintf(stderr, "Error in worker: %s\n", lua_tostring(L, -1));
+    }
+    lua_close(L);
+  } else {
+    fprintf(stderr, "Worker: could not create Lua state.\n");
+  }
+  __atomic_store_n(&job->done, 1, __ATOMIC_RELEASE);
+  release(job);
+  return NULL;
+}
+
+void Worker::release(Job *job) {
+  if (__atomic_sub_fetch(&job->refcount, 1, __ATOMIC_ACQ_REL)) return;
+  for(int i = 0; i < job->queue_count; ++i) {
+    Mailbox::release(job->queues[i]);
+  }
+  if (job->queues) free(job->queues);
+  if (job->code)   free(job->code);
+  free(job);
+}
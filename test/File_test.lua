@@ -0,0 +1,354 @@
+--[[------------------------------------------------------
+
+  lens.File test
+  --------------
+
+  ...
+
+--]]------------------------------------------------------
+local lub    = require 'lub'
+local lens   = require 'lens'
+local lut    = require 'lut'
+local should = lut.Test 'lens.File'
+
+local File = lens.File
+
+local function bigContent()
+  local list = {}
+  for i = 1, 100000 do
+    list[i] = string.format('%08i: 0123456789abcdef', i)
+  end
+  -- More than 2MB
+  return table.concat(list, '\n')
+end
+
+local function run(func)
+  local sc = lens.Scheduler()
+  sc.willTerminate = function() end
+  sc:run(func)
+end
+
+function should.autoload()
+  assertType('table', File)
+end
+
+function should.readLine()
+  local f = File(lub.path '|fixtures/io.txt', File.Read)
+  assertEqual('Hello Lubyk!', f:readLine())
+  assertNil(f:readLine())
+end
+
+function should.readLineWithDelimiter()
+  local path = lub.path '|tmp_lines.txt'
+  lub.writeall(path, 'one;two\r\n;three')
+  local f = File(path, File.Read)
+  assertEqual('one', f:readLine(';'))
+  -- "\r" is only removed before "\n".
+  assertEqual('two\r\n', f:readLine(';'))
+  assertEqual('three', f:readLine(';'))
+  assertNil(f:readLine(';'))
+  f:close()
+  lub.rmFile(path)
+end
+
+function should.readLineKeepCR()
+  local path = lub.path '|tmp_lines.txt'
+  lub.writeall(path, 'one\r\ntwo\r\n')
+  local f = File(path, File.Read)
+  assertEqual('one\r', f:readLine(nil, true))
+  assertEqual('two', f:readLine())
+  assertNil(f:readLine())
+  f:close()
+  lub.rmFile(path)
+end
+
+function should.readLineWithCRLFAcrossBuffers()
+  local path = lub.path '|tmp_lines.txt'
+  -- "\r" is the last byte of the 8196 bytes buffer, "\n" comes with the
+  -- next read.
+  local first = string.rep('a', 8195)
+  lub.writeall(path, first .. '\r\nnext\r\n')
+  local f = File(path, File.Read)
+  assertEqual(first, f:readLine())
+  assertEqual('next', f:readLine())
+  assertNil(f:readLine())
+  f:close()
+  lub.rmFile(path)
+end
+
+function should.read()
+  local f = File(lub.path '|fixtures/io.txt', File.Read)
+  assertEqual('Hello', f:read(5))
+  assertEqual(' Lubyk!\n', f:read(100))
+  assertNil(f:read(5))
+end
+
+function should.readAll()
+  local f = File(lub.path '|fixtures/io.txt', File.Read)
+  assertEqual('Hello Lubyk!\n', f:readAll())
+  -- Nothing more
+  assertEqual('', f:readAll())
+end
+
+function should.readAllAfterReadLine()
+  local path = lub.path '|tmp_readAll.txt'
+  lub.writeall(path, 'one\ntwo\nthree')
+  local f = File(path, File.Read)
+  assertEqual('one', f:readLine())
+  assertEqual('two\nthree', f:readAll())
+  lub.rmFile(path)
+end
+
+function should.readAllLargeFile()
+  local path = lub.path '|tmp_readAll.txt'
+  local content = bigContent()
+  lub.writeall(path, content)
+  local f = File(path, File.Read)
+  assertEqual('00000001', f:read(8))
+  -- Mapped in memory
+  local data = f:readAll()
+  assertEqual(#content - 8, #data)
+  assertTrue(content:sub(9) == data)
+  lub.rmFile(path)
+end
+
+function should.readMappedFile()
+  local path = lub.path '|tmp_mmap.txt'
+  lub.writeall(path, 'one\r\ntwo\nthree')
+  local f = File(path, File.Mmap)
+  assertEqual(14, f:size())
+  assertEqual('one', f:readLine())
+  assertEqual('two', f:read(3))
+  assertEqual('', f:readLine())
+  assertEqual('three', f:readLine())
+  assertNil(f:readLine())
+  assertNil(f:read(1))
+  f:close()
+  lub.rmFile(path)
+end
+
+function should.sliceMappedFile()
+  local path = lub.path '|tmp_mmap.txt'
+  local content = bigContent()
+  lub.writeall(path, content)
+  local f = File(path, File.Mmap)
+  f:advise(File.Random)
+  assertEqual('00050000: 0123456789abcdef', f:slice(49999 * 27, 26))
+  assertEqual('00100000: 0123456789abcdef', f:slice(#content - 26, 100))
+  assertEqual('', f:slice(#content, 10))
+  -- Slices do not move the read position.
+  assertEqual('00000001', f:read(8))
+  f:advise(File.WillNeed, 1000, 1000)
+  assertEqual(#content - 8, #f:readAll())
+  f:close()
+  lub.rmFile(path)
+end
+
+function should.mapEmptyFile()
+  local path = lub.path '|tmp_mmap.txt'
+  lub.writeall(path, '')
+  local f = File(path, File.Mmap)
+  assertEqual(0, f:size())
+  assertNil(f:readLine())
+  assertEqual('', f:readAll())
+  f:close()
+  lub.rmFile(path)
+end
+
+function should.readAndWriteInBackground()
+  local path = lub.path '|tmp_async.txt'
+  local content = bigContent()
+  local wsz, data, rest
+  lub.writeall(path, '')
+  run(function()
+    local f = File(path, File.Write)
+    wsz = f:writeAsync(content)
+    assertTrue(f:sync(true))
+    f:close()
+
+    f = File(path, File.Read)
+    -- Mix with buffered reads.
+    assertEqual('00000001: 0123456789abcdef', f:readLine())
+    data = f:readAsync(#content)
+    rest = f:readAsync(10)
+    f:close()
+  end)
+  assertEqual(#content, wsz)
+  assertEqual(#content - 27, #data)
+  assertEqual(string.sub(content, 28), data)
+  assertNil(rest)
+  lub.rmFile(path)
+end
+
+function should.queueBackgroundOperations()
+  local path = lub.path '|tmp_async.txt'
+  lub.writeall(path, 'abcdef')
+  local first, second
+  run(function()
+    local f = File(path, File.Read)
+    local th = lens.Thread(function()
+      -- Starts while the first read is running.
+      second = f:readAsync(3)
+    end)
+    first = f:readAsync(3)
+    th:join()
+    f:close()
+  end)
+  assertEqual('abc', first)
+  assertEqual('def', second)
+  lub.rmFile(path)
+end
+
+function should.waitForBackgroundOperationsBeforeRead()
+  local path = lub.path '|tmp_async.txt'
+  lub.writeall(path, 'abc\ndef\nghi')
+  local first, line, rest
+  run(function()
+    local f = File(path, File.Read)
+    local th = lens.Thread(function()
+      -- Called while the async read is pending.
+      line = f:readLine()
+      rest = f:readAll()
+    end)
+    first = f:readAsync(4)
+    th:join()
+    f:close()
+  end)
+  assertEqual('abc\n', first)
+  assertEqual('def', line)
+  assertEqual('ghi', rest)
+  lub.rmFile(path)
+end
+
+function should.bufferWrites()
+  local path = lub.path '|tmp_buffer.txt'
+  lub.writeall(path, '')
+  local f = File(path, File.Write)
+  f:setBuffer(10)
+  f:write('abc')
+  f:write('def')
+  assertEqual(6, f:buffered())
+  assertEqual('', lub.content(path))
+  -- Full buffer is flushed.
+  f:write('ghij')
+  assertEqual(0, f:buffered())
+  assertEqual('abcdefghij', lub.content(path))
+  f:write('kl')
+  f:flush()
+  assertEqual('abcdefghijkl', lub.content(path))
+  f:write('mn')
+  f:close()
+  assertEqual('abcdefghijklmn', lub.content(path))
+  lub.rmFile(path)
+end
+
+function should.flushBufferAfterInterval()
+  local path = lub.path '|tmp_buffer.txt'
+  lub.writeall(path, '')
+  local before, after
+  run(function()
+    local f = File(path, File.Write)
+    f:setBuffer(1000, 0.01)
+    f:write('one')
+    f:write('two')
+    before = lub.content(path)
+    lens.sleep(0.05)
+    after = lub.content(path)
+    f:close()
+  end)
+  assertEqual('', before)
+  assertEqual('onetwo', after)
+  lub.rmFile(path)
+end
+
+function should.groupCommits()
+  local path = lub.path '|tmp_buffer.txt'
+  lub.writeall(path, '')
+  local done = 0
+  run(function()
+    local f = File(path, File.Write)
+    f:setBuffer(1000)
+    local threads = {}
+    for i = 1, 5 do
+      threads[i] = lens.Thread(function()
+        f:write(i .. ',')
+        f:commit()
+        done = done + 1
+      end)
+    end
+    for i = 1, 5 do
+      threads[i]:join()
+    end
+    f:close()
+  end)
+  assertEqual(5, done)
+  assertEqual('1,2,3,4,5,', lub.content(path))
+  lub.rmFile(path)
+end
+
+function should.readAndWriteAtOffset()
+  local path = lub.path '|tmp_records.bin'
+  lub.writeall(path, '')
+  local f = File(path, File.ReadWrite)
+  assertEqual(11, f:writeAt(4, 'hello', ' ', 'world'))
+  assertEqual(2, f:writeAt(0, 'ab'))
+  assertEqual('hello', f:readAt(4, 5))
+  local a, b, c = f:readAt(4, 5, 1, 100)
+  assertEqual('hello', a)
+  assertEqual(' ', b)
+  assertEqual('world', c)
+  -- The read position is not used.
+  assertEqual('ab\0\0hello world', f:read(100))
+  assertNil(f:readAt(15, 10))
+  f:close()
+  lub.rmFile(path)
+end
+
+function should.flushBufferBeforePositionalIO()
+  local path = lub.path '|tmp_records.bin'
+  lub.writeall(path, '')
+  local f = File(path, File.ReadWrite)
+  f:setBuffer(4096)
+  f:write('xyz')
+  assertEqual('x', f:readAt(0, 1))
+  f:write('abc')
+  -- Replaces the buffered bytes.
+  assertEqual(3, f:writeAt(3, 'ABC'))
+  f:write('def')
+  f:close()
+  assertEqual('xyzABCdef', lub.content(path))
+  lub.rmFile(path)
+end
+
+function should.keepOrderDuringCommitAndAsyncWrite()
+  local path = lub.path '|tmp_buffer.txt'
+  lub.writeall(path, '')
+  local big = string.rep('c', 1000000)
+  run(function()
+    local f = File(path, File.Write)
+    f:setBuffer(4)
+    local state
+    local th = lens.Thread(function()
+      while state ~= 'commit' do lens.sleep(0.001) end
+      -- Fills the buffer several times while the sync is pending.
+      for i = 1, 10 do f:write('b') end
+      while state ~= 'async' do lens.sleep(0.001) end
+      -- Written while the async write is pending.
+      for i = 1, 10 do f:write('d') end
+    end)
+    f:write('aa')
+    state = 'commit'
+    f:commit()
+    lens.sleep(0.01)
+    state = 'async'
+    f:writeAsync(big)
+    th:join()
+    f:close()
+  end)
+  assertEqual('aa' .. string.rep('b', 10) .. big .. string.rep('d', 10), lub.content(path))
+  lub.rmFile(path)
+end
+
+should.ignore.deleted = true
+
+should:test()
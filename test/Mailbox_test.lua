@@ -0,0 +1,50 @@
+--[[------------------------------------------------------
+
+  lens.Mailbox test
+  -----------------
+
+  ...
+
+--]]------------------------------------------------------
+local lens   = require 'lens'
+local lut    = require 'lut'
+local should = lut.Test 'lens.Mailbox'
+
+local Mailbox = lens.Mailbox
+
+function should.autoload()
+  assertType('table', Mailbox)
+end
+
+function should.tostring()
+  local m = Mailbox()
+  assertMatch('lens.Mailbox: 0x.* %(0%)', tostring(m))
+end
+
+function should.postAndRecv()
+  local m = Mailbox()
+  assertNil(m:recv())
+  m:post('hello')
+  m:post('x\0y')
+  assertEqual(2, m:pending())
+  assertEqual('hello', m:recv())
+  assertEqual('x\0y', m:recv())
+  assertNil(m:recv())
+  assertEqual(0, m:pending())
+end
+
+function should.receiveInScheduler()
+  local m = Mailbox()
+  local s = lens.Scheduler()
+  local msg
+  s:run(function()
+    lens.Thread(function()
+      msg = m:receive()
+    end)
+    lens.sleep(0.01)
+    m:post('hello')
+  end)
+  assertEqual('hello', msg)
+end
+
+should:test()
@@ -0,0 +1,229 @@
+--[[------------------------------------------------------
+
+  lens.Poller test
+  ----------------
+
+
+--]]------------------------------------------------------
+local lens   = require 'lens'
+local lut    = require 'lut'
+local should = lut.Test 'lens.Poller'
+
+local Poller,      Socket,      elapsed =
+      lens.Poller, lens.Socket, lens.elapsed
+
+local Read, Write, Edge, OneShot =
+      Poller.Read, Poller.Write, Poller.Edge, Poller.OneShot
+
+-- Bound UDP socket: always ready for writing, not readable.
+local function udpSocket()
+  local s = Socket(Socket.UDP)
+  s:bind('127.0.0.1', 0)
+  return s
+end
+
+function should.tostring()
+  local p = Poller()
+  assertMatch('lens.Poller:', tostring(p))
+end
+
+function should.addAndRemove()
+  local p = Poller()
+  local s = udpSocket()
+  local a = p:add(s:fd(), Read)
+  local b = p:add(s:fd(), Write)
+  assertEqual(2, p:count())
+  assertEqual(0, p:idxToPos(a))
+  assertEqual(1, p:idxToPos(b))
+  p:remove(a)
+  assertEqual(1, p:count())
+  -- compaction
+  assertEqual(0, p:idxToPos(b))
+  assertEqual(-1, p:idxToPos(a))
+end
+
+function should.reuseFreeIdx()
+  local p = Poller(4)
+  local s = udpSocket()
+  local list = {}
+  for i = 1, 100 do
+    list[i] = p:add(s:fd(), Write)
+  end
+  assertEqual(99, list[100])
+  for i = 100, 2, -1 do
+    p:remove(list[i])
+  end
+  assertEqual(1, p:count())
+  -- Shrunk and first free idx reused.
+  assertEqual(1, p:add(s:fd(), Read))
+  assertEqual(0, p:idxToPos(list[1]))
+  assertEqual(1, p:idxToPos(1))
+end
+
+function should.pollWriteEvents()
+  local p = Poller()
+  local s = udpSocket()
+  local r = p:add(s:fd(), Read)
+  local w = p:add(s:fd(), Write)
+  assertTrue(p:poll(elapsed() + 1))
+  -- Only the write item is ready.
+  assertValueEqual({w}, p:events())
+end
+
+function should.fillEvents()
+  local p = Poller()
+  local s = udpSocket()
+  local r = p:add(s:fd(), Read)
+  local w = p:add(s:fd(), Write)
+  local events, revents = {}, {}
+  assertTrue(p:poll(elapsed() + 1))
+  assertEqual(1, p:fillEvents(events, revents))
+  assertEqual(w, events[1])
+  assertEqual(Write, revents[1])
+  -- Tables are reused
+  assertTrue(p:poll(elapsed() + 1))
+  assertEqual(1, p:fillEvents(events))
+  assertValueEqual({w}, events)
+end
+
+function should.timeout()
+  local p = Poller()
+  local s = udpSocket()
+  p:add(s:fd(), Read)
+  local start = elapsed()
+  assertTrue(p:poll(start + 0.02))
+  assertTrue(elapsed() - start >= 0.02)
+  assertNil(p:events())
+end
+
+function should.wakeUpWithSubMillisecondPrecision()
+  local p = Poller()
+  local s = udpSocket()
+  p:add(s:fd(), Read)
+  local wake_at = elapsed() + 0.0005
+  assertTrue(p:poll(wake_at))
+  local late = elapsed() - wake_at
+  assertTrue(late >= 0)
+  -- Not rounded to milliseconds.
+  assertTrue(late < 0.001)
+end
+
+function should.rearmTimerToNewWakeAt()
+  local p = Poller()
+  local s = udpSocket()
+  p:add(s:fd(), Read)
+  local w = p:add(s:fd(), Write)
+  -- Returns on the write event with the timer armed far away.
+  assertTrue(p:poll(elapsed() + 10))
+  assertValueEqual({w}, p:events())
+  p:remove(w)
+  for _, delay in ipairs {0.002, 0.005} do
+    local wake_at = elapsed() + delay
+    assertTrue(p:poll(wake_at))
+    local late = elapsed() - wake_at
+    assertNil(p:events())
+    assertTrue(late >= 0)
+    assertTrue(late < 0.001)
+  end
+end
+
+function should.modifyFilter()
+  local p = Poller()
+  local s = udpSocket()
+  local idx = p:add(s:fd(), Read)
+  p:modify(idx, Write, s:fd(), 0)
+  assertTrue(p:poll(elapsed() + 1))
+  assertValueEqual({idx}, p:events())
+end
+
+function should.reportOneShotOnce()
+  local p = Poller()
+  local s = udpSocket()
+  local w = p:add(s:fd(), Write + OneShot)
+  assertTrue(p:poll(elapsed() + 1))
+  assertValueEqual({w}, p:events())
+  if p:backend() ~= Poller.Poll then
+    -- Disarmed
+    assertTrue(p:poll(elapsed() + 0.01))
+    assertNil(p:events())
+  end
+  -- modify re-arms
+  p:modify(w, Write + OneShot, s:fd(), 0)
+  assertTrue(p:poll(elapsed() + 1))
+  assertValueEqual({w}, p:events())
+end
+
+local function reportEdgeOnce(backend)
+  local p = Poller(8, backend)
+  local s = udpSocket()
+  local w = p:add(s:fd(), Write + Edge)
+  assertTrue(p:poll(elapsed() + 1))
+  assertValueEqual({w}, p:events())
+  if p:backend() ~= Poller.Poll then
+    -- Still writable but no new edge.
+    assertTrue(p:poll(elapsed() + 0.01))
+    assertNil(p:events())
+  end
+end
+
+function should.reportEdgeOnce()
+  reportEdgeOnce(Poller.Default)
+end
+
+function should.reportEdgeOnceWithURing()
+  reportEdgeOnce(Poller.URing)
+end
+
+local function reportEdgeAfterDrain(backend)
+  local p = Poller(8, backend)
+  local s = udpSocket()
+  local cli = Socket(Socket.UDP)
+  cli:connect('127.0.0.1', s.port)
+  local r = p:add(s:fd(), Read + Edge)
+  assertTrue(p:poll(elapsed() + 0.01))
+  assertNil(p:events())
+  for i = 1, 3 do
+    cli:send('msg '..i)
+    assertTrue(p:poll(elapsed() + 1))
+    assertValueEqual({r}, p:events())
+    if p:backend() ~= Poller.Poll then
+      -- Data still there but no new edge.
+      assertTrue(p:poll(elapsed() + 0.01))
+      assertNil(p:events())
+      assertEqual('msg '..i, (s:recvMessage()))
+      -- Drained: still armed for the next message.
+      assertTrue(p:poll(elapsed() + 0.01))
+      assertNil(p:events())
+    else
+      assertEqual('msg '..i, (s:recvMessage()))
+    end
+  end
+end
+
+function should.reportEdgeAfterDrain()
+  reportEdgeAfterDrain(Poller.Default)
+end
+
+function should.reportEdgeAfterDrainWithURing()
+  reportEdgeAfterDrain(Poller.URing)
+end
+
+function should.selectURingBackend()
+  local p = Poller(8, Poller.URing)
+  local b = p:backend()
+  -- Falls back to epoll on older kernels.
+  assertTrue(b == Poller.URing or b == Poller.EPoll or b == Poller.KQueue)
+  local s = udpSocket()
+  local r = p:add(s:fd(), Read)
+  local w = p:add(s:fd(), Write)
+  assertTrue(p:poll(elapsed() + 1))
+  assertValueEqual({w}, p:events())
+  -- Level triggered: still ready.
+  assertTrue(p:poll(elapsed() + 1))
+  assertValueEqual({w}, p:events())
+  p:remove(w)
+  assertTrue(p:poll(elapsed() + 0.01))
+  assertNil(p:events())
+end
+
+should:test()
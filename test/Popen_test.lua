@@ -54,6 +54,16 @@ function should.readLine()
   assertEqual(nil, t2)
 end
 
+function should.readAll()
+  local s = lens.Scheduler()
+  local t
+  s:run(function()
+    local p = lens.Popen('printf "one\\ntwo"; sleep 0.05; printf "\\nthree"')
+    t = p:readAll()
+  end)
+  assertEqual('one\ntwo\nthree', t)
+end
+
 function should.waitWrite()
   local s = lens.Scheduler()
   local path = lub.path '|tmp_waitWrite.txt'
@@ -0,0 +1,71 @@
+--[[------------------------------------------------------
+
+  lens.Resolver test
+  ------------------
+
+  ...
+
+--]]------------------------------------------------------
+local lens   = require 'lens'
+local lut    = require 'lut'
+local should = lut.Test 'lens.Resolver'
+
+local Resolver = lens.Resolver
+
+local function run(func)
+  local sc = lens.Scheduler()
+  sc.willTerminate = function() end
+  sc:run(func)
+end
+
+function should.autoload()
+  assertType('table', Resolver)
+end
+
+function should.resolveAndCache()
+  local addr, err
+  run(function()
+    addr, err = Resolver.resolve('localhost')
+  end)
+  assertNil(err)
+  assertMatch('^[0-9a-f.:]+$', addr)
+  assertEqual(addr, Resolver.cached('localhost'))
+end
+
+function should.notResolveNumericAddress()
+  -- No lookup, never yields.
+  assertEqual('127.0.0.1', Resolver.cached('127.0.0.1'))
+  assertEqual('::1', Resolver.cached('::1'))
+end
+
+function should.setTTL()
+  local ttl = Resolver.ttl()
+  assertEqual(60, ttl)
+  Resolver.setTTL(0)
+  assertNil(Resolver.cached('localhost'))
+  Resolver.setTTL(ttl)
+end
+
+function should.reverseLookupInBackground()
+  local name, err
+  run(function()
+    local th = lens.Thread(function()
+      -- The scheduler keeps running during the lookup.
+      while not name and not err do
+        lens.sleep(0.001)
+      end
+    end)
+    name, err = Resolver.reverse('127.0.0.1')
+    th:kill()
+  end)
+  assertNil(err)
+  assertType('string', name)
+end
+
+function should.returnErrorOnInvalidAddress()
+  run(function()
+    local name, err = Resolver.reverse('not an address')
+    assertNil(name)
+    assertType('string', err)
+  end)
+end
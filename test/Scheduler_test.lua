@@ -38,4 +38,51 @@ function should.restart()
   assertEqual(2, x)
 end
 
+function should.resumeFdThreadWithRevents()
+  local ev
+  local s = Scheduler()
+  s:run(function()
+    local sock = lens.Socket(lens.Socket.UDP)
+    sock:bind('127.0.0.1', 0)
+    ev = coroutine.yield('write', sock:fd())
+  end)
+  assertEqual(lens.Poller.Write, ev)
+end
+
+function should.runThreadsInTimeOrder()
+  local seq = {}
+  local s = Scheduler()
+  s:run(function()
+    lens.Thread(function()
+      lens.sleep(0.02)
+      table.insert(seq, 'b')
+    end)
+    lens.Thread(function()
+      lens.sleep(0.01)
+      table.insert(seq, 'a')
+    end)
+    lens.Thread(function()
+      lens.sleep(0.02)
+      table.insert(seq, 'c')
+    end)
+  end)
+  assertValueEqual({'a', 'b', 'c'}, seq)
+end
+
+function should.killSleepingThread()
+  local x
+  local s = Scheduler()
+  s:run(function()
+    local t = lens.Thread(function()
+      lens.sleep(0.01)
+      x = 1
+    end)
+    lens.sleep(0.005)
+    t:kill()
+  end)
+  assertNil(x)
+  assertEqual(0, s:fdCount())
+  assertEqual(-1, s:wakeAt())
+end
+
 should:test()
@@ -5,6 +5,7 @@
 
 
 --]]------------------------------------------------------
+local lub    = require 'lub'
 local lens   = require 'lens'
 local lut    = require 'lut'
 local should = lut.Test 'lens.Socket'
@@ -149,6 +150,254 @@ function should.send(t)
   end)
 end
 
+function should.recvLineWithOptions(t)
+  run(function()
+    t.server = Socket()
+    t.port = t.server:bind('*', 0)
+    t.server:listen()
+    t.thread = lens.Thread(function()
+      local client = t.server:accept()
+      t.received1 = client:recvLine()
+      t.received2 = client:recvLine(nil, true)
+      t.received3 = client:recvLine(';')
+      t.received4 = client:recvLine()
+      client:close()
+    end)
+    t.client = Socket()
+    t.client:connect('127.0.0.1', t.port)
+    t.client:send('one\r\ntwo\r')
+    -- '\r' and '\n' in different packets
+    lens.sleep(0.01)
+    t.client:send('\nthree;four\n')
+    t.thread:join()
+    t.client:close()
+    assertEqual('one', t.received1)
+    assertEqual('two\r', t.received2)
+    assertEqual('three', t.received3)
+    assertEqual('four', t.received4)
+  end)
+end
+
+function should.useSmallReceiveBuffer(t)
+  run(function()
+    t.server = Socket(Socket.TCP, 16)
+    assertEqual(16, t.server:bufferSize())
+    t.port = t.server:bind('*', 0)
+    t.server:listen()
+    t.thread = lens.Thread(function()
+      local client = t.server:accept()
+      -- accepted sockets use the same buffer size
+      t.size = client:bufferSize()
+      t.received = client:recvLine()
+      client:close()
+    end)
+    t.client = Socket()
+    t.client:connect('127.0.0.1', t.port)
+    t.client:send(string.rep('x', 100) .. '\n')
+    t.thread:join()
+    t.client:close()
+    assertEqual(16, t.size)
+    assertEqual(string.rep('x', 100), t.received)
+  end)
+end
+
+function should.sendRecvFrames(t)
+  run(function()
+    t.server = Socket()
+    t.port = t.server:bind('*', 0)
+    t.server:listen()
+    local big = string.rep('0123456789', 10000)
+    t.thread = lens.Thread(function()
+      local client = t.server:accept()
+      t.received1 = client:recvFrame()
+      t.received2 = client:recvFrame()
+      t.received3 = client:recvFrame()
+      client:close()
+    end)
+    t.client = Socket()
+    t.client:connect('127.0.0.1', t.port)
+    t.client:sendFrame('Hello')
+    t.client:sendFrame('')
+    t.client:sendFrame(big)
+    t.thread:join()
+    t.client:close()
+    assertEqual('Hello', t.received1)
+    assertEqual('', t.received2)
+    assertEqual(big, t.received3)
+  end)
+end
+
+function should.refuseFramesAfterInvalidSize(t)
+  run(function()
+    t.server = Socket()
+    t.port = t.server:bind('*', 0)
+    t.server:listen()
+    t.thread = lens.Thread(function()
+      local client = t.server:accept()
+      lens.waitRead(client.sock_fd)
+      -- Native calls (pcall cannot yield in Lua 5.1).
+      local super = client.super
+      t.ok1, t.err1 = pcall(super.recvFrame, super)
+      t.ok2, t.err2 = pcall(super.recvFrame, super)
+      client:close()
+    end)
+    t.client = Socket()
+    t.client:connect('127.0.0.1', t.port)
+    t.client:send('\255\255\255\255garbage')
+    t.thread:join()
+    t.client:close()
+    assertFalse(t.ok1)
+    assertMatch('Frame too large', t.err1)
+    assertFalse(t.ok2)
+    assertMatch('Frame stream broken', t.err2)
+  end)
+end
+
+function should.sendRecvValues(t)
+  run(function()
+    t.server = Socket()
+    t.port = t.server:bind('*', 0)
+    t.server:listen()
+    t.thread = lens.Thread(function()
+      local client = t.server:accept()
+      t.received1 = client:recvValue()
+      t.received2 = client:recvValue()
+      t.received3 = client:recvValue()
+      client:close()
+    end)
+    t.client = Socket()
+    t.client:connect('127.0.0.1', t.port)
+    t.client:sendValue {1, 'two', {three = 3.5, four = true}}
+    t.client:sendValue(nil)
+    t.client:sendValue(string.rep('x', 100000))
+    t.thread:join()
+    t.client:close()
+    assertValueEqual({1, 'two', {three = 3.5, four = true}}, t.received1)
+    assertNil(t.received2)
+    assertEqual(string.rep('x', 100000), t.received3)
+  end)
+end
+
+function should.sendSeveralStrings(t)
+  run(function()
+    t.server = Socket()
+    t.port = t.server:bind('*', 0)
+    t.server:listen()
+    local big = string.rep('x', 4000000)
+    t.thread = lens.Thread(function()
+      local client = t.server:accept()
+      t.received1 = client:recvLine()
+      t.received2 = client:recvBytes(#big)
+      t.received3 = client:recvLine()
+      client:close()
+    end)
+    t.client = Socket()
+    t.client:connect('127.0.0.1', t.port)
+    t.client:send('Hello', ' ', 'Lubyk!', '\n')
+    -- Returns before the data is sent.
+    t.client:setWatermark(#big * 2)
+    t.client:send(big, 'done\n')
+    t.client:flush()
+    assertEqual(0, t.client:pending())
+    t.thread:join()
+    t.client:close()
+    assertEqual('Hello Lubyk!', t.received1)
+    assertEqual(#big, #t.received2)
+    assertEqual('done', t.received3)
+  end)
+end
+
+function should.sendRecvWithCompletionIO(t)
+  -- With io_uring, the poller runs recv and send while threads wait (falls
+  -- back to readiness on older kernels).
+  local big = string.rep('x', 4000000)
+  local sc = Scheduler(lens.Poller(8, lens.Poller.URing))
+  sc.willTerminate = function() end
+  sc:run(function()
+    t.server = Socket()
+    t.port = t.server:bind('*', 0)
+    t.server:listen()
+    t.thread = lens.Thread(function()
+      local client = t.server:accept()
+      t.received1 = client:recvLine()
+      t.received2 = client:recvBytes(#big)
+      t.received3 = client:recvFrame()
+      t.received4 = client:recvValue()
+      client:send('bye\n')
+      client:close()
+    end)
+    t.client = Socket()
+    t.client:connect('127.0.0.1', t.port)
+    t.client:send('Hello\r')
+    -- '\r' and '\n' in different packets
+    lens.sleep(0.01)
+    t.client:send('\n')
+    t.client:send(big)
+    t.client:sendFrame('frame')
+    t.client:sendValue({1, 'two'})
+    t.reply = t.client:recvLine()
+    t.thread:join()
+    t.client:close()
+  end)
+  assertEqual('Hello', t.received1)
+  assertEqual(big, t.received2)
+  assertEqual('frame', t.received3)
+  assertValueEqual({1, 'two'}, t.received4)
+  assertEqual('bye', t.reply)
+end
+
+function should.sendFileAndPipe(t)
+  run(function()
+    t.server = Socket()
+    t.port = t.server:bind('*', 0)
+    t.server:listen()
+    t.thread = lens.Thread(function()
+      local client = t.server:accept()
+      t.received1 = client:recvLine()
+      t.received2 = client:recvLine()
+      t.received3 = client:recvLine()
+      client:close()
+    end)
+    t.client = Socket()
+    t.client:connect('127.0.0.1', t.port)
+    local file = lens.File(lub.path '|fixtures/io.txt', lens.File.Read)
+    t.sent1 = t.client:sendFile(file)
+    t.sent2 = t.client:sendFile(file, 6, 5)
+    t.client:send('\n')
+    t.sent3 = t.client:sendPipe(lens.Popen('echo "Hello pipe"'))
+    t.thread:join()
+    t.client:close()
+    assertEqual(13, t.sent1)
+    assertEqual(5, t.sent2)
+    assertEqual(11, t.sent3)
+    assertEqual('Hello Lubyk!', t.received1)
+    assertEqual('Lubyk', t.received2)
+    assertEqual('Hello pipe', t.received3)
+  end)
+end
+
+function should.acceptMany(t)
+  run(function()
+    t.server = Socket()
+    t.port = t.server:bind('*', 0)
+    t.server:listen()
+    local clients = {}
+    for i = 1, 3 do
+      clients[i] = Socket()
+      clients[i]:connect('127.0.0.1', t.port)
+    end
+    sleep(0.05)
+    t.list = t.server:acceptMany()
+    assertEqual(3, #t.list)
+    for i, cli in ipairs(t.list) do
+      -- Numeric address (no reverse lookup).
+      assertMatch('127.0.0.1$', cli:remoteHost())
+      cli:close()
+      clients[i]:close()
+    end
+  end)
+end
+
 function should.recvBytes(t)
   run(function()
     t.server = Socket()
@@ -199,4 +448,121 @@ function should.sendRecvUDP(t)
   end)
 end
 
+function should.sendRecvMessagesUDP(t)
+  run(function()
+    t.server = Socket(Socket.UDP)
+    t.port = t.server:bind('*', 0)
+    t.thread = lens.Thread(function()
+      t.received = {}
+      while #t.received < 3 do
+        local list, hosts, ports = t.server:recvMessages(10)
+        for i, data in ipairs(list) do
+          table.insert(t.received, data)
+          t.host, t.port2 = hosts[i], ports[i]
+        end
+      end
+    end)
+    t.client = Socket(Socket.UDP)
+    t.client:connect('127.0.0.1', t.port)
+    t.client:sendMessages {'one', 'two', 'three'}
+    t.thread:join()
+    assertValueEqual({'one', 'two', 'three'}, t.received)
+    assertEqual('127.0.0.1', t.host)
+    assertEqual(t.client:localPort(), t.port2)
+  end)
+end
+
+function should.notDropMessagesAfterRefusedDatagram(t)
+  run(function()
+    local server = Socket(Socket.UDP)
+    t.port = server:bind('127.0.0.1', 0)
+    server:close()
+    t.client = Socket(Socket.UDP)
+    t.client:connect('127.0.0.1', t.port)
+    -- Port unreachable: the error is reported on the next send.
+    t.client:sendMessages {'lost'}
+    lens.sleep(0.01)
+    t.server = Socket(Socket.UDP)
+    t.server:bind('127.0.0.1', t.port)
+    local big = string.rep('x', 40000)
+    t.client:sendMessages {'one', 'two', big}
+    t.received = {}
+    while #t.received < 3 do
+      local list = t.server:recvMessages(10)
+      for _, data in ipairs(list) do
+        table.insert(t.received, data)
+      end
+    end
+    assertEqual('one', t.received[1])
+    assertEqual('two', t.received[2])
+    -- Larger than the receive buffer: not truncated.
+    assertEqual(big, t.received[3])
+  end)
+end
+
+function should.keepUDPSocketOnReconnect()
+  local server = Socket(Socket.UDP)
+  local port = server:bind('*', 0)
+  local client = Socket(Socket.UDP)
+  client:connect('127.0.0.1', port)
+  local local_port = client:localPort()
+  assertTrue(local_port > 0)
+  -- resolve again
+  client:connect('127.0.0.1', port)
+  assertEqual(local_port, client:localPort())
+end
+
+function should.bindSamePortWithReusePort()
+  local a = Socket()
+  local port = a:bind('*', 0, Socket.ReuseAddr + Socket.ReusePort)
+  a:listen()
+  local b = Socket()
+  assertEqual(port, b:bind('*', port, Socket.ReuseAddr + Socket.ReusePort))
+  b:listen()
+  local c = Socket()
+  assertError('Address already in use', function()
+    c:bind('*', port)
+  end)
+end
+
+function should.acceptInShardedWorkers(t)
+  local port
+  do
+    local s = Socket()
+    port = s:bind('*', 0)
+    s:close()
+  end
+  local workers = Socket.shardedListen('*', port, 2, [[
+    return function(cli, index)
+      cli:send(cli:recvLine() .. ' ' .. index .. '\n')
+      cli:close()
+    end
+  ]])
+  local seen = {}
+  run(function()
+    -- Give workers some time to listen.
+    sleep(0.2)
+    -- The kernel spreads connections by hashing the source port: with 40
+    -- connections, both workers get some.
+    for i = 1, 40 do
+      local cli = Socket()
+      cli:connect('127.0.0.1', port)
+      cli:send('hello '..i..'\n')
+      local reply = cli:recvLine()
+      cli:close()
+      local msg, index = string.match(reply, '^(.*) (%d+)$')
+      t['reply'..i] = msg
+      seen[index] = true
+    end
+  end)
+  assertEqual('hello 1', t.reply1)
+  assertEqual('hello 40', t.reply40)
+  assertTrue(seen['1'])
+  assertTrue(seen['2'])
+
+  Socket.stopSharded(workers)
+  assertFalse(workers[1]:running())
+  assertFalse(workers[2]:running())
+end
+
 should:test()
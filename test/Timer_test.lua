@@ -30,6 +30,39 @@ function should.createInScheduler()
   assertEqual('lens.Timer', t.type)
 end
 
+function should.stopManyTimers()
+  local s = Scheduler()
+  local counts = {}
+  local at_stop = {}
+  s:run(function()
+    local list = {}
+    for i = 1, 1000 do
+      counts[i] = 0
+      list[i] = Timer(0.01, function()
+        counts[i] = counts[i] + 1
+      end)
+    end
+    sleep(0.005)
+    for i = 1, 1000, 2 do
+      list[i]:stop()
+      at_stop[i] = counts[i]
+    end
+    sleep(0.01)
+    for i = 2, 1000, 2 do
+      list[i]:stop()
+      at_stop[i] = counts[i]
+    end
+  end)
+  -- Exact counts depend on timing: only check what stop guarantees.
+  for i = 1, 1000 do
+    -- Triggered on start.
+    assertTrue(counts[i] >= 1)
+    -- Nothing after stop.
+    assertEqual(at_stop[i], counts[i])
+  end
+  assertEqual(-1, s:wakeAt())
+end
+
 should:test()
 
 
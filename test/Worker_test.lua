@@ -0,0 +1,74 @@
+--[[------------------------------------------------------
+
+  lens.Worker test
+  ----------------
+
+  ...
+
+--]]------------------------------------------------------
+local lens   = require 'lens'
+local lut    = require 'lut'
+local should = lut.Test 'lens.Worker'
+
+local Worker,      Mailbox =
+      lens.Worker, lens.Mailbox
+
+local ECHO = [[
+  local lens = require 'lens'
+  local inbox, outbox = ...
+  lens.sched():run(function()
+    while true do
+      local msg = inbox:receive()
+      if msg == 'quit' then break end
+      outbox:post(msg:upper())
+    end
+  end)
+]]
+
+function should.autoload()
+  assertType('table', Worker)
+end
+
+function should.exchangeMessages()
+  local inbox, outbox = Mailbox(), Mailbox()
+  local w = Worker(ECHO, inbox, outbox)
+  local res = {}
+  local s = lens.Scheduler()
+  s:run(function()
+    for i = 1, 100 do
+      inbox:post('msg'..i)
+    end
+    inbox:post('quit')
+    for i = 1, 100 do
+      res[i] = outbox:receive()
+    end
+  end)
+  w:join()
+  assertEqual('MSG1', res[1])
+  assertEqual('MSG100', res[100])
+  assertFalse(w:running())
+end
+
+function should.runOneWorkerPerCore()
+  local outbox = Mailbox()
+  local workers = {}
+  for i = 1, 4 do
+    local inbox = Mailbox()
+    workers[i] = Worker(ECHO, inbox, outbox)
+    inbox:post('w'..i)
+    inbox:post('quit')
+  end
+  local res = {}
+  local s = lens.Scheduler()
+  s:run(function()
+    for i = 1, 4 do
+      res[outbox:receive()] = true
+    end
+  end)
+  for i = 1, 4 do
+    workers[i]:join()
+  end
+  assertValueEqual({W1 = true, W2 = true, W3 = true, W4 = true}, res)
+end
+
+should:test()
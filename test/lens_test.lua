@@ -25,6 +25,25 @@ function should.millisleep()
   assertEqual(0, unslept)
 end
 
+function should.packAndUnpack()
+  local values = {
+    true, false, 0, 127, 128, -1, -33, 65536, 2^40, -2^40, 1.5, -0.25,
+    '', 'hello', string.rep('x', 300), {}, {1, 2, 3},
+    {a = 1, b = {c = 'd'}}, {1, 2, nil, 4},
+  }
+  for _, v in ipairs(values) do
+    assertValueEqual(v, lens.unpack(lens.pack(v)))
+  end
+  assertNil(lens.unpack(lens.pack(nil)))
+  assertEqual('\147\1\2\3', lens.pack {1, 2, 3})
+  assertError('Cannot pack value of type', function()
+    lens.pack(print)
+  end)
+  assertError('truncated data', function()
+    lens.unpack('\147\1')
+  end)
+end
+
 function should.sleep()
   local s = lens.Scheduler()
   local t